@@ -0,0 +1,223 @@
+"""Times cbe, ninja and make on the trees of generate_heavy_repo.py.
+
+Every tool builds its own copy of the same generated tree, at every scale, through the same scenarios:
+
+  clean         build from scratch, tool state included
+  noop          build again with nothing changed
+  touch_header  touch one header that only sources include, then build
+  touch_source  touch one source file, then build
+  regenerate    rewrite the manifest with the same content, then build
+
+Each scenario runs --trials times; the report gives the median and p90 of the wall time and the median CPU time of
+the tool and its children. For cbe, one more run of every scenario is traced with --trace and its phase timings
+are reported. All samples are written to --json.
+"""
+
+import argparse
+import json
+import os
+import re
+import resource
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+GENERATOR = os.path.join(SCRIPT_DIR, "generate_heavy_repo.py")
+
+TOOLS = ["cbe", "ninja", "make"]
+SCENARIOS = ["clean", "noop", "touch_header", "touch_source", "regenerate"]
+MANIFESTS = {"cbe": "catalyst.build", "ninja": "build.ninja", "make": "Makefile"}
+TOOL_STATE = [".catalyst.bin", ".catalyst.usage", ".ninja_log", ".ninja_deps"]
+
+
+def percentile(samples, fraction):
+    ordered = sorted(samples)
+    return ordered[min(len(ordered) - 1, round(fraction * (len(ordered) - 1)))]
+
+
+def generate_tree(root, sources, headers, args):
+    command = [sys.executable, GENERATOR, "--root", root, "--sources", str(sources), "--headers", str(headers),
+               "--cxx", args.cxx, "--seed", str(args.seed)]
+    if args.fake_costs:
+        command += ["--fake-costs", args.fake_costs, "--fake-link-us", str(args.fake_link_us)]
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+
+
+def leaf_header(tree):
+    """The highest-numbered header that a source includes; headers only include lower-numbered ones, so no
+    other header includes it and touching it rebuilds only its includers."""
+    included = set()
+    src_dir = os.path.join(tree, "src")
+    for name in os.listdir(src_dir):
+        with open(os.path.join(src_dir, name)) as f:
+            included.update(int(m) for m in re.findall(r'#include "header_(\d+)\.hpp"', f.read()))
+    return os.path.join(tree, "include", f"header_{max(included)}.hpp")
+
+
+def touch(path):
+    # Strictly newer than anything built so far, whatever the file system's timestamp granularity.
+    now = time.time_ns() + 1_000_000_000
+    os.utime(path, ns=(now, now))
+
+
+class Runner:
+    def __init__(self, tool, binary, tree, jobs):
+        self.tool = tool
+        self.binary = binary
+        self.tree = tree
+        self.jobs = jobs
+        self.manifest = os.path.join(tree, MANIFESTS[tool])
+        self.header = leaf_header(tree)
+        self.source = os.path.join(tree, "src", "source_0.cpp")
+
+    def build(self, extra_args=()):
+        """Builds the tree; returns the wall and CPU time in seconds."""
+        before = resource.getrusage(resource.RUSAGE_CHILDREN)
+        start = time.perf_counter()
+        result = subprocess.run([self.binary, "-j", str(self.jobs), *extra_args], cwd=self.tree,
+                                stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+        wall = time.perf_counter() - start
+        after = resource.getrusage(resource.RUSAGE_CHILDREN)
+        if result.returncode != 0:
+            sys.exit(f"{self.tool} failed in {self.tree} (exit code {result.returncode}):\n{result.stderr}")
+        cpu = (after.ru_utime - before.ru_utime) + (after.ru_stime - before.ru_stime)
+        return wall, cpu
+
+    def clean(self):
+        shutil.rmtree(os.path.join(self.tree, "build"), ignore_errors=True)
+        os.makedirs(os.path.join(self.tree, "build"))
+        for name in TOOL_STATE:
+            path = os.path.join(self.tree, name)
+            if os.path.exists(path):
+                os.remove(path)
+
+    def prepare(self, scenario):
+        """Puts the tree in the state the scenario starts from, untimed."""
+        if scenario == "clean":
+            self.clean()
+            return
+        self.build()  # Up to date before the change.
+        if scenario == "touch_header":
+            touch(self.header)
+        elif scenario == "touch_source":
+            touch(self.source)
+        elif scenario == "regenerate":
+            with open(self.manifest) as f:
+                content = f.read()
+            with open(self.manifest, "w") as f:
+                f.write(content)
+            touch(self.manifest)
+
+    def phases(self, scenario):
+        """Phase timings of cbe, in milliseconds, from one traced run of the scenario."""
+        self.prepare(scenario)
+        with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as f:
+            trace_path = f.name
+        try:
+            self.build(["--trace", trace_path])
+            with open(trace_path) as f:
+                events = json.load(f)["traceEvents"]
+        finally:
+            os.remove(trace_path)
+        phases = {}
+        for event in events:
+            if event.get("cat") == "phase" and event.get("ph") == "X":
+                phases[event["name"]] = phases.get(event["name"], 0.0) + event["dur"] / 1000.0
+        return phases
+
+
+def summarize(samples):
+    walls = [wall for wall, _ in samples]
+    cpus = [cpu for _, cpu in samples]
+    return {"median_s": statistics.median(walls), "p90_s": percentile(walls, 0.9), "min_s": min(walls),
+            "cpu_median_s": statistics.median(cpus), "wall_s": walls, "cpu_s": cpus}
+
+
+def print_scale(sources, results):
+    print(f"\n== {sources} sources ==")
+    print(f"{'scenario':<14}{'tool':<8}{'median':>10}{'p90':>10}{'cpu':>10}")
+    for scenario in SCENARIOS:
+        for tool, by_scenario in results.items():
+            if scenario not in by_scenario:
+                continue
+            s = by_scenario[scenario]
+            print(f"{scenario:<14}{tool:<8}{s['median_s']:>9.3f}s{s['p90_s']:>9.3f}s{s['cpu_median_s']:>9.3f}s")
+            for name, ms in s.get("phases_ms", {}).items():
+                print(f"{'':<22}{name:<28}{ms:>9.1f}ms")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--scales", default="100,1000", help="comma-separated numbers of sources")
+    parser.add_argument("--headers-per-source", type=float, default=1.0,
+                        help="headers generated per source (default: 1)")
+    parser.add_argument("--trials", type=int, default=5, help="timed runs of every scenario")
+    parser.add_argument("--tools", default=",".join(TOOLS), help="comma-separated tools to compare")
+    parser.add_argument("--scenarios", default=",".join(SCENARIOS), help="comma-separated scenarios to run")
+    parser.add_argument("--cbe", default="cbe", help="cbe binary")
+    parser.add_argument("--ninja", default="ninja", help="ninja binary")
+    parser.add_argument("--make", default="make", help="make binary")
+    parser.add_argument("--cxx", default="clang++", help="C++ compiler the generated manifests invoke")
+    parser.add_argument("--fake-costs", metavar="SPEC",
+                        help="compile times for cbe_fake_cc, passed as --cxx; see generate_heavy_repo.py")
+    parser.add_argument("--fake-link-us", type=int, default=0, help="time the fake link takes")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="parallel jobs for every tool")
+    parser.add_argument("--seed", type=int, default=1, help="seed of the generated include graphs")
+    parser.add_argument("--workdir", help="where trees are generated (default: a temporary directory, removed)")
+    parser.add_argument("--json", default="compare_builds.json", help="where all samples are written")
+    args = parser.parse_args()
+
+    binaries = {"cbe": args.cbe, "ninja": args.ninja, "make": args.make}
+    tools = []
+    for tool in args.tools.split(","):
+        if shutil.which(binaries[tool]) is None:
+            print(f"Skipping {tool}: {binaries[tool]} not found", file=sys.stderr)
+        else:
+            tools.append(tool)
+    scenarios = args.scenarios.split(",")
+    for scenario in scenarios:
+        if scenario not in SCENARIOS:
+            sys.exit(f"Unknown scenario: {scenario}")
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix="cbe_compare_")
+    report = {"jobs": args.jobs, "trials": args.trials, "cxx": args.cxx, "scales": {}}
+    try:
+        for sources in (int(s) for s in args.scales.split(",")):
+            headers = max(1, int(sources * args.headers_per_source))
+            pristine = os.path.join(workdir, f"{sources}_sources", "pristine")
+            print(f"Generating {sources} sources, {headers} headers...")
+            shutil.rmtree(os.path.dirname(pristine), ignore_errors=True)
+            generate_tree(pristine, sources, headers, args)
+
+            results = {}
+            for tool in tools:
+                tree = os.path.join(os.path.dirname(pristine), tool)
+                shutil.copytree(pristine, tree)
+                runner = Runner(tool, shutil.which(binaries[tool]), tree, args.jobs)
+                results[tool] = {}
+                for scenario in scenarios:
+                    samples = []
+                    for _ in range(args.trials):
+                        runner.prepare(scenario)
+                        samples.append(runner.build())
+                    results[tool][scenario] = summarize(samples)
+                    if tool == "cbe":
+                        results[tool][scenario]["phases_ms"] = runner.phases(scenario)
+                shutil.rmtree(tree)
+            report["scales"][str(sources)] = results
+            print_scale(sources, results)
+    finally:
+        if args.workdir is None:
+            shutil.rmtree(workdir, ignore_errors=True)
+
+    with open(args.json, "w") as f:
+        json.dump(report, f, indent=2)
+    print(f"\nResults written to {args.json}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,215 @@
+/**
+ * @file fake_cc.cpp
+ * @brief A stand-in for a C++ compiler driver, to benchmark build scheduling without compiling anything.
+ *
+ * Accepts the command lines of the `cc`/`cxx`/`ld`/`sld` tools (and of GCC/Clang in general) and behaves like the
+ * compiler as far as a build system can tell: it takes some time, writes the output and, for compiles, a depfile
+ * listing every header the source includes, transitively. Unknown flags are ignored.
+ *
+ * The time a compile takes is read from the source, from a line `// fake-cc: <microseconds>`, so every step of a
+ * generated tree can be given its own cost without a per-step flag. Flags specific to this tool:
+ *
+ *   -fake-cost-us=<n>   Take <n> microseconds, whatever the source says (links have no source to read).
+ *   -fake-spin          Burn CPU for the duration instead of sleeping, to load the machine like a compiler.
+ *   -fake-size=<n>      Size of the output file, in bytes (default: 4096).
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <print>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+struct Options {
+    bool compile = false;
+    bool spin = false;
+    std::string output;
+    std::string depfile;
+    std::vector<std::string> inputs;
+    std::vector<fs::path> include_dirs;
+    std::optional<uint64_t> cost_us;
+    uint64_t size = 4096;
+};
+
+std::optional<std::string> readFile(const fs::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return std::nullopt;
+    std::ostringstream content;
+    content << file.rdbuf();
+    return std::move(content).str();
+}
+
+uint64_t parseNumber(std::string_view text) {
+    uint64_t value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9')
+            break;
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return value;
+}
+
+/** @brief Calls `fn` with the target of every `#include "..."` line; angled includes are system headers. */
+void forEachInclude(std::string_view content, auto &&fn) {
+    size_t pos = 0;
+    while ((pos = content.find("#include \"", pos)) != std::string_view::npos) {
+        pos += 10;
+        const size_t end = content.find('"', pos);
+        if (end == std::string_view::npos)
+            return;
+        fn(content.substr(pos, end - pos));
+        pos = end + 1;
+    }
+}
+
+/** @brief Collects the headers a file includes, transitively, in the order a preprocessor first opens them. */
+void collectHeaders(const fs::path &file, std::string_view content, const Options &options,
+                    std::unordered_set<std::string> &seen, std::vector<std::string> &headers) {
+    forEachInclude(content, [&](std::string_view name) {
+        std::vector<fs::path> candidates{file.parent_path() / name};
+        for (const fs::path &dir : options.include_dirs) {
+            candidates.push_back(dir / name);
+        }
+        for (const fs::path &candidate : candidates) {
+            std::string path = candidate.lexically_normal().string();
+            if (seen.contains(path))
+                return; // Include guards: a header is only opened once.
+            auto header = readFile(candidate);
+            if (!header)
+                continue;
+            seen.insert(path);
+            headers.push_back(std::move(path));
+            collectHeaders(candidate, *header, options, seen, headers);
+            return;
+        }
+    });
+}
+
+void appendEscaped(std::string &out, std::string_view path) {
+    for (char c : path) {
+        if (c == ' ' || c == '#')
+            out += '\\';
+        out += c;
+    }
+}
+
+void takeTime(uint64_t cost_us, bool spin) {
+    const auto duration = std::chrono::microseconds(cost_us);
+    if (!spin) {
+        std::this_thread::sleep_for(duration);
+        return;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + duration;
+    volatile uint64_t sink = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+        for (int i = 0; i < 1000; ++i) {
+            sink = sink + static_cast<uint64_t>(i);
+        }
+    }
+}
+
+Options parseArgs(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "-c") {
+            options.compile = true;
+        } else if (arg == "-o" && has_value) {
+            options.output = argv[++i];
+        } else if (arg == "-MF" && has_value) {
+            options.depfile = argv[++i];
+        } else if ((arg == "-MT" || arg == "-MQ" || arg == "-isystem" || arg == "-include") && has_value) {
+            ++i;
+        } else if (arg == "-I" && has_value) {
+            options.include_dirs.emplace_back(argv[++i]);
+        } else if (arg.starts_with("-I")) {
+            options.include_dirs.emplace_back(arg.substr(2));
+        } else if (arg.starts_with("-fake-cost-us=")) {
+            options.cost_us = parseNumber(arg.substr(14));
+        } else if (arg == "-fake-spin") {
+            options.spin = true;
+        } else if (arg.starts_with("-fake-size=")) {
+            options.size = parseNumber(arg.substr(11));
+        } else if (!arg.starts_with('-')) {
+            options.inputs.emplace_back(arg);
+        }
+    }
+    return options;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    const Options options = parseArgs(argc, argv);
+    if (options.output.empty() || options.inputs.empty()) {
+        std::println(stderr, "fake_cc: usage: fake_cc [-c] [-I<dir>]... [-MF <depfile>] <inputs>... -o <output>");
+        return 2;
+    }
+
+    uint64_t cost_us = options.cost_us.value_or(0);
+    std::vector<std::string> headers;
+    if (options.compile) {
+        auto source = readFile(options.inputs.front());
+        if (!source) {
+            std::println(stderr, "fake_cc: {}: No such file or directory", options.inputs.front());
+            return 1;
+        }
+        if (!options.cost_us) {
+            if (size_t pos = source->find("// fake-cc: "); pos != std::string::npos)
+                cost_us = parseNumber(std::string_view(*source).substr(pos + 12));
+        }
+        std::unordered_set<std::string> seen;
+        collectHeaders(options.inputs.front(), *source, options, seen, headers);
+    } else {
+        for (const std::string &input : options.inputs) {
+            if (!fs::exists(input)) {
+                std::println(stderr, "fake_cc: {}: No such file or directory", input);
+                return 1;
+            }
+        }
+    }
+
+    takeTime(cost_us, options.spin);
+
+    std::ofstream output(options.output, std::ios::binary | std::ios::trunc);
+    const std::string block(static_cast<size_t>(std::min<uint64_t>(options.size, 1 << 16)), '\0');
+    for (uint64_t written = 0; written < options.size; written += block.size()) {
+        const uint64_t chunk = std::min<uint64_t>(block.size(), options.size - written);
+        output.write(block.data(), static_cast<std::streamsize>(chunk));
+    }
+    if (!output) {
+        std::println(stderr, "fake_cc: cannot write {}", options.output);
+        return 1;
+    }
+
+    if (options.compile && !options.depfile.empty()) {
+        std::string depfile;
+        appendEscaped(depfile, options.output);
+        depfile += ':';
+        for (const std::string &dependency : options.inputs) {
+            depfile += ' ';
+            appendEscaped(depfile, dependency);
+        }
+        for (const std::string &header : headers) {
+            depfile += " \\\n ";
+            appendEscaped(depfile, header);
+        }
+        depfile += '\n';
+        std::ofstream(options.depfile, std::ios::binary | std::ios::trunc) << depfile;
+    }
+    return 0;
+}
@@ -1,3 +1,5 @@
+import argparse
+import math
 import os
 import random
 
@@ -10,6 +12,11 @@ NUM_HEADERS = 1000
 NUM_SOURCES = 1000
 HEADERS_PER_HEADER = 3
 HEADERS_PER_SOURCE = 10
+CXX = "clang++"
+CXXFLAGS = "-std=c++20 -O0 -Iinclude"
+LDFLAGS = ""
+# Compile time of every source in microseconds, written for fake_cc to read; None for real compilers.
+FAKE_COSTS = None
 
 
 def ensure_dirs():
@@ -37,6 +44,28 @@ def generate_headers():
             f.write(f"\ninline int func_{i}() {{ return {i}; }}\n")
 
 
+def fake_costs(spec, count, rng):
+    """Compile times for fake_cc: `constant:<us>`, `lognormal:<median_us>:<sigma>`, or `replay:<usage log>`,
+    which reuses the wall times of the cc/cxx steps recorded in a `.catalyst.usage`, in turn."""
+    kind, _, params = spec.partition(":")
+    if kind == "constant":
+        return [int(params)] * count
+    if kind == "lognormal":
+        median, sigma = params.split(":")
+        return [int(rng.lognormvariate(math.log(float(median)), float(sigma))) for _ in range(count)]
+    if kind == "replay":
+        recorded = []
+        with open(params) as f:
+            for line in f:
+                fields = line.rstrip("\n").split("\t")
+                if not line.startswith("#") and len(fields) == 8 and fields[1] in ("cc", "cxx"):
+                    recorded.append(int(fields[2]))
+        if not recorded:
+            raise SystemExit(f"No compile steps recorded in {params}")
+        return [recorded[i % len(recorded)] for i in range(count)]
+    raise SystemExit(f"Unknown cost distribution: {spec}")
+
+
 def generate_sources():
     source_files = []
     for i in range(NUM_SOURCES):
@@ -45,6 +74,8 @@ def generate_sources():
         source_files.append(name)
         with open(filename, "w") as f:
             f.write(f"// Source {i}\n")
+            if FAKE_COSTS is not None:
+                f.write(f"// fake-cc: {FAKE_COSTS[i]}\n")
 
             # Include random headers
             deps = random.sample(range(NUM_HEADERS), min(
@@ -80,10 +111,10 @@ def generate_catalyst_manifest(source_files):
     manifest_path = os.path.join(ROOT_DIR, "catalyst.build")
     with open(manifest_path, "w") as f:
         f.write("DEF|cc|clang\n")
-        f.write("DEF|cxx|clang++\n")
+        f.write(f"DEF|cxx|{CXX}\n")
         f.write("DEF|cflags|\n")
-        f.write("DEF|cxxflags|-std=c++20 -O0 -Iinclude\n")
-        f.write("DEF|ldflags|\n")
+        f.write(f"DEF|cxxflags|{CXXFLAGS}\n")
+        f.write(f"DEF|ldflags|{LDFLAGS}\n")
         f.write("DEF|ldlibs|\n")
 
         obj_files = []
@@ -107,9 +138,9 @@ def generate_ninja_manifest(source_files):
     manifest_path = os.path.join(ROOT_DIR, "build.ninja")
     with open(manifest_path, "w") as f:
         # Preamble: Variables
-        f.write("cxx = clang++\n")
-        f.write("cxxflags = -std=c++20 -O0 -Iinclude\n")
-        f.write("ldflags = \n")
+        f.write(f"cxx = {CXX}\n")
+        f.write(f"cxxflags = {CXXFLAGS}\n")
+        f.write(f"ldflags = {LDFLAGS}\n")
         f.write("\n")
 
         f.write("rule cxx\n")
@@ -146,9 +177,9 @@ def generate_ninja_manifest(source_files):
 def generate_makefile(source_files):
     manifest_path = os.path.join(ROOT_DIR, "Makefile")
     with open(manifest_path, "w") as f:
-        f.write("CXX = clang++\n")
-        f.write("CXXFLAGS = -std=c++20 -O0 -Iinclude\n")
-        f.write("LDFLAGS = \n")
+        f.write(f"CXX = {CXX}\n")
+        f.write(f"CXXFLAGS = {CXXFLAGS}\n")
+        f.write(f"LDFLAGS = {LDFLAGS}\n")
         f.write("\n")
 
         obj_files = []
@@ -178,6 +209,35 @@ def generate_makefile(source_files):
 
 
 if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Generates equivalent catalyst, ninja and make builds of a "
+                                     "synthetic C++ project.")
+    parser.add_argument("--root", default=ROOT_DIR, help="directory to generate into")
+    parser.add_argument("--sources", type=int, default=NUM_SOURCES, help="number of source files")
+    parser.add_argument("--headers", type=int, default=NUM_HEADERS, help="number of header files")
+    parser.add_argument("--cxx", default=CXX, help="C++ compiler the manifests invoke")
+    parser.add_argument("--seed", type=int, help="seed of the include graph, for reproducible trees")
+    parser.add_argument("--fake-costs", metavar="SPEC",
+                        help="build with fake_cc (pass it as --cxx): give every source a compile time drawn from "
+                        "constant:<us>, lognormal:<median_us>:<sigma> or replay:<.catalyst.usage>")
+    parser.add_argument("--fake-link-us", type=int, default=0, help="time the fake link takes")
+    parser.add_argument("--fake-spin", action="store_true", help="make fake_cc burn CPU instead of sleeping")
+    args = parser.parse_args()
+
+    ROOT_DIR = args.root
+    SRC_DIR = os.path.join(ROOT_DIR, "src")
+    INCLUDE_DIR = os.path.join(ROOT_DIR, "include")
+    BUILD_DIR = os.path.join(ROOT_DIR, "build")
+    NUM_SOURCES = args.sources
+    NUM_HEADERS = args.headers
+    CXX = args.cxx
+    random.seed(args.seed)
+    if args.fake_costs:
+        # Drawn from a generator of their own, so a seed gives the same include graph with or without costs.
+        FAKE_COSTS = fake_costs(args.fake_costs, NUM_SOURCES, random.Random(args.seed))
+        LDFLAGS = f"-fake-cost-us={args.fake_link_us}"
+        if args.fake_spin:
+            CXXFLAGS += " -fake-spin"
+
     ensure_dirs()
     print("Generating headers...")
     generate_headers()
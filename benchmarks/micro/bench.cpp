@@ -0,0 +1,72 @@
+#include "bench/bench.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <print>
+#include <string_view>
+
+namespace {
+void printHelp() {
+    std::println("Usage: cbe_bench [options]\n"
+                 "  -o, --out <file>      Write the results as JSON (default: cbe_bench.json)\n"
+                 "  -f, --filter <text>   Only run benchmarks whose name contains <text>\n"
+                 "  --max-steps <n>       Largest synthetic manifest, in steps (default: 1000000)\n"
+                 "  --min-time <ms>       Time to sample each benchmark for, at least (default: 500)\n"
+                 "  -h, --help            Show this help");
+}
+
+bool parseSize(const char *text, size_t &value) {
+    const char *end = text + std::strlen(text);
+    auto [ptr, ec] = std::from_chars(text, end, value);
+    return ec == std::errc{} && ptr == end;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    bench::Options options;
+    std::filesystem::path out = "cbe_bench.json";
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        size_t number = 0;
+        if ((arg == "-o" || arg == "--out") && has_value) {
+            out = argv[++i];
+        } else if ((arg == "-f" || arg == "--filter") && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--max-steps" && has_value && parseSize(argv[++i], number)) {
+            options.max_steps = number;
+        } else if (arg == "--min-time" && has_value && parseSize(argv[++i], number)) {
+            options.min_time = static_cast<double>(number) / 1000.0;
+        } else if (arg == "-h" || arg == "--help") {
+            printHelp();
+            return 0;
+        } else {
+            std::println(stderr, "Invalid argument: {}", arg);
+            printHelp();
+            return 1;
+        }
+    }
+
+    // Manifests and `.catalyst.bin` are written to the working directory; keep them out of the caller's.
+    out = std::filesystem::absolute(out);
+    const std::filesystem::path scratch = std::filesystem::temp_directory_path() / "cbe_bench";
+    std::filesystem::remove_all(scratch);
+    std::filesystem::create_directories(scratch);
+    std::filesystem::current_path(scratch);
+
+    bench::Runner runner(options);
+    depfile_bench(runner);
+    graph_bench(runner);
+    manifest_bench(runner);
+    stat_cache_bench(runner);
+
+    std::filesystem::current_path(scratch.parent_path());
+    std::filesystem::remove_all(scratch);
+    if (auto res = runner.write_json(out.string()); !res) {
+        std::println(stderr, "{}", res.error());
+        return 1;
+    }
+    std::println("Results written to {}", out.string());
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "bench/bench.hpp"
+
+#include "cbe/depfile.hpp"
+
+#include <format>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace catalyst;
+
+namespace {
+/**
+ * @brief A depfile as clang writes it for a translation unit of a large project: the source, then system and
+ * project headers, two per line, joined by line continuations. Some paths contain escaped spaces.
+ */
+std::string clangDepfile(size_t unit, size_t headers, std::mt19937 &random) {
+    std::string content = std::format("obj/m{0}/f{1}.o: src/m{0}/f{1}.cpp", unit / 500, unit % 500);
+    auto out = std::back_inserter(content);
+    std::uniform_int_distribution<size_t> pick(0, 4999);
+    for (size_t h = 0; h < headers; ++h) {
+        std::format_to(out, "{}", h % 2 == 0 ? " \\\n " : " ");
+        const size_t id = pick(random);
+        if (h < headers / 2) {
+            std::format_to(out, "/usr/lib/gcc/x86_64-linux-gnu/13/../../../../include/c++/13/bits/header_{}.h", id);
+        } else if (id % 50 == 0) {
+            std::format_to(out, "third\\ party/include/lib{}/api.hpp", id);
+        } else {
+            std::format_to(out, "include/module_{}/header_{}.hpp", id / 100, id);
+        }
+    }
+    content += '\n';
+    return content;
+}
+} // namespace
+
+void depfile_bench(bench::Runner &runner) {
+    constexpr size_t TUNABLE_DEPFILES = 1000;
+    if (!runner.selected("parseDepfile"))
+        return;
+
+    for (size_t headers : {20, 200, 800}) {
+        std::mt19937 random(42);
+        std::vector<std::string> depfiles;
+        depfiles.reserve(TUNABLE_DEPFILES);
+        size_t dependencies = 0;
+        for (size_t unit = 0; unit < TUNABLE_DEPFILES; ++unit) {
+            depfiles.push_back(clangDepfile(unit, headers, random));
+            parseDepfile(depfiles.back(), [&](std::string_view) { ++dependencies; });
+        }
+
+        runner.run(std::format("parseDepfile/{}_headers", headers), dependencies, [&] {
+            size_t length = 0;
+            for (const std::string &depfile : depfiles) {
+                parseDepfile(depfile, [&](std::string_view dependency) { length += dependency.size(); });
+            }
+            bench::doNotOptimize(length);
+        });
+    }
+}
@@ -0,0 +1,70 @@
+#include "bench/bench.hpp"
+
+#include "cbe/domain.hpp"
+#include "cbe/graph.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <format>
+#include <optional>
+#include <print>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace catalyst;
+
+namespace {
+/** @brief The steps of a manifest, as views into it; definitions are skipped. */
+std::vector<BuildStep> splitSteps(std::string_view manifest) {
+    std::vector<BuildStep> steps;
+    while (!manifest.empty()) {
+        const size_t newline = manifest.find('\n');
+        const std::string_view line = manifest.substr(0, newline);
+        manifest.remove_prefix(newline == std::string_view::npos ? manifest.size() : newline + 1);
+        if (line.starts_with("DEF|"))
+            continue;
+        const size_t first = line.find('|');
+        const size_t second = line.find('|', first + 1);
+        steps.push_back({.tool = line.substr(0, first),
+                         .inputs = line.substr(first + 1, second - first - 1),
+                         .output = line.substr(second + 1)});
+    }
+    return steps;
+}
+
+void addSteps(BuildGraph &graph, const std::vector<BuildStep> &steps) {
+    for (const BuildStep &step : steps) {
+        if (auto res = graph.add_step(step); !res) {
+            std::println(stderr, "add_step: {}", res.error());
+            std::exit(1);
+        }
+    }
+}
+} // namespace
+
+void graph_bench(bench::Runner &runner) {
+    const size_t hardware_threads = std::max(1U, std::thread::hardware_concurrency());
+    for (size_t scale : bench::manifestScales(runner.options())) {
+        const std::string manifest = bench::syntheticManifest(scale);
+        const std::vector<BuildStep> steps = splitSteps(manifest);
+
+        std::optional<BuildGraph> graph;
+        runner.run(
+            std::format("add_step/{}", scale), steps.size(), [&] { addSteps(*graph, steps); },
+            [&] { graph.emplace(); });
+
+        BuildGraph finalized;
+        addSteps(finalized, steps);
+        finalized.finalize();
+        for (size_t threads : {size_t{1}, hardware_threads}) {
+            runner.run(std::format("topo_sort/{}_threads/{}", threads, scale), finalized.node_count(), [&] {
+                auto levels = finalized.topo_sort(threads);
+                bench::doNotOptimize(levels);
+            });
+            if (hardware_threads == 1)
+                break;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#include "bench/bench.hpp"
+
+#include "cbe/binary.hpp"
+#include "cbe/builder.hpp"
+#include "cbe/parser.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <print>
+#include <string>
+
+using namespace catalyst;
+
+namespace {
+void require(const Result<void> &res, std::string_view what) {
+    if (!res) {
+        std::println(stderr, "{}: {}", what, res.error());
+        std::exit(1);
+    }
+}
+} // namespace
+
+void manifest_bench(bench::Runner &runner) {
+    for (size_t steps : bench::manifestScales(runner.options())) {
+        const std::string parse_name = std::format("parse/{}", steps);
+        const std::string emit_name = std::format("emit_bin/{}", steps);
+        const std::string load_name = std::format("parse_bin/{}", steps);
+        if (!runner.selected(parse_name) && !runner.selected(emit_name) && !runner.selected(load_name))
+            continue;
+
+        const std::string path = std::format("manifest_{}.build", steps);
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << bench::syntheticManifest(steps);
+
+        // A fresh builder per sample, destroyed outside the timed region. `parse()` loads `.catalyst.bin` when it
+        // is newer than the manifest, so the cache is removed first; with the binary feature on, the time includes
+        // writing the cache back, which `emit_bin` measures on its own.
+        std::optional<CBEBuilder> builder;
+        runner.run(
+            parse_name, steps, [&] { require(parse(*builder, path), "parse"); },
+            [&] {
+                std::filesystem::remove(".catalyst.bin");
+                builder.emplace();
+            });
+
+        CBEBuilder parsed;
+        std::filesystem::remove(".catalyst.bin");
+        require(parse(parsed, path), "parse");
+        runner.run(emit_name, steps, [&] { require(emit_bin(parsed), "emit_bin"); });
+
+        require(emit_bin(parsed), "emit_bin");
+        runner.run(
+            load_name, steps, [&] { require(parse_bin(*builder), "parse_bin"); }, [&] { builder.emplace(); });
+        builder.reset();
+        std::filesystem::remove(path);
+    }
+}
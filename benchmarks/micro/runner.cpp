@@ -0,0 +1,143 @@
+#include "bench/bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <print>
+#include <thread>
+
+namespace {
+uint64_t percentile(const std::vector<uint64_t> &sorted, double fraction) {
+    const auto rank = static_cast<size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+/** @brief `1234567` as `1.23ms`, for the console summary. */
+std::string formatDuration(uint64_t ns) {
+    if (ns >= 1'000'000'000)
+        return std::format("{:.2f}s", static_cast<double>(ns) / 1e9);
+    if (ns >= 1'000'000)
+        return std::format("{:.2f}ms", static_cast<double>(ns) / 1e6);
+    if (ns >= 1'000)
+        return std::format("{:.2f}us", static_cast<double>(ns) / 1e3);
+    return std::format("{}ns", ns);
+}
+} // namespace
+
+namespace bench {
+
+bool Runner::selected(std::string_view name) const {
+    return options_.filter.empty() || name.find(options_.filter) != std::string_view::npos;
+}
+
+void Runner::run(std::string name, uint64_t items, const std::function<void()> &body,
+                 const std::function<void()> &setup) {
+    if (!selected(name))
+        return;
+    using Clock = std::chrono::steady_clock;
+
+    if (setup)
+        setup();
+    body(); // Warm up caches, allocators and the page cache.
+
+    Measurement measurement{.name = std::move(name), .items = items, .sample_ns = {}};
+    uint64_t total_ns = 0;
+    const auto min_total_ns = static_cast<uint64_t>(options_.min_time * 1e9);
+    while (measurement.sample_ns.size() < options_.max_samples &&
+           (measurement.sample_ns.size() < options_.min_samples || total_ns < min_total_ns)) {
+        if (setup)
+            setup();
+        const auto begin = Clock::now();
+        body();
+        const auto ns = static_cast<uint64_t>(std::chrono::nanoseconds(Clock::now() - begin).count());
+        measurement.sample_ns.push_back(ns);
+        total_ns += ns;
+    }
+
+    std::vector<uint64_t> sorted = measurement.sample_ns;
+    std::ranges::sort(sorted);
+    measurement.min_ns = sorted.front();
+    measurement.median_ns = percentile(sorted, 0.5);
+    measurement.p90_ns = percentile(sorted, 0.9);
+    measurement.mean_ns = total_ns / sorted.size();
+
+    const double per_item = items == 0 ? 0.0 : static_cast<double>(measurement.median_ns) / static_cast<double>(items);
+    std::println("{:<44} median {:>10}  p90 {:>10}  {:>9.1f} ns/item  ({} samples)", measurement.name,
+                 formatDuration(measurement.median_ns), formatDuration(measurement.p90_ns), per_item,
+                 sorted.size());
+    measurements_.push_back(std::move(measurement));
+}
+
+catalyst::Result<void> Runner::write_json(const std::string &path) const {
+    using JSON = nlohmann::json;
+    JSON benchmarks = JSON::array();
+    for (const Measurement &m : measurements_) {
+        benchmarks.push_back({{"name", m.name},
+                              {"items", m.items},
+                              {"samples", m.sample_ns.size()},
+                              {"min_ns", m.min_ns},
+                              {"median_ns", m.median_ns},
+                              {"p90_ns", m.p90_ns},
+                              {"mean_ns", m.mean_ns},
+                              {"sample_ns", m.sample_ns}});
+    }
+    const JSON context = {{"version", CATALYST_PROJ_VER},
+                          {"hardware_concurrency", std::thread::hardware_concurrency()},
+                          {"unix_time", std::chrono::duration_cast<std::chrono::seconds>(
+                                            std::chrono::system_clock::now().time_since_epoch())
+                                            .count()}};
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+        return std::unexpected(std::format("Failed to open {}", path));
+    file << JSON{{"context", context}, {"benchmarks", std::move(benchmarks)}}.dump(2) << '\n';
+    if (!file)
+        return std::unexpected(std::format("Failed to write {}", path));
+    return {};
+}
+
+std::vector<size_t> manifestScales(const Options &options) {
+    std::vector<size_t> scales;
+    for (size_t steps = 10'000; steps <= options.max_steps; steps *= 10) {
+        scales.push_back(steps);
+    }
+    return scales;
+}
+
+std::string syntheticManifest(size_t steps) {
+    constexpr size_t TUNABLE_ARCHIVE_SIZE = 500;
+    constexpr size_t TUNABLE_GENERATED_HEADERS = 16;
+
+    std::string manifest = "DEF|cc|clang\nDEF|cxx|clang++\nDEF|cflags|\nDEF|cxxflags|-std=c++20 -O2 -Iinclude\n"
+                           "DEF|ldflags|\nDEF|ldlibs|\n";
+    manifest.reserve(steps * 72);
+    auto out = std::back_inserter(manifest);
+
+    // Every step but the link is either a compile or, after every `TUNABLE_ARCHIVE_SIZE` compiles, an archive.
+    std::string archives;
+    size_t module = 0;
+    size_t in_module = 0;
+    for (size_t step = 0; step + 1 < steps; ++step) {
+        if (in_module == TUNABLE_ARCHIVE_SIZE || (step + 2 == steps && in_module > 0)) {
+            std::format_to(out, "ar|");
+            for (size_t i = 0; i < in_module; ++i) {
+                std::format_to(out, "{}obj/m{}/f{}.o", i == 0 ? "" : ",", module, i);
+            }
+            std::format_to(out, "|lib/libm{}.a\n", module);
+            std::format_to(std::back_inserter(archives), "{}lib/libm{}.a", archives.empty() ? "" : ",", module);
+            ++module;
+            in_module = 0;
+            continue;
+        }
+        std::format_to(out, "cxx|src/m{0}/f{1}.cpp,!gen/config_{2}.h|obj/m{0}/f{1}.o\n", module, in_module,
+                       (module + in_module) % TUNABLE_GENERATED_HEADERS);
+        ++in_module;
+    }
+    std::format_to(out, "ld|{}|bin/app\n", archives);
+    return manifest;
+}
+
+} // namespace bench
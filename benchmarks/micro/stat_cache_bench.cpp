@@ -0,0 +1,69 @@
+#include "bench/bench.hpp"
+
+#include "cbe/batch_io.hpp"
+#include "cbe/builder.hpp"
+#include "cbe/executor.hpp"
+#include "cbe/parser.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <print>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace catalyst;
+
+void stat_cache_bench(bench::Runner &runner) {
+    if (!runner.selected("StatCache"))
+        return;
+
+    // The lookups of a no-op build's dirty analysis: every step's output, inputs and dependency set. The files do
+    // not exist, which costs the lookups nothing; only `prefetch()` would notice.
+    constexpr size_t TUNABLE_STEPS = 100'000;
+    const size_t steps = std::min(TUNABLE_STEPS, runner.options().max_steps);
+    const std::string path = "stat_cache.build";
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << bench::syntheticManifest(steps);
+    std::filesystem::remove(".catalyst.bin");
+    CBEBuilder builder;
+    if (auto res = parse(builder, path); !res) {
+        std::println(stderr, "parse: {}", res.error());
+        std::exit(1);
+    }
+    const BuildGraph graph = builder.emit_graph();
+    StatCache cache;
+    BatchIO io;
+    cache.prefetch(graph, path, io);
+    std::filesystem::remove(path);
+
+    uint64_t lookups = 0;
+    for (size_t s = 0; s < graph.step_count(); ++s) {
+        lookups += 2 + graph.step(s).inputs.size() + graph.step(s).opaque_inputs.size();
+    }
+
+    // Every thread checks the whole graph, as workers of concurrent builds sharing a cache would.
+    const size_t hardware_threads = std::max(1U, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= hardware_threads; threads *= 2) {
+        runner.run(std::format("StatCache/{}_threads/{}", threads, steps), lookups * threads, [&] {
+            std::atomic<int64_t> newest = 0;
+            std::vector<std::jthread> pool;
+            for (size_t t = 0; t < threads; ++t) {
+                pool.emplace_back([&] {
+                    int64_t local = 0;
+                    for (size_t s = 0; s < graph.step_count(); ++s) {
+                        const StepView step = graph.step(s);
+                        local ^= cache.mtime(step.output) ^ cache.newest(step.inputs) ^
+                                 cache.newest(step.opaque_inputs) ^ cache.depset_newest(step.depfile_set);
+                    }
+                    newest.fetch_xor(local, std::memory_order_relaxed);
+                });
+            }
+            pool.clear();
+            bench::doNotOptimize(newest.load());
+        });
+    }
+}
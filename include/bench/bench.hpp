@@ -0,0 +1,83 @@
+#pragma once
+
+#include "cbe/utility.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+struct Options {
+    std::string filter;            ///< Only benchmarks whose name contains this run.
+    size_t max_steps = 1'000'000;  ///< Largest synthetic manifest, in steps.
+    double min_time = 0.5;         ///< Seconds each benchmark is sampled for, at least.
+    size_t min_samples = 5;
+    size_t max_samples = 1000;
+};
+
+/** @brief Timings of one benchmark, per sample. */
+struct Measurement {
+    std::string name;
+    uint64_t items = 0; ///< Units of work in one sample (steps, dependencies, lookups).
+    std::vector<uint64_t> sample_ns;
+    uint64_t min_ns = 0;
+    uint64_t median_ns = 0;
+    uint64_t p90_ns = 0;
+    uint64_t mean_ns = 0;
+};
+
+/**
+ * @brief Runs benchmarks and collects their timings.
+ *
+ * A benchmark is a callable timed as a whole: it is run once to warm up, then sampled until both `min_samples`
+ * and `min_time` are reached, or `max_samples` is. Work that must not be timed goes into the setup callable, run
+ * before every sample.
+ */
+class Runner {
+public:
+    explicit Runner(Options options) : options_(std::move(options)) {
+    }
+
+    [[nodiscard]] const Options &options() const {
+        return options_;
+    }
+
+    /** @brief Whether a benchmark passes the filter; lets suites skip building inputs nobody measures. */
+    [[nodiscard]] bool selected(std::string_view name) const;
+
+    void run(std::string name, uint64_t items, const std::function<void()> &body,
+             const std::function<void()> &setup = {});
+
+    /** @brief Writes every measurement as JSON, for comparison between commits. */
+    catalyst::Result<void> write_json(const std::string &path) const;
+
+private:
+    Options options_;
+    std::vector<Measurement> measurements_;
+};
+
+/** @brief Sizes of the synthetic manifests, from 10k steps up to `max_steps`, by factors of 10. */
+std::vector<size_t> manifestScales(const Options &options);
+
+/**
+ * @brief A `catalyst.build` of `steps` steps shaped like a C++ project: compile steps with a source and a few
+ * generated headers as opaque inputs, archived by groups of 500, and a link of all archives.
+ */
+std::string syntheticManifest(size_t steps);
+
+/** @brief Keeps the optimizer from dropping a computation whose result is unused. */
+template <typename T> void doNotOptimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace bench
+
+void manifest_bench(bench::Runner &runner);
+void depfile_bench(bench::Runner &runner);
+void graph_bench(bench::Runner &runner);
+void stat_cache_bench(bench::Runner &runner);
@@ -0,0 +1,70 @@
+#pragma once
+
+#if FF_cbe__logging
+
+#include "cbe/process_exec.hpp"
+#include "cbe/utility.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace catalyst {
+
+/**
+ * @brief Writes the output of finished steps to the build log, and echoes it to the console, on a thread of its own.
+ *
+ * Workers hand a step over with `submit()`, a single compare-and-swap onto an intrusive list, and go back to
+ * building. The writer takes the whole list at once, restores submission order and writes it through a log file
+ * that stays open for the whole build. Only the writer waits for the console lock.
+ */
+class BuildLog {
+public:
+    /** @brief The output of one step, and what to do with it. */
+    struct Entry {
+        std::string header;  ///< `<tool> -> <output>`, written above the output in the log.
+        OutputCapture output;
+        bool echo = false;   ///< Whether the output is printed to the console as well.
+        std::string message; ///< Printed to stderr after the output, e.g. why the step failed.
+
+    private:
+        friend class BuildLog;
+        Entry *next_ = nullptr;
+    };
+
+    /**
+     * @brief Truncates the log file and starts the writer.
+     * @param path The log file.
+     * @param console_mutex Held while writing to the console, so the output of a step is not interleaved with
+     * other console output.
+     */
+    static Result<std::unique_ptr<BuildLog>> open(const std::string &path, std::mutex &console_mutex);
+
+    BuildLog(const BuildLog &) = delete;
+    BuildLog &operator=(const BuildLog &) = delete;
+
+    /** @brief Writes every submitted entry, then stops the writer. */
+    ~BuildLog();
+
+    /** @brief Queues an entry for writing. Never blocks. */
+    void submit(std::unique_ptr<Entry> entry);
+
+private:
+    BuildLog(std::ofstream &&file, std::mutex &console_mutex);
+    void push(Entry *node);
+    void run();
+    void write(const Entry &entry);
+
+    std::ofstream file_;
+    std::mutex &console_mutex_;
+    std::atomic<Entry *> pending_ = nullptr; ///< Submitted entries, newest first.
+    Entry stop_;                             ///< Submitted last, by the destructor.
+    std::thread thread_;
+};
+
+} // namespace catalyst
+
+#endif
@@ -1,14 +1,13 @@
 #pragma once
 
+#include "cbe/command.hpp"
 #include "cbe/graph.hpp"
+#include "cbe/trace.hpp"
 
 #include <filesystem>
 #include <memory>
-#include <ranges>
-#include <string>
+#include <span>
 #include <string_view>
-#include <type_traits>
-#include <vector>
 
 namespace catalyst {
 
@@ -27,25 +26,65 @@ public:
      */
     Result<void> add_step(BuildStep &&bs);
 
+    /**
+     * @brief Declares a pool (`POOL|<name>|<depth>`).
+     * @return Success or error.
+     */
+    Result<void> add_pool(std::string_view name, uint32_t depth);
+
+    /**
+     * @brief Declares a user-defined rule (`RULE|<name>|<command>[|<options>]`).
+     * @return Success or error.
+     */
+    Result<void> add_rule(const RuleSpec &spec);
+
+    /**
+     * @brief Declares an alias for a group of targets (`ALIAS|<name>|<targets>`).
+     * @return Success or error.
+     */
+    Result<void> add_alias(const Alias &alias);
+
+    /**
+     * @brief Compiles the command templates from the definitions and rules, unless that was already done.
+     *
+     * The parser calls this once the manifest is read, and `parse_bin()` loads the templates precompiled.
+     * A definition added afterwards, like a command line `KEY=VALUE`, compiles them again on the next call.
+     * Must be called before `emit_graph()`.
+     *
+     * @return Success, or an error if a rule's command is malformed.
+     */
+    Result<void> compile_templates();
+
+    /** @pre `compile_templates()` succeeded. */
+    const CommandTemplates &templates() const {
+        return templates_;
+    }
+
     const BuildGraph &graph() const {
         return graph_;
     }
 
     /**
-     * @brief Returns the built graph by moving it out of the builder.
+     * @brief Loads the dependency files, finalizes the graph and moves it out of the builder.
+     * @param jobs Upper bound on threads used to read dependency files (0 = hardware concurrency).
+     * @param targets If not empty, only the dependency files of the steps these nodes are built from are loaded.
      * @return The completed `BuildGraph`.
      */
-    BuildGraph &&emit_graph() {
+    BuildGraph &&emit_graph(size_t jobs = 0, std::span<const NodeId> targets = {}) {
+        TraceScope trace("build graph", "phase");
+        graph_.load_depfiles(jobs, targets);
+        graph_.finalize();
         return std::move(graph_);
     }
 
     /**
-     * @brief Adds a global definition/variable.
+     * @brief Adds a global definition/variable, unless it is already defined.
      * @param key The name of the definition.
      * @param value The value of the definition.
      */
     void add_definition(std::string_view key, std::string_view value) {
-        definitions_.emplace(key, value);
+        if (definitions_.emplace(key, value).second)
+            templates_compiled_ = false;
     }
 
     /**
@@ -66,21 +105,10 @@ public:
     friend class Executor;
 
 private:
-    template <typename Return_T> Return_T getDefinitionOf(std::string_view key) const {
-        if constexpr (std::is_same_v<Return_T, std::string>) {
-            if (auto it = definitions_.find(key); it != definitions_.end())
-                return std::string(it->second);
-            return "";
-        } else if constexpr (std::is_same_v<Return_T, std::vector<std::string>>) {
-            auto def = getDefinitionOf<std::string>(key);
-            return std::ranges::views::split(def, ' ') | std::ranges::to<std::vector<std::string>>();
-        } else {
-            static_assert(std::false_type(), "Unsupported Return_T for getDefinitionOf");
-        }
-    }
-
     BuildGraph graph_;
     Definitions definitions_;
+    CommandTemplates templates_;
+    bool templates_compiled_ = false;
 };
 
 } // namespace catalyst
@@ -8,6 +8,9 @@ struct CliArgs {
     bool compdb = false;
     bool graph = false;
     bool commands = false;
+    bool simulate = false;
+    bool explain = false;
+    bool hotspots = false;
     std::filesystem::path work_dir = ".";
     std::vector<std::pair<std::string_view, std::string_view>> definition_overrides;
 };
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "cbe/domain.hpp"
+#include "cbe/graph.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace catalyst {
+
+/**
+ * @brief Reusable storage for one command line at a time.
+ *
+ * Arguments are written as NUL-terminated strings into a single byte buffer and `finish()` returns an argv
+ * pointing into it. Capacity is kept between commands, so once it has seen its largest command a worker builds
+ * every further command without allocating. The argv stays valid until the arena is cleared.
+ */
+class CommandArena {
+public:
+    void clear() {
+        bytes_.clear();
+        offsets_.clear();
+    }
+
+    /** @brief Appends one argument. */
+    void append(std::string_view arg) {
+        offsets_.push_back(static_cast<uint32_t>(bytes_.size()));
+        bytes_.append(arg);
+        bytes_.push_back('\0');
+    }
+
+    /** @brief Appends one argument made of three parts (e.g. ``, `<output>` and `.d`). */
+    void append(std::string_view prefix, std::string_view arg, std::string_view suffix) {
+        offsets_.push_back(static_cast<uint32_t>(bytes_.size()));
+        bytes_.append(prefix);
+        bytes_.append(arg);
+        bytes_.append(suffix);
+        bytes_.push_back('\0');
+    }
+
+    /**
+     * @brief Appends several precompiled arguments with a single copy.
+     * @param block The arguments, each NUL-terminated, back to back.
+     * @param offsets Start of each argument within `block`.
+     */
+    void append_block(std::string_view block, std::span<const uint32_t> offsets) {
+        const auto base = static_cast<uint32_t>(bytes_.size());
+        bytes_.append(block);
+        for (uint32_t offset : offsets) {
+            offsets_.push_back(base + offset);
+        }
+    }
+
+    /**
+     * @brief Resolves the arguments into pointers.
+     * @return The argv, without its terminator. `data()[size()]` is a null pointer, as `exec` expects.
+     */
+    std::span<const char *const> finish() {
+        argv_.clear();
+        for (uint32_t offset : offsets_) {
+            argv_.push_back(bytes_.data() + offset);
+        }
+        argv_.push_back(nullptr);
+        return {argv_.data(), argv_.size() - 1};
+    }
+
+private:
+    std::string bytes_;
+    std::vector<uint32_t> offsets_; ///< Arguments are recorded as offsets, since `bytes_` may move while growing.
+    std::vector<const char *> argv_;
+};
+
+/**
+ * @brief Command lines of the built-in tools and of the user-defined rules, compiled from the manifest.
+ *
+ * Each command is a list of segments: runs of fixed arguments (the compiler, its flags, `-MMD -MF`, ...), and
+ * slots for the step's inputs and output, each with an optional prefix and suffix (`$out.d`). Definitions are
+ * expanded and split into arguments once, at parse time, and every fixed run is copied into the arena with a
+ * single `memcpy`. The compiled form is position independent and is stored as is in `.catalyst.bin`.
+ *
+ * The built-in tools are compiled from the same syntax as rules, see `BUILTIN_COMMANDS`. `execute`,
+ * `-t commands` and `-t compdb` all build their command lines through this class.
+ */
+class CommandTemplates {
+public:
+    /** @brief Commands of the built-in tools, indexed by `Tool`. */
+    static constexpr std::array<std::string_view, TOOL_NAMES.size()> BUILTIN_COMMANDS = {
+        "$cc $cflags -MMD -MF $out.d -c $in -o $out",
+        "$cxx $cxxflags -MMD -MF $out.d -c $in -o $out",
+        "$cxx $in -o $out $ldflags $ldlibs",
+        "ar rcs $out $in",
+        "$cxx -shared $in -o $out",
+    };
+
+    /**
+     * @brief Compiles the built-in commands and every rule of a graph.
+     * @return The templates, or an error naming the rule whose command is malformed.
+     */
+    static Result<CommandTemplates> compile(const Definitions &definitions, const BuildGraph &graph);
+
+    /**
+     * @brief Writes the command line of a step into an arena, replacing what it held.
+     * @param graph The graph the step belongs to.
+     * @param step The step.
+     * @param arena The arena to write into.
+     * @param rsp_path If not empty, `$in` is passed as `@<rsp_path>` instead.
+     * @return The argv, valid until the arena is reused.
+     */
+    std::span<const char *const> emit(const BuildGraph &graph, const StepView &step, CommandArena &arena,
+                                      std::string_view rsp_path = {}) const;
+
+    /**
+     * @brief Size of the command line `emit()` produces without a response file, as the kernel counts it against
+     * `ARG_MAX`: every argument with its terminator, plus one pointer per argument and the terminating null.
+     */
+    [[nodiscard]] size_t argv_size(const BuildGraph &graph, const StepView &step) const;
+
+    /** @brief Whether the command of a step passes its inputs (`$in`), which a response file could then hold. */
+    [[nodiscard]] bool takes_inputs(const StepView &step) const;
+
+    friend Result<void> parse_bin(class CBEBuilder &);
+    friend Result<void> emit_bin(class CBEBuilder &);
+
+private:
+    enum class Part : uint8_t { LITERALS, INPUTS, OUTPUT };
+
+    struct TextRange {
+        uint32_t begin = 0;
+        uint32_t end = 0;
+    };
+
+    // Written to the binary cache as is, so it has no implicit padding.
+    struct Segment {
+        Part part = Part::LITERALS;
+        std::array<uint8_t, 3> reserved{};
+        uint32_t first = 0;    ///< LITERALS: the run's first argument in `literal_offsets_`.
+        uint32_t count = 0;    ///< LITERALS: number of arguments in the run.
+        TextRange text = {};   ///< LITERALS: the run's bytes. INPUTS/OUTPUT: text before the path.
+        TextRange suffix = {}; ///< INPUTS/OUTPUT: text after the path.
+    };
+
+    /** @brief Compiles one command into the segments following the current ones. */
+    Result<void> add_command(std::string_view name, std::string_view command, const Definitions &definitions);
+    void add_literal(InputRange &command, std::string_view word);
+    TextRange add_text(std::string_view text);
+
+    [[nodiscard]] std::span<const Segment> command(const StepView &step) const {
+        const size_t index = step.tool == Tool::RULE ? TOOL_NAMES.size() + step.rule : static_cast<size_t>(step.tool);
+        return std::span(segments_).subspan(commands_[index].offset, commands_[index].count);
+    }
+
+    [[nodiscard]] std::string_view text(TextRange range) const {
+        return std::string_view(literals_).substr(range.begin, range.end - range.begin);
+    }
+
+    std::vector<InputRange> commands_;      ///< Segments of each built-in tool, then of each rule.
+    std::vector<Segment> segments_;
+    std::string literals_;                  ///< Every fixed argument, NUL-terminated, back to back, and affixes.
+    std::vector<uint32_t> literal_offsets_; ///< Start of each literal, relative to the start of its run.
+};
+
+} // namespace catalyst
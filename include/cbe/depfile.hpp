@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstring>
+#include <string_view>
+
+namespace catalyst {
+
+namespace detail {
+// Helper to skip whitespace and handle line continuations
+inline const char *skipWhitespace(const char *ptr, const char *end) {
+    while (ptr < end) {
+        unsigned char c = *ptr;
+        if (c > ' ' && c != '\\')
+            break;
+
+        if (c <= ' ') {
+            ptr++;
+        } else if (c == '\\') {
+            if (ptr + 1 < end && (ptr[1] == '\n' || ptr[1] == '\r')) {
+                ptr++; // skip backslash
+                if (ptr < end && *ptr == '\r')
+                    ptr++;
+                if (ptr < end && *ptr == '\n')
+                    ptr++;
+            } else {
+                break; // Escaped character, start of a filename
+            }
+        }
+    }
+    return ptr;
+}
+
+// Helper to extract a single token, handling escaped spaces
+inline const char *extractToken(const char *ptr, const char *end, std::string_view &out_token) {
+    const char *start = ptr;
+    while (ptr < end) {
+        unsigned char c = *ptr;
+        if (c <= ' ' || c == '\\')
+            break;
+        ptr++;
+    }
+
+    // Handle escaped characters (spaces, etc.)
+    if (ptr < end && *ptr == '\\') {
+        while (ptr < end) {
+            if (*ptr == '\\') {
+                if (ptr + 1 >= end) {
+                    ptr++; // Dangling backslash
+                    break;
+                }
+                if (ptr[1] == '\n' || ptr[1] == '\r') {
+                    break; // Line continuation means end of token
+                }
+                ptr += 2; // Skip escaped char
+            } else if (static_cast<unsigned char>(*ptr) <= ' ') {
+                break; // Unescaped whitespace ends token
+            } else {
+                ptr++;
+            }
+        }
+    }
+
+    out_token = std::string_view(start, ptr - start);
+    return ptr;
+}
+} // namespace detail
+
+/**
+ * @brief Parses a Makefile-style dependency file (.d).
+ *
+ * This parser handles line continuations (\) and escaped spaces.
+ * It invokes the callback for each dependency found.
+ *
+ * @param content The contents of the dependency file.
+ * @param callback A callable that accepts a std::string_view for each dependency.
+ */
+void parseDepfile(std::string_view content, auto callback) {
+    if (content.empty())
+        return;
+
+    const char *ptr = content.data();
+    const char *end = ptr + content.size();
+
+    // 1. Skip to deps, ignoring final output
+    const char *colon = static_cast<const char *>(std::memchr(ptr, ':', end - ptr));
+    if (!colon)
+        return;
+    ptr = colon + 1;
+
+    // Main parsing loop
+    while (ptr < end) {
+        ptr = detail::skipWhitespace(ptr, end);
+        if (ptr >= end)
+            break;
+
+        std::string_view token;
+        ptr = detail::extractToken(ptr, end, token);
+
+        if (!token.empty()) {
+            callback(token);
+        }
+    }
+}
+
+} // namespace catalyst
@@ -1,42 +1,93 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <limits>
 #include <optional>
 #include <string_view>
 #include <unordered_map>
-#include <vector>
 
 namespace catalyst {
 
 /**
- * @brief Represents a single build step execution.
+ * @brief The tools a build step can be executed with.
+ *
+ * `RULE` steps run the command of a user-defined rule (`RULE|...` in the manifest) instead of a built-in tool.
+ */
+enum class Tool : uint8_t { CC, CXX, LD, AR, SLD, RULE };
+
+/** @brief Mnemonics of the built-in tools, indexed by `Tool`. */
+inline constexpr std::array<std::string_view, 5> TOOL_NAMES = {"cc", "cxx", "ld", "ar", "sld"};
+
+/** @brief Mnemonic of a tool as written in the manifest (e.g., "cc"). Rule steps are named after their rule. */
+constexpr std::string_view toolName(Tool tool) {
+    return tool == Tool::RULE ? "rule" : TOOL_NAMES[static_cast<size_t>(tool)];
+}
+
+/** @brief Resolves a manifest mnemonic to a tool, or `std::nullopt` if it is not a known tool. */
+constexpr std::optional<Tool> toolFromName(std::string_view name) {
+    for (size_t i = 0; i < TOOL_NAMES.size(); ++i) {
+        if (TOOL_NAMES[i] == name)
+            return static_cast<Tool>(i);
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Describes a single build step as written in the manifest.
  *
  * A build step defines a transformation from inputs to a single output using a specific tool.
+ * The graph copies what it needs out of this description, so it is only used while adding steps.
  */
 struct BuildStep {
     /** @brief The tool identifier (e.g., "cc", "cxx", "ld"). */
     std::string_view tool;
-    
-    /** @brief Raw comma-separated string of input paths. */
+
+    /**
+     * @brief Raw comma-separated string of input paths.
+     *
+     * Inputs prefixed with `!` are opaque: they affect the build but are not passed to the tool.
+     */
     std::string_view inputs;
-    
+
     /** @brief The output file path generated by this step. */
     std::string_view output;
-    
-    /** 
-     * @brief Inputs that are not explicitly parsed but affect the build.
-     * Often used for order-only dependencies or implicit system dependencies.
-     */
-    std::optional<std::vector<std::string_view>> opaque_inputs = std::nullopt;
-    
-    /** 
-     * @brief Inputs discovered dynamically from a dependency file (e.g., .d files from GCC/Clang).
-     */
-    std::optional<std::vector<std::string_view>> depfile_inputs = std::nullopt;
-    
-    /** @brief List of explicit input file paths parsed from the `inputs` string. */
-    std::vector<std::string_view> parsed_inputs;
 };
 
+/** @brief Index of a user-defined rule. */
+using RuleId = uint16_t;
+
+/** @brief Index of a pool. */
+using PoolId = uint16_t;
+
+/** @brief Sentinel for "not a rule step" / "not in a pool". */
+inline constexpr uint16_t NO_INDEX = std::numeric_limits<uint16_t>::max();
+
+/**
+ * @brief Describes a user-defined rule as written in the manifest (`RULE|<name>|<command>[|<options>]`).
+ *
+ * The command is split into arguments on spaces. `$in` expands to the step's inputs, one argument each, `$out` to
+ * its output and `$<name>` to the definition `<name>`. `${name}` delimits a name, `$$` is a literal `$`.
+ */
+struct RuleSpec {
+    std::string_view name;
+    std::string_view command;
+
+    /** @brief Makefile-style depfile written by the command (e.g., `$out.d`), or empty. */
+    std::string_view depfile = {};
+
+    /** @brief Response file (e.g., `$out.rsp`) that receives the inputs, passed as `@<rsp>` in place of `$in`. */
+    std::string_view rsp = {};
+
+    /** @brief Pool that limits how many steps of this rule run at once, or empty. */
+    std::string_view pool = {};
+};
+
+/** @brief Whether a character can be part of a `$name` placeholder. */
+constexpr bool isVariableChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
 /** @brief Global definitions/variables for the build (e.g., compiler flags, tool paths). */
 using Definitions = std::unordered_map<std::string_view, std::string_view>;
 
@@ -1,53 +1,119 @@
 #pragma once
 
+#include "cbe/batch_io.hpp"
 #include "cbe/builder.hpp"
 #include "cbe/graph.hpp"
+#include "cbe/stats.hpp"
 #include "cbe/utility.hpp"
 #if FF_cbe__estimates
 #include "cbe/work_estimate.hpp"
 #endif
 
-#include <shared_mutex>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 namespace catalyst {
 
+/** @brief Why a step rebuilds; `CLEAN` (0) if it does not. */
+enum class RebuildCause : uint8_t {
+    CLEAN,
+    OUTPUT_MISSING, ///< The output does not exist.
+    MANIFEST,       ///< The manifest is not older than the output; its commands may have changed.
+    INPUT_MISSING,  ///< An input could not be stat-ed.
+    INPUT_NEWER,    ///< An input is not older than the output.
+    INPUT_DIRTY,    ///< An input is produced by a step that rebuilds.
+};
+
 /**
- * @brief Thread-safe cache for file status information (modification times).
+ * @brief Modification times of every node of a build graph, in one dense array.
  *
- * This cache prevents redundant filesystem calls when checking multiple dependencies
- * for the same file across different threads.
+ * Times are stored as nanoseconds in `std::filesystem::file_time_type`'s epoch, indexed by node id, so checking a
+ * step is a gather over its input ids followed by a max reduction. All files are stat-ed once, in a single batch,
+ * before the build starts. Dependency sets are shared between steps, so their newest time is reduced once per
+ * chunk and once per set, not once per step.
  */
 class StatCache {
-    struct Entry {
-        std::filesystem::path path;
-        std::filesystem::file_time_type time;
-        std::error_code ec;
+public:
+    /** @brief Stored for files that could not be stat-ed; newer than any real file, so dependents rebuild. */
+    static constexpr int64_t MISSING = std::numeric_limits<int64_t>::max();
 
-        bool operator<(const Entry &other) const;
-        bool operator<(const std::filesystem::path &other_path) const;
-    };
+    /**
+     * @brief Stats every node of the graph and the manifest in one batch.
+     * @param graph The graph whose nodes are stat-ed.
+     * @param build_file Path to the build manifest.
+     * @param io The I/O backend to issue the batch on.
+     * @param nodes If not empty, only these nodes are stat-ed; the others read as `MISSING`.
+     */
+    void prefetch(const BuildGraph &graph, std::string_view build_file, BatchIO &io,
+                  std::span<const NodeId> nodes = {});
 
-    std::vector<Entry> cache;
-    std::shared_mutex cache_mtx;
+    [[nodiscard]] int64_t mtime(NodeId id) const {
+        return mtimes_[id];
+    }
+
+    [[nodiscard]] int64_t manifest_mtime() const {
+        return manifest_mtime_;
+    }
 
-public:
     /**
-     * @brief Retrieves the last write time for a path, caching the result.
-     * @param p The file path to check.
-     * @return A pair containing the last write time and any error code.
+     * @brief Newest modification time in a dependency set, computed once per set during `prefetch()`.
+     * @param set A set id, or INVALID_ID for steps without depfile inputs.
      */
-    std::pair<std::filesystem::file_time_type, std::error_code> get_or_update(const std::filesystem::path &p);
+    [[nodiscard]] int64_t depset_newest(uint32_t set) const {
+        return set == INVALID_ID ? std::numeric_limits<int64_t>::min() : depset_mtimes_[set];
+    }
 
     /**
-     * @brief Checks if an input file has changed since a given output timestamp.
-     * @param input The input file path.
-     * @param output_time The timestamp of the output file.
-     * @return True if input is newer or stat failed, false otherwise.
+     * @brief Returns the newest modification time among a set of nodes.
+     *
+     * Uses AVX2 gathers when the CPU supports them, and a scalar loop otherwise.
+     *
+     * @param ids The nodes to inspect.
+     * @return The largest stored time, `MISSING` if any of them is missing, or the minimum value if `ids` is empty.
      */
-    bool changed_since(const std::filesystem::path &input, std::filesystem::file_time_type output_time);
+    [[nodiscard]] int64_t newest(std::span<const NodeId> ids) const;
+
+    /**
+     * @brief Whether a step is stale by itself, from the times of its output, its inputs and the manifest.
+     *
+     * Any input at least as new as the output, or missing, makes the step stale. Checking the explicit inputs is
+     * also how a stale `.d` file is caught. Steps that rebuild because a producer of theirs does are left to the
+     * caller.
+     */
+    [[nodiscard]] RebuildCause stale_cause(const StepView &step) const {
+        const int64_t output_mtime = mtimes_[step.output];
+        if (output_mtime == MISSING)
+            return RebuildCause::OUTPUT_MISSING;
+        if (manifest_mtime_ >= output_mtime)
+            return RebuildCause::MANIFEST;
+        int64_t input_mtime = newest(step.inputs);
+        if (input_mtime < output_mtime)
+            input_mtime = newest(step.opaque_inputs);
+        if (input_mtime < output_mtime)
+            input_mtime = depset_newest(step.depfile_set);
+        if (input_mtime < output_mtime)
+            return RebuildCause::CLEAN;
+        return input_mtime == MISSING ? RebuildCause::INPUT_MISSING : RebuildCause::INPUT_NEWER;
+    }
+
+private:
+    std::vector<int64_t> mtimes_;
+    std::vector<int64_t> depset_mtimes_;
+    int64_t manifest_mtime_ = MISSING;
+};
+
+/** @brief What a change to a file that no step produces rebuilds, as ranked by `Executor::rank_hotspots()`. */
+struct Hotspot {
+    NodeId input;
+    uint32_t rebuilds; ///< Steps that rebuild when the input changes, transitively.
+    uint64_t cost;     ///< Sum of the weights of those steps.
+    uint64_t touches;  ///< Changes to the input over the period of the touch file.
 };
 
 struct ExecutorConfig {
@@ -57,6 +123,11 @@ struct ExecutorConfig {
     bool keep_going = false;                            ///< If true, continue building other steps after an error.
     size_t jobs = 0;                                   ///< Number of parallel jobs (0 = auto-detect).
     std::string build_file = "catalyst.build";         ///< Path to the build manifest.
+    std::string trace_file;                            ///< Path to write a Chrome trace to, empty for none.
+    bool print_stats = false;                          ///< If true, print `Stats` once the run is over.
+    std::string usage_file = ".catalyst.usage";        ///< Per-step resource record, empty for none.
+    std::string touches_file;                          ///< How often each file changed, for `hotspots()`.
+    std::vector<std::string> targets;                  ///< Outputs or aliases to build, empty for everything.
 #if FF_cbe__estimates
     std::string estimates_file = "catalyst.estimates"; ///< Path to the work estimates file.
 #endif
@@ -73,13 +144,14 @@ struct ExecutorConfig {
  */
 class Executor {
 public:
-    Executor(CBEBuilder &&builder, const ExecutorConfig &config);
+    Executor(CBEBuilder &&builder, const ExecutorConfig &config = {});
 
     /**
      * @brief Executes the build.
      *
      * Performs a parallel walk of the build graph, executing steps whose
-     * dependencies are ready and which need rebuilding.
+     * dependencies are ready and which need rebuilding. With `config.targets`, only the steps they are built
+     * from are considered.
      *
      * @return Success or error.
      */
@@ -109,8 +181,80 @@ public:
      */
     Result<void> emit_commands();
 
+    /**
+     * @brief Predicts the wall time of a full build from the step durations in the usage log, for several job
+     * counts (or `config.jobs`) and every scheduling policy, and prints them with the critical path.
+     * @return Success, or an error if the graph has a cycle or no step duration was ever recorded.
+     */
+    Result<void> simulate();
+
+    /**
+     * @brief Prints why every step that the next build would run is dirty, then the files whose changes set
+     * off the most rebuilds. With `config.targets`, only the steps they are built from are explained.
+     * @return Success, or an error if the graph has a cycle or a target is not part of it.
+     */
+    Result<void> explain();
+
+    /**
+     * @brief Ranks the files that no step produces by what changing them rebuilds: every step that reads them,
+     * depfile inputs included, and every step downstream of those, weighted by the recorded step durations (or
+     * the work estimates). With a touch file, the cost is multiplied by how often the file changed.
+     * @return Success, or an error if the graph has a cycle or a file cannot be read.
+     */
+    Result<void> hotspots();
+
+    /**
+     * @brief What a change to every file that no step produces rebuilds, most expensive first.
+     *
+     * Each file is ranked by a walk down the graph from the steps that read it, depfile inputs included, so the
+     * work is the size of what each file rebuilds and the memory one stamp per node.
+     *
+     * @param weights The weight of every step, indexed by step.
+     * @param touches Changes to every node, indexed by node; if empty, every file changed once.
+     * @return One entry per file that a step reads, by `cost * touches`, then by rebuilds, then by node.
+     */
+    static std::vector<Hotspot> rank_hotspots(const BuildGraph &graph, std::span<const uint64_t> weights,
+                                              std::span<const uint64_t> touches);
+
+    /**
+     * @brief Decides which steps run, before any of them does.
+     *
+     * Walks the graph in topological order: a step is dirty if any of its inputs is produced by a dirty step, or
+     * otherwise if it is stale itself. `explain()` reports the same causes.
+     *
+     * @param order The nodes to decide for, in topological order.
+     * @return One `RebuildCause` per node, 0 (`CLEAN`) for nodes that do not rebuild; only nodes that are step
+     * outputs can be set.
+     */
+    static std::vector<uint8_t> find_dirty(const BuildGraph &graph, std::span<const NodeId> order,
+                                           const StatCache &stat_cache);
+
 private:
-    bool needs_rebuild(const BuildStep &step, StatCache &stat_cache) const;
+    /**
+     * @brief Emits the graph. With `config.targets`, only the depfiles of the steps they are built from are read.
+     * @param selection Set to the nodes the targets are built from, in topological order; cleared without targets.
+     * @return The graph, or an error if a target is neither an alias nor part of the graph.
+     */
+    Result<BuildGraph> emit_selected_graph(std::vector<NodeId> &selection);
+
+    /**
+     * @brief The nodes to work on, in topological order: the selection with `config.targets`, every node otherwise.
+     *
+     * The whole graph is only sorted without targets, or to list the cycles of a selection that has one.
+     *
+     * @param levels Holds the sort of the whole graph when one ran; the result may point into it.
+     * @return The nodes, or an error listing every cycle.
+     */
+    Result<std::span<const NodeId>> selected_order(const BuildGraph &graph, std::span<const NodeId> selection,
+                                                   std::optional<TopoLevels> &levels) const;
+
+    /**
+     * @brief Wall time of every step from the usage log. Steps without a record take the median of their tool, or
+     * of every recorded step if their tool never ran.
+     * @param estimated Set to the number of steps without a record.
+     * @return Durations in microseconds, indexed by step; empty if no step of the graph was ever recorded.
+     */
+    Result<std::vector<uint64_t>> recorded_durations(const BuildGraph &graph, size_t &estimated) const;
 
     CBEBuilder builder;
     ExecutorConfig config;
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "cbe/stats.hpp"
+
+#include <algorithm>
 #include <filesystem>
 #include <stdexcept>
+#include <string>
 #include <string_view>
 
 #ifdef _WIN32
@@ -100,6 +104,7 @@ public:
         }
         file_data = static_cast<char *>(addr);
 #endif
+        Stats::add(Counter::BYTES_MAPPED, file_size);
     }
 
     ~MappedFile() {
@@ -150,4 +155,66 @@ public:
     explicit MappedUnfaultedFile(const std::filesystem::path &path) : MappedFile(path, false) {
     }
 };
+
+/**
+ * @brief Reads a whole file into a caller-owned buffer.
+ *
+ * Meant for small, short-lived files: the buffer is reused across calls, so reading many files costs one
+ * open/read/close each and no mapping. Unlike `MappedFile`, failures are reported through the return value.
+ *
+ * @param path The path to the file.
+ * @param buffer Receives the file contents. Its capacity is kept between calls.
+ * @return False if the file could not be opened or read.
+ */
+inline bool readFile(const std::filesystem::path &path, std::string &buffer) {
+    buffer.clear();
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size_li;
+    bool ok = GetFileSizeEx(handle, &size_li);
+    if (ok) {
+        buffer.resize(static_cast<size_t>(size_li.QuadPart));
+        size_t done = 0;
+        while (ok && done < buffer.size()) {
+            DWORD chunk = 0;
+            DWORD want = static_cast<DWORD>(std::min<size_t>(buffer.size() - done, 1U << 30));
+            ok = ReadFile(handle, buffer.data() + done, want, &chunk, nullptr) && chunk != 0;
+            done += chunk;
+        }
+        buffer.resize(done);
+    }
+    CloseHandle(handle);
+    return ok;
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    struct stat sb{};
+    bool ok = fstat(fd, &sb) == 0;
+    if (ok) {
+        // The buffer is one byte larger than the file, so a single read() normally returns all of it and the
+        // next one hits EOF. The loop only matters for short reads or a file that grew meanwhile.
+        buffer.resize(static_cast<size_t>(sb.st_size) + 1);
+        size_t done = 0;
+        while (true) {
+            if (done == buffer.size())
+                buffer.resize(buffer.size() * 2);
+            ssize_t n = read(fd, buffer.data() + done, buffer.size() - done);
+            if (n < 0) {
+                ok = false;
+                break;
+            }
+            if (n == 0)
+                break;
+            done += static_cast<size_t>(n);
+        }
+        buffer.resize(done);
+    }
+    close(fd);
+    return ok;
+#endif
+}
 } // namespace catalyst
@@ -1,51 +1,179 @@
 #pragma once
 
 #include "cbe/domain.hpp"
+#include "cbe/path_table.hpp"
 #include "cbe/utility.hpp"
 
+#include <cstdint>
 #include <filesystem>
+#include <limits>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace catalyst {
 
+/** @brief Dense identifier of a node (file) in the build graph. */
+using NodeId = uint32_t;
+
+/** @brief Sentinel for "no node" / "no step" in the packed 32-bit tables. */
+inline constexpr uint32_t INVALID_ID = std::numeric_limits<uint32_t>::max();
+
+/** @brief A run of node ids inside the graph's input arena. */
+struct InputRange {
+    uint32_t offset = 0;
+    uint32_t count = 0;
+};
+
+/**
+ * @brief Nodes grouped by depth in the graph.
+ *
+ * Level 0 holds the nodes without inputs; every node on level k only depends on nodes of levels below k.
+ * Concatenated, the levels form a topological order.
+ */
+struct TopoLevels {
+    std::vector<NodeId> order;           ///< All nodes, level by level.
+    std::vector<uint32_t> level_offsets; ///< Level k is `order[level_offsets[k], level_offsets[k + 1])`.
+
+    [[nodiscard]] size_t level_count() const {
+        return level_offsets.empty() ? 0 : level_offsets.size() - 1;
+    }
+
+    [[nodiscard]] std::span<const NodeId> level(size_t k) const {
+        return {order.data() + level_offsets[k], order.data() + level_offsets[k + 1]};
+    }
+};
+
+/** @brief A user-defined rule, with its pool resolved. The command itself is compiled by `CommandTemplates`. */
+struct Rule {
+    std::string_view name;
+    std::string_view command;
+    std::string_view depfile; ///< `$out` pattern, or empty.
+    std::string_view rsp;     ///< `$out` pattern, or empty.
+    PoolId pool = NO_INDEX;
+};
+
+/** @brief Limits how many steps of the rules assigned to it run at the same time. */
+struct Pool {
+    std::string_view name;
+    uint32_t depth = 0;
+};
+
+/** @brief A name for a group of targets (`ALIAS|<name>|<targets>`), which can include other aliases. */
+struct Alias {
+    std::string_view name;
+    std::string_view targets; ///< Comma-separated outputs, files or aliases.
+};
+
+/**
+ * @brief Expands a depfile or response file pattern of a rule for one step.
+ *
+ * `$out` and `${out}` are replaced with the output path and `$$` with `$`; other text is copied.
+ */
+void expandOutput(std::string_view pattern, std::string_view output, std::string &path);
+
+/** @brief Read-only view of one row of the step table. */
+struct StepView {
+    Tool tool;
+    RuleId rule;                           ///< The step's rule if `tool` is `Tool::RULE`, NO_INDEX otherwise.
+    NodeId output;
+    std::span<const NodeId> inputs;         ///< Explicit inputs, passed to the tool.
+    std::span<const NodeId> opaque_inputs; ///< Tracked for staleness only (`!` prefixed in the manifest).
+    uint32_t depfile_set;                  ///< Inputs from the `.d` file of a previous build, or INVALID_ID.
+};
+
 /**
  * @brief Represents the dependency graph of the build system.
  *
  * This class manages nodes (files) and edges (dependencies), as well as the list of build steps.
  * It also manages the lifetime of resources (like memory-mapped files) used by the graph strings.
+ *
+ * Edges are collected as a flat list while steps are added and are packed into a compressed
+ * sparse row (CSR) layout by `finalize()`: one offset array plus one array of 32-bit target ids.
+ * Finalizing also deduplicates edges and renumbers nodes in topological (BFS) order so that
+ * traversals walk memory front to back.
+ *
+ * Steps are stored as a structure of arrays. Every input list lives in a single arena of node ids
+ * and a step only records the ranges it owns, so adding a step does not allocate per step.
+ *
+ * Depfile inputs are hash-consed, since most translation units include nearly the same headers. Each
+ * step's sorted depfile ids are cut into chunks at content-defined boundaries (a chunk ends after an id
+ * whose hash has its low bits clear), and identical chunks, as well as identical chunk lists (dependency
+ * sets), are stored once. Two sets that differ by one header share all but one chunk.
  */
 class BuildGraph {
 public:
-    /** @brief Represents a node in the dependency graph (typically a file). */
-    struct Node {
-        std::string_view path;
-        std::vector<size_t> out_edges; ///< Indices of nodes that depend on this node.
-        std::optional<size_t> step_id; ///< Index of the BuildStep that produces this node (if any).
-    };
-
     /**
      * @brief Retrieves the index of an existing node or creates a new one.
+     *
+     * Paths are canonicalized lexically first, so every spelling of a file maps to one node.
+     *
      * @param path The file path associated with the node.
-     * @return The index of the node in the `nodes_` vector.
+     * @return The id of the node.
      */
-    size_t get_or_create_node(std::string_view path);
+    NodeId get_or_create_node(std::string_view path);
 
     /**
      * @brief Adds a new build step to the graph.
      *
-     * This method parses the step's inputs, creates necessary nodes and edges,
-     * and handles dependency file parsing if applicable.
+     * This method parses the step's inputs into the input arena and creates the necessary nodes.
+     * Dependency files are not read here, see `load_depfiles()`.
      *
      * @param step The build step to add.
-     * @return The index of the added step, or an error if a producer for the output already exists.
+     * @return The index of the added step, or an error if the tool is unknown, a producer for the
+     *         output already exists or the graph has already been finalized.
      */
     Result<size_t> add_step(BuildStep step);
 
+    /**
+     * @brief Declares a pool that rules can be assigned to.
+     * @return The id of the pool, or an error if the name is taken or the depth is zero.
+     */
+    Result<PoolId> add_pool(std::string_view name, uint32_t depth);
+
+    /**
+     * @brief Declares a user-defined rule. Steps can use it by name once it is declared.
+     * @return The id of the rule, or an error if the name is taken (also by a built-in tool), its pool is unknown
+     *         or a depfile/rsp pattern uses a placeholder other than `$out`.
+     */
+    Result<RuleId> add_rule(const RuleSpec &spec);
+
+    /**
+     * @brief Declares an alias for a group of targets.
+     * @return Success, or an error if the name is empty or taken by another alias.
+     */
+    Result<void> add_alias(const Alias &alias);
+
+    /**
+     * @brief Reads the dependency (.d) files of the compile steps, in parallel.
+     *
+     * Steps whose output does not exist are skipped, they rebuild regardless of their dependencies.
+     * Outputs are stat-ed and depfiles read in batches through `BatchIO`, then parsed on up to `threads`
+     * threads; the results are merged into the graph afterwards, as interned dependency sets. Entries that
+     * are already explicit or opaque inputs of the step (like the source file itself) are left out.
+     * Must be called before `finalize()`.
+     *
+     * @param threads Upper bound on worker threads (0 = hardware concurrency).
+     * @param targets If not empty, only the steps these nodes are built from are read, including the producers of
+     *        generated headers that their depfiles name.
+     */
+    void load_depfiles(size_t threads = 0, std::span<const NodeId> targets = {});
+
+    /**
+     * @brief Packs the collected edges into the CSR layout.
+     *
+     * Deduplicates edges and renumbers nodes in topological order. Depfile inputs only get an edge if they
+     * are produced by a step (generated headers); other headers have no producer to order against, and
+     * their staleness is checked through the dependency sets. Nodes that are part of a cycle
+     * keep their relative order and are placed after all acyclic nodes, so `topo_sort()` can still
+     * report them. Calling this on an already finalized graph is a no-op.
+     */
+    void finalize();
+
     /**
      * @brief Keeps a resource alive for the lifetime of the graph.
      * @param res A shared pointer to the resource (e.g., MappedFile).
@@ -54,28 +182,205 @@ public:
         resources_.push_back(std::move(res));
     }
 
-    const std::vector<Node> &nodes() const {
-        return nodes_;
+    [[nodiscard]] bool finalized() const {
+        return finalized_;
+    }
+
+    [[nodiscard]] size_t node_count() const {
+        return paths_.size();
     }
-    const std::vector<BuildStep> &steps() const {
-        return steps_;
+
+    [[nodiscard]] size_t edge_count() const {
+        return edges_.size();
+    }
+
+    [[nodiscard]] std::string_view node_path(NodeId id) const {
+        return paths_.key(id);
     }
 
     /**
-     * @brief Performs a topological sort of the graph.
-     * @return A vector of node indices in topological order (dependencies first),
-     *         or an error if a cycle is detected.
+     * @brief Looks up the node of a path without creating it.
+     * @return The node id, or INVALID_ID if the path is not part of the graph.
      */
-    Result<std::vector<size_t>> topo_sort() const;
+    [[nodiscard]] NodeId find_node(std::string_view path) const {
+        return paths_.find(path);
+    }
+
+    /** @brief Index of the BuildStep that produces this node (if any). */
+    [[nodiscard]] std::optional<size_t> node_step(NodeId id) const {
+        if (step_of_[id] == INVALID_ID)
+            return std::nullopt;
+        return step_of_[id];
+    }
+
+    /**
+     * @brief Ids of nodes that depend on this node.
+     * @pre The graph has been finalized.
+     */
+    [[nodiscard]] std::span<const NodeId> out_edges(NodeId id) const {
+        return {edges_.data() + edge_offsets_[id], edges_.data() + edge_offsets_[id + 1]};
+    }
+
+    [[nodiscard]] size_t step_count() const {
+        return step_tool_.size();
+    }
+
+    [[nodiscard]] StepView step(size_t id) const {
+        return {.tool = step_tool_[id],
+                .rule = step_rule_[id],
+                .output = step_output_[id],
+                .inputs = arena_span(step_inputs_[id]),
+                .opaque_inputs = arena_span(step_opaque_[id]),
+                .depfile_set = step_depset_[id]};
+    }
+
+    [[nodiscard]] std::span<const Rule> rules() const {
+        return rules_;
+    }
+
+    [[nodiscard]] std::span<const Pool> pools() const {
+        return pools_;
+    }
+
+    [[nodiscard]] std::span<const Alias> aliases() const {
+        return aliases_;
+    }
+
+    /**
+     * @brief Looks up the nodes to build for a list of names: aliases are expanded, anything else is a path.
+     * @return The nodes, or an error naming the first name that is neither an alias nor part of the graph.
+     */
+    [[nodiscard]] Result<std::vector<NodeId>> resolve_targets(std::span<const std::string> names) const;
+
+    /**
+     * @brief The targets and every node they are built from: inputs, opaque inputs and depfile inputs, transitively.
+     * @pre The graph has been finalized, so that node ids are in topological order.
+     * @return The nodes in ascending order, which is a topological order.
+     */
+    [[nodiscard]] std::vector<NodeId> closure(std::span<const NodeId> targets) const;
+
+    /**
+     * @brief Whether a closure is free of cycles, without sorting the whole graph.
+     *
+     * `finalize()` numbers the nodes on or below a cycle last; a closure holds one of those exactly when it holds a
+     * cycle, and a cycle always has a step that reads a node numbered at or after its own.
+     *
+     * @param closure As returned by `closure()`.
+     */
+    [[nodiscard]] bool is_acyclic(std::span<const NodeId> closure) const;
+
+    /** @brief Name of a step's tool as written in the manifest: the rule name for rule steps. */
+    [[nodiscard]] std::string_view tool_name(const StepView &step) const {
+        return step.tool == Tool::RULE ? rules_[step.rule].name : toolName(step.tool);
+    }
+
+    /** @brief Pool of a step, or NO_INDEX if it is not limited. */
+    [[nodiscard]] PoolId step_pool(const StepView &step) const {
+        return step.tool == Tool::RULE ? rules_[step.rule].pool : NO_INDEX;
+    }
+
+    /**
+     * @brief Path of the depfile a step writes: `<output>.d` for compiles, the rule's pattern for rule steps.
+     * @return False if the step writes no depfile.
+     */
+    bool depfile_path(const StepView &step, std::string &path) const;
+
+    /** @brief Number of distinct dependency sets. */
+    [[nodiscard]] size_t depset_count() const {
+        return depsets_.size();
+    }
+
+    /** @brief Ids of the chunks that make up a dependency set. */
+    [[nodiscard]] std::span<const uint32_t> depset_chunks(uint32_t set) const {
+        return {depset_arena_.data() + depsets_[set].offset, depsets_[set].count};
+    }
+
+    /** @brief Number of distinct dependency chunks. */
+    [[nodiscard]] size_t dep_chunk_count() const {
+        return dep_chunks_.size();
+    }
+
+    /** @brief Nodes in a dependency chunk. */
+    [[nodiscard]] std::span<const NodeId> dep_chunk(uint32_t chunk) const {
+        return arena_span(dep_chunks_[chunk]);
+    }
+
+    /** @brief Calls `fn(NodeId)` for every depfile input of a step. */
+    void for_each_depfile_input(const StepView &step, auto &&fn) const {
+        if (step.depfile_set == INVALID_ID)
+            return;
+        for (uint32_t chunk : depset_chunks(step.depfile_set)) {
+            for (NodeId id : dep_chunk(chunk)) {
+                fn(id);
+            }
+        }
+    }
+
+    /** @brief Calls `fn(NodeId)` for every input of a step: explicit, opaque and from its depfile. */
+    void for_each_input(const StepView &step, auto &&fn) const {
+        for (NodeId id : step.inputs) {
+            fn(id);
+        }
+        for (NodeId id : step.opaque_inputs) {
+            fn(id);
+        }
+        for_each_depfile_input(step, fn);
+    }
+
+    /**
+     * @brief Performs a topological sort of the graph, grouped into depth levels.
+     *
+     * Iterative, frontier-based Kahn's algorithm: each level is expanded from the previous one, in parallel
+     * when the graph is large enough to make that worthwhile. If nodes are left over, the strongly connected
+     * components among them are computed and every cycle is reported, not just the first one.
+     *
+     * @pre The graph has been finalized.
+     * @param threads Upper bound on worker threads (0 = hardware concurrency).
+     * @return The nodes grouped by level, or an error listing every cycle in the graph.
+     */
+    Result<TopoLevels> topo_sort(size_t threads = 0) const;
 
     friend Result<void> parse(class CBEBuilder &, const std::filesystem::path &);
     friend Result<void> parse_bin(class CBEBuilder &);
     friend Result<void> emit_bin(class CBEBuilder &);
 
 private:
-    std::vector<Node> nodes_;
-    std::vector<BuildStep> steps_;
-    std::unordered_map<std::string_view, size_t> index_;
+    [[nodiscard]] bool has_depfile(uint32_t step) const;
+
+    /** @brief Reads the depfiles of the given compile steps, see `load_depfiles()`. */
+    void read_depfiles(std::span<const uint32_t> compile_steps, size_t threads);
+
+    /** @brief Formats every cycle among the nodes left with a non-zero in-degree by Kahn's algorithm. */
+    [[nodiscard]] std::string describe_cycles(std::span<const uint32_t> in_degree) const;
+
+    [[nodiscard]] std::span<const NodeId> arena_span(InputRange range) const {
+        return {input_arena_.data() + range.offset, range.count};
+    }
+
+    PathTable paths_;                    ///< Canonical path per node, doubles as the path -> node index.
+    std::vector<uint32_t> step_of_;      ///< Producing step per node, or INVALID_ID.
+    std::vector<uint32_t> edge_offsets_; ///< CSR row offsets, `node_count() + 1` entries.
+    std::vector<NodeId> edges_;          ///< CSR targets, sorted and unique per row.
+    bool finalized_ = false;
+
+    // Step table, one entry per step in each column.
+    std::vector<Tool> step_tool_;
+    std::vector<RuleId> step_rule_;
+    std::vector<NodeId> step_output_;
+    std::vector<InputRange> step_inputs_;
+    std::vector<InputRange> step_opaque_;
+    std::vector<uint32_t> step_depset_;
+    std::vector<NodeId> input_arena_; ///< Backing storage of every step's input ranges and of the dep chunks.
+
+    // Interned depfile inputs: a set is a list of chunk ids, a chunk is a range of `input_arena_`.
+    std::vector<InputRange> depsets_;
+    std::vector<uint32_t> depset_arena_;
+    std::vector<InputRange> dep_chunks_;
+
+    std::vector<Rule> rules_;
+    std::vector<Pool> pools_;
+    std::vector<Alias> aliases_;
+
     std::vector<std::shared_ptr<void>> resources_;
 };
 
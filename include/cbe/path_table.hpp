@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace catalyst {
+
+/**
+ * @brief Append-only storage for strings that must outlive their source buffer.
+ *
+ * Memory is handed out from fixed-size chunks, so views returned by `copy()` stay valid
+ * for the lifetime of the arena, including after the arena itself has been moved.
+ */
+class StringArena {
+public:
+    /**
+     * @brief Copies a string into the arena.
+     * @param sv The string to copy.
+     * @return A view of the copy, owned by the arena.
+     */
+    std::string_view copy(std::string_view sv) {
+        if (sv.empty())
+            return {};
+        if (sv.size() > CHUNK_SIZE / 4) {
+            // Oversized strings get a dedicated chunk so they don't waste the current one.
+            auto &chunk = chunks_.emplace_back(std::make_unique_for_overwrite<char[]>(sv.size()));
+            std::memcpy(chunk.get(), sv.data(), sv.size());
+            return {chunk.get(), sv.size()};
+        }
+        if (current_ == nullptr || used_ + sv.size() > CHUNK_SIZE) {
+            current_ = chunks_.emplace_back(std::make_unique_for_overwrite<char[]>(CHUNK_SIZE)).get();
+            used_ = 0;
+        }
+        char *dst = current_ + used_;
+        std::memcpy(dst, sv.data(), sv.size());
+        used_ += sv.size();
+        return {dst, sv.size()};
+    }
+
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char *current_ = nullptr;
+    size_t used_ = 0;
+};
+
+/**
+ * @brief 64-bit hash of a path.
+ *
+ * Consumes 16 bytes per round in independent multiply-mix lanes (48 bytes for long paths), which keeps
+ * typical include paths to a handful of rounds.
+ */
+uint64_t hashPath(std::string_view path);
+
+/**
+ * @brief Lexically canonicalizes a path.
+ *
+ * Collapses repeated separators, drops `.` components and folds `dir/..` pairs, so that `./src/a.h`,
+ * `src/../src/a.h` and `src/a.h` all become `src/a.h`. Leading `..` components of relative paths are kept.
+ * The file system is not consulted, so symlinks are not resolved.
+ *
+ * @param path The path to canonicalize.
+ * @param scratch Buffer used when the path has to be rewritten.
+ * @return `path` itself if it is already canonical, otherwise a view into `scratch`.
+ */
+std::string_view canonicalizePath(std::string_view path, std::string &scratch);
+
+/**
+ * @brief Interning table mapping canonical paths to dense 32-bit ids.
+ *
+ * Open addressing with linear probing over 8-byte slots. Every slot keeps the upper half of its key's
+ * hash as a tag, so a probe only touches the key string when the tags match. Full hashes are kept per
+ * key, which lets the table be renumbered or rebuilt without hashing any string again.
+ */
+class PathTable {
+public:
+    static constexpr uint32_t NOT_FOUND = std::numeric_limits<uint32_t>::max();
+
+    /**
+     * @brief Returns the id of a path, adding it if it is not known yet.
+     *
+     * The path is canonicalized first. Canonical paths that were rewritten are copied into the table's
+     * arena; all other keys keep pointing at the caller's buffer, which must outlive the table.
+     */
+    uint32_t intern(std::string_view path);
+
+    /**
+     * @brief Like `intern()`, but always copies new keys into the table's arena.
+     *
+     * For callers that intern paths out of short-lived buffers. Known paths cost no allocation.
+     */
+    uint32_t intern_copy(std::string_view path);
+
+    /** @brief Looks up a path without adding it. */
+    [[nodiscard]] uint32_t find(std::string_view path) const;
+
+    /**
+     * @brief Appends a key that is known to be canonical and unique, with its precomputed hash.
+     *
+     * Used when loading the binary cache.
+     */
+    uint32_t adopt(std::string_view canonical_path, uint64_t hash);
+
+    /**
+     * @brief Renumbers the keys so that new id `i` is old id `order[i]`.
+     * @param order A permutation of `[0, size())`.
+     */
+    void permute(std::span<const uint32_t> order);
+
+    void reserve(size_t count);
+
+    [[nodiscard]] size_t size() const {
+        return keys_.size();
+    }
+
+    [[nodiscard]] std::string_view key(uint32_t id) const {
+        return keys_[id];
+    }
+
+    [[nodiscard]] uint64_t hash(uint32_t id) const {
+        return hashes_[id];
+    }
+
+private:
+    struct Slot {
+        uint32_t tag = 0;
+        uint32_t id = NOT_FOUND;
+    };
+
+    [[nodiscard]] uint32_t find_canonical(std::string_view path, uint64_t hash) const;
+    uint32_t insert_new(std::string_view path, uint64_t hash);
+    void place(uint32_t id);
+    void rehash(size_t capacity);
+
+    std::vector<Slot> slots_;
+    std::vector<std::string_view> keys_;
+    std::vector<uint64_t> hashes_;
+    StringArena arena_;
+};
+
+} // namespace catalyst
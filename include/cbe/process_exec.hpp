@@ -2,13 +2,110 @@
 
 #include "cbe/utility.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <future>
+#include <mutex>
 #include <optional>
+#include <ostream>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
 namespace catalyst {
+
+/**
+ * @brief The subprocesses a build currently runs, so they can be stopped together.
+ *
+ * On POSIX systems every subprocess leads its own process group, so stopping it also stops the processes it
+ * started (e.g. `cc1plus` under the compiler driver), and a terminal's Ctrl-C only reaches CBE, which then
+ * decides what to stop. On Windows processes are not tracked and `cancel()` only prevents new ones.
+ */
+class RunningProcesses {
+public:
+    /**
+     * @brief Stops every running process group and any process started afterwards.
+     *
+     * Sends SIGTERM, waits up to `grace` for the processes to exit and sends SIGKILL to those still running.
+     * Returns once they are gone or the second signal was sent.
+     */
+    void cancel(std::chrono::milliseconds grace);
+
+    [[nodiscard]] bool cancelled() const {
+        return cancelled_.load(std::memory_order_acquire);
+    }
+
+    /** @brief Registers a started process. Returns false, and the caller must kill it, if the set was cancelled. */
+    bool add(int pid);
+    void remove(int pid);
+
+private:
+    std::mutex mutex_;
+    std::vector<int> pids_;
+    std::atomic<bool> cancelled_ = false;
+};
+
+/**
+ * @brief Output of one subprocess, held in memory up to a limit and spilled to an anonymous temporary file past it.
+ *
+ * A compiler that dumps megabytes of template errors then costs a file, not a worker's worth of memory, and the
+ * memory part keeps its capacity across `clear()`.
+ */
+class OutputCapture {
+public:
+    static constexpr size_t TUNABLE_CAPTURE_MEMORY = 256 * 1024;
+
+    explicit OutputCapture(size_t memory_limit = TUNABLE_CAPTURE_MEMORY) : memory_limit_(memory_limit) {
+    }
+    OutputCapture(const OutputCapture &) = delete;
+    OutputCapture &operator=(const OutputCapture &) = delete;
+    ~OutputCapture() {
+        clear();
+    }
+
+    void append(std::string_view data);
+
+    /** @brief Drops the contents and the spill file. */
+    void clear();
+
+    [[nodiscard]] size_t size() const {
+        return size_;
+    }
+    [[nodiscard]] bool empty() const {
+        return size_ == 0;
+    }
+    [[nodiscard]] bool spilled() const {
+        return spill_ != nullptr;
+    }
+    [[nodiscard]] char back() const {
+        return last_;
+    }
+
+    /** @brief Copies the whole output, memory part then spill file, to a stream. */
+    void write_to(std::ostream &out) const;
+
+    [[nodiscard]] std::string str() const;
+
+private:
+    size_t memory_limit_;
+    size_t size_ = 0;
+    char last_ = '\0';
+    std::string memory_;
+    std::FILE *spill_ = nullptr; ///< From `std::tmpfile`, removed once closed.
+};
+
+/** @brief Resources a finished subprocess used, and its children that it waited for. */
+struct ProcessUsage {
+    uint64_t user_us = 0;
+    uint64_t sys_us = 0;
+    uint64_t max_rss_kib = 0;
+    uint64_t read_blocks = 0;  ///< Blocks read from storage, not from the page cache.
+    uint64_t write_blocks = 0; ///< Blocks written to storage.
+};
+
 /**
  * @brief Executes a subprocess.
  *
@@ -22,4 +119,22 @@ Result<std::pair<int, std::string>> process_exec(std::vector<std::string> &&args
                          std::optional<std::string> working_dir = std::nullopt,
                          std::optional<std::unordered_map<std::string, std::string>> env = std::nullopt,
                          bool capture_output = false);
+
+/**
+ * @brief Executes a subprocess from a prebuilt argv, without copying the arguments.
+ *
+ * @param argv The command line arguments (first argument is the executable). `argv.data()[argv.size()]` must be a
+ * null pointer, as returned by `CommandArena::finish()`.
+ * @param working_dir Optional working directory for the subprocess.
+ * @param env Optional environment variables to extend/override the parent environment.
+ * @param capture If set, receives the combined stdout and stderr of the process, otherwise they are inherited.
+ * @param running If set, the process is registered there while it runs, in its own process group.
+ * @param usage If set, receives the resources the process used, from `wait4`. Left zeroed on Windows.
+ * @return The exit code of the process (128 + the signal if it was killed), or an error if it could not be
+ * started.
+ */
+Result<int> process_exec(std::span<const char *const> argv, std::optional<std::string> working_dir = std::nullopt,
+                         std::optional<std::unordered_map<std::string, std::string>> env = std::nullopt,
+                         OutputCapture *capture = nullptr, RunningProcesses *running = nullptr,
+                         ProcessUsage *usage = nullptr);
 } // namespace catalyst
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "cbe/graph.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+
+namespace catalyst {
+
+enum class ProgressMode : uint8_t {
+    SILENT,      ///< Nothing is printed.
+    STATUS_LINE, ///< A single line, redrawn in place (a terminal).
+    LINES,       ///< One line per started step (a pipe or a file).
+    DRY_RUN,     ///< One `[DRY RUN]` line per step.
+};
+
+/**
+ * @brief Reports the progress of a build from a renderer thread of its own.
+ *
+ * Workers only bump relaxed counters, so a build of thousands of short steps does not serialize on the terminal;
+ * in `LINES` and `DRY_RUN` mode, where every started step gets a line, they also push the step into a bounded
+ * ring. The renderer wakes a fixed number of times per second: in `STATUS_LINE` mode it redraws one line with the
+ * running steps, the throughput, an ETA and the last step started, otherwise it drains the ring and writes the
+ * lines of every step started since the last frame at once.
+ *
+ * The ETA is weighted by the work of each step (its work estimate, when available), so a few long steps left at
+ * the end of a build are not mistaken for a few seconds of work.
+ */
+class Progress {
+public:
+    /**
+     * @param graph The graph being built.
+     * @param step_work The work of every step, indexed by step; steps that do not run count as 0.
+     * @param steps_to_build The number of steps that run.
+     * @param mode How to report.
+     * @param console_mutex Held while printing, as by anything else writing to the console.
+     */
+    Progress(const BuildGraph &graph, std::span<const uint64_t> step_work, size_t steps_to_build, ProgressMode mode,
+             std::mutex &console_mutex);
+    Progress(const Progress &) = delete;
+    Progress &operator=(const Progress &) = delete;
+    ~Progress() {
+        stop();
+    }
+
+    /** @brief Starts the renderer. */
+    void start();
+
+    /** @brief Renders a last frame and stops the renderer. */
+    void stop();
+
+    void step_started(uint32_t step) {
+        if (mode_ == ProgressMode::LINES || mode_ == ProgressMode::DRY_RUN)
+            push(step);
+        else
+            last_started_.store(step, std::memory_order_relaxed);
+        started_.fetch_add(1, std::memory_order_release);
+    }
+
+    void step_finished(uint32_t step) {
+        finished_.fetch_add(1, std::memory_order_relaxed);
+        work_done_.fetch_add(step_work_[step], std::memory_order_relaxed);
+    }
+
+    /** @brief Number of steps started so far. */
+    [[nodiscard]] size_t started() const {
+        return started_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence; ///< `position + 1` once written, `position + capacity` once read.
+        uint32_t step;
+    };
+
+    static constexpr size_t TUNABLE_RING_CAPACITY = 4096;
+    static constexpr auto TUNABLE_FRAME_INTERVAL = std::chrono::milliseconds(100);
+
+    void push(uint32_t step);
+    bool pop(uint32_t &step);
+    void run();
+    void render();
+    void draw_status_line();
+
+    const BuildGraph &graph_;
+    std::span<const uint64_t> step_work_;
+    size_t steps_to_build_;
+    uint64_t total_work_ = 0;
+    ProgressMode mode_;
+    std::mutex &console_mutex_;
+    size_t terminal_width_ = 0; ///< 0 if unknown, then the status line is not truncated.
+
+    std::atomic<size_t> started_ = 0;
+    std::atomic<size_t> finished_ = 0;
+    std::atomic<uint64_t> work_done_ = 0;
+    std::atomic<uint32_t> last_started_ = 0; ///< `STATUS_LINE` mode only.
+
+    std::unique_ptr<Slot[]> ring_;
+    std::atomic<uint64_t> ring_tail_ = 0; ///< Next position producers write.
+    uint64_t ring_head_ = 0;              ///< Next position the renderer reads.
+
+    // Renderer state.
+    size_t lines_printed_ = 0;
+    std::string frame_;
+    std::chrono::steady_clock::time_point start_time_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+} // namespace catalyst
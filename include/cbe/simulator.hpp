@@ -0,0 +1,75 @@
+#pragma once
+
+#include "cbe/graph.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace catalyst {
+
+enum class SchedulingPolicy : uint8_t {
+    FIFO,          ///< Ready steps start in the order they became ready.
+    LONGEST_FIRST, ///< The longest ready step starts first, as with work estimates.
+    CRITICAL_PATH, ///< The ready step with the longest chain of work behind it starts first.
+    COUNT,
+};
+
+inline constexpr std::array<std::string_view, static_cast<size_t>(SchedulingPolicy::COUNT)> POLICY_NAMES = {
+    "fifo", "longest-first", "critical-path"};
+
+struct SimulationResult {
+    uint64_t wall_us = 0;
+    double utilization = 0; ///< Time spent running steps over the time `jobs` slots were available.
+};
+
+/**
+ * @brief Replays a full build of a graph as a discrete-event simulation, from the duration of every step.
+ *
+ * Steps take exactly their duration and spawning is free; pools are honored as by the executor. Files that no
+ * step produces are ready from the start. A simulation is a single pass over the graph, with a heap of ready steps
+ * and one of running steps, so sweeping job counts and policies over a large graph takes moments.
+ */
+class BuildSimulator {
+public:
+    /**
+     * @param graph A finalized, acyclic graph.
+     * @param order The nodes of `graph` in topological order.
+     * @param durations_us The duration of every step, indexed by step.
+     */
+    BuildSimulator(const BuildGraph &graph, std::span<const NodeId> order, std::span<const uint64_t> durations_us);
+
+    [[nodiscard]] SimulationResult run(size_t jobs, SchedulingPolicy policy) const;
+
+    /** @brief Sum of all step durations: the wall time of a build on one job. */
+    [[nodiscard]] uint64_t total_work_us() const {
+        return total_work_us_;
+    }
+
+    /** @brief Length of the longest chain of dependent steps: the wall time of a build on unlimited jobs. */
+    [[nodiscard]] uint64_t critical_path_us() const {
+        return critical_path_us_;
+    }
+
+    /** @brief Output nodes of the steps on the critical path, in build order. */
+    [[nodiscard]] std::span<const NodeId> critical_path() const {
+        return critical_path_;
+    }
+
+    [[nodiscard]] uint64_t duration_us(NodeId node) const {
+        return durations_[node];
+    }
+
+private:
+    const BuildGraph &graph_;
+    std::vector<uint64_t> durations_;    ///< Per node; 0 for files that no step produces.
+    std::vector<uint64_t> bottom_level_; ///< Per node: the longest chain of work from its start to the end.
+    std::vector<uint32_t> in_degrees_;
+    std::vector<NodeId> critical_path_;
+    uint64_t total_work_us_ = 0;
+    uint64_t critical_path_us_ = 0;
+};
+
+} // namespace catalyst
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+
+namespace catalyst {
+
+enum class Counter : uint8_t {
+    NODES,
+    EDGES,
+    STEPS,
+    STEPS_RUN,
+    STAT_CALLS,         ///< Files stat-ed, by `BatchIO`.
+    STAT_CACHE_HITS,    ///< Modification times read from the `StatCache` instead of stat-ed again.
+    DEPFILES_READ,
+    BYTES_MAPPED,
+    SCHEDULER_LOCKS,        ///< Acquisitions of the scheduler mutex by the workers.
+    SCHEDULER_LOCK_WAIT_NS, ///< Time the workers spent acquiring it.
+    SPAWNS,
+    SPAWN_NS,           ///< Time spent in `posix_spawn`, until the child exists.
+    PEAK_QUEUE_DEPTH,   ///< Largest number of steps ready at once. A peak, not a sum.
+    COUNT,
+};
+
+/**
+ * @brief Runtime counters and histograms of `cbe` itself, printed by `--stats` and `-t stats`.
+ *
+ * Always on. Every thread updates a block of its own with relaxed atomics, registered on its first update, so an
+ * update is an uncontended add and never a shared cache line. `print()` sums the blocks.
+ *
+ * Histograms have power-of-two buckets: bucket `b` counts values in `[2^(b-1), 2^b)`, bucket 0 counts zeros.
+ */
+class Stats {
+public:
+    static constexpr size_t HISTOGRAM_BUCKETS = 40;
+    using HistogramId = uint32_t;
+
+    static void add(Counter counter, uint64_t value = 1);
+
+    /** @brief Raises a peak counter to `value` if it is larger. */
+    static void peak(Counter counter, uint64_t value);
+
+    /**
+     * @brief Registers a histogram, or finds the one already registered under that name.
+     * @param name Shown in the report, e.g. the tool whose step durations it holds.
+     * @param unit Unit of the recorded values, e.g. `us`. Must be a string literal.
+     */
+    static HistogramId histogram(std::string_view name, std::string_view unit);
+
+    static void record(HistogramId histogram, uint64_t value);
+
+    /**
+     * @brief Prints every counter, the peak RSS and every non-empty histogram. Call once no thread updates.
+     * @param steps_ran False after a dry run, to leave out the counters that only running steps update.
+     */
+    static void print(std::FILE *out, bool steps_ran = true);
+};
+
+} // namespace catalyst
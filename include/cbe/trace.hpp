@@ -0,0 +1,77 @@
+#pragma once
+
+#include "cbe/utility.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace catalyst {
+
+/**
+ * @brief Records a timeline of the run in the Chrome trace-event format, for `chrome://tracing` or Perfetto.
+ *
+ * Every thread records into a buffer of its own, registered on its first event, so recording is an append to a
+ * thread-local vector and threads never contend. The buffers are serialized once, by `write()`, at exit. While
+ * tracing is disabled, which is the default, every call returns after a single relaxed load.
+ *
+ * Categories must be string literals; they are stored as views.
+ */
+class Trace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /** @brief Starts recording. Timestamps are relative to this call. */
+    static void enable();
+
+    [[nodiscard]] static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief Names the calling thread's lane. */
+    static void name_thread(std::string name);
+
+    /** @brief Records an interval on the calling thread's lane. */
+    static void complete(std::string name, std::string_view category, Clock::time_point begin, Clock::time_point end);
+
+    /**
+     * @brief Records an interval that does not belong to the calling thread, such as the time a step waited in the
+     * ready queue. It is shown on a track of its own, keyed by `id`.
+     */
+    static void async(std::string name, std::string_view category, uint64_t id, Clock::time_point begin,
+                      Clock::time_point end);
+
+    /** @brief Writes every recorded event. Must not race with threads still recording. */
+    static Result<void> write(const std::string &path);
+
+private:
+    static inline std::atomic<bool> enabled_ = false;
+};
+
+/** @brief Records the lifetime of a scope as an interval on the calling thread's lane. */
+class TraceScope {
+public:
+    TraceScope(std::string_view name, std::string_view category) {
+        if (Trace::enabled()) {
+            name_ = name;
+            category_ = category;
+            begin_ = Trace::Clock::now();
+        }
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    ~TraceScope() {
+        if (!category_.empty())
+            Trace::complete(std::move(name_), category_, begin_, Trace::Clock::now());
+    }
+
+private:
+    std::string name_;
+    std::string_view category_;
+    Trace::Clock::time_point begin_;
+};
+
+} // namespace catalyst
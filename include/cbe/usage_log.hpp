@@ -0,0 +1,49 @@
+#pragma once
+
+#include "cbe/process_exec.hpp"
+#include "cbe/utility.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace catalyst {
+
+/** @brief What a step used the last time it ran. */
+struct StepUsage {
+    uint64_t wall_us = 0;
+    ProcessUsage process;
+};
+
+/**
+ * @brief The resources every step used the last time it ran, kept across builds in `.catalyst.usage`.
+ *
+ * One tab-separated line per output: the output, the tool, then the wall, user and system time in microseconds,
+ * the peak RSS in KiB and the blocks read and written. A build replaces the lines of the steps it ran and keeps the
+ * others, so the file always covers the whole tree, however incremental the build was.
+ */
+class UsageLog {
+public:
+    struct Record {
+        std::string tool;
+        StepUsage usage;
+    };
+
+    /** @brief Reads a usage log. A missing file is an empty log; malformed lines are skipped. */
+    static Result<UsageLog> load(const std::string &path);
+
+    /** @brief Writes the log, sorted by output, replacing the file. */
+    Result<void> save(const std::string &path) const;
+
+    void set(std::string_view output, std::string_view tool, const StepUsage &usage);
+
+    [[nodiscard]] const std::unordered_map<std::string, Record> &records() const {
+        return records_;
+    }
+
+private:
+    std::unordered_map<std::string, Record> records_;
+};
+
+} // namespace catalyst
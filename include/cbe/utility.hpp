@@ -1,8 +1,40 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <expected>
 #include <format>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace catalyst {
 template <typename Value_T> using Result = std::expected<Value_T, std::string>;
+
+/**
+ * @brief Calls `fn(i)` for every `i` in `[0, count)` on up to `threads` threads, the caller's included.
+ *
+ * Indices are handed out one at a time from a shared counter, so uneven work balances itself. Threads are only
+ * started when each of them gets at least `min_per_thread` items.
+ *
+ * @param threads Maximum number of threads (0 = auto-detect).
+ */
+template <typename Fn_T> void parallelFor(size_t count, size_t threads, size_t min_per_thread, Fn_T &&fn) {
+    if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+    threads = std::min(threads, (count + min_per_thread - 1) / std::max<size_t>(min_per_thread, 1));
+
+    std::atomic<size_t> next = 0;
+    auto worker = [&]() {
+        for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < count;
+             i = next.fetch_add(1, std::memory_order_relaxed)) {
+            fn(i);
+        }
+    };
+    std::vector<std::jthread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+        workers.emplace_back(worker);
+    }
+    worker();
+}
 } // namespace catalyst
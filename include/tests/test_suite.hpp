@@ -2,3 +2,6 @@
 
 bool integration_test();
 bool opaque_deps_test();
+bool graph_test();
+bool batch_io_test();
+bool command_test();
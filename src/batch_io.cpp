@@ -0,0 +1,447 @@
+#include "cbe/batch_io.hpp"
+
+#include "cbe/file_handle.hpp"
+#include "cbe/stats.hpp"
+#include "cbe/utility.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define CBE_HAS_IO_URING 1
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#define CBE_HAS_IO_URING 0
+#endif
+
+namespace catalyst {
+
+namespace {
+
+// Requests kept in flight per io_uring batch.
+constexpr unsigned TUNABLE_QUEUE_DEPTH = 256;
+// The fallback is latency bound, not CPU bound, so it uses more threads than there are cores.
+constexpr size_t TUNABLE_FALLBACK_THREADS_PER_CORE = 4;
+constexpr size_t TUNABLE_FALLBACK_OPS_PER_THREAD = 4;
+
+std::error_code errnoCode(int err) {
+    return {err, std::system_category()};
+}
+
+#if CBE_HAS_IO_URING
+std::filesystem::file_time_type fromStatx(const struct statx_timestamp &ts) {
+    using namespace std::chrono;
+    const sys_time<nanoseconds> sys{seconds(ts.tv_sec) + nanoseconds(ts.tv_nsec)};
+    return time_point_cast<std::filesystem::file_time_type::duration>(file_clock::from_sys(sys));
+}
+
+// io_uring takes NUL-terminated paths; views from the path table are not.
+struct PathBlock {
+    std::string data;
+    std::vector<size_t> offsets;
+
+    explicit PathBlock(std::span<const std::string_view> paths) {
+        size_t bytes = 0;
+        for (std::string_view p : paths)
+            bytes += p.size() + 1;
+        data.reserve(bytes);
+        offsets.reserve(paths.size());
+        for (std::string_view p : paths) {
+            offsets.push_back(data.size());
+            data.append(p);
+            data.push_back('\0');
+        }
+    }
+
+    [[nodiscard]] const char *operator[](size_t i) const {
+        return data.data() + offsets[i];
+    }
+};
+#endif
+
+} // namespace
+
+#if CBE_HAS_IO_URING
+/**
+ * @brief Minimal io_uring instance driven through the raw system calls.
+ */
+struct BatchIO::Ring {
+    int fd = -1;
+    unsigned entries = 0;
+
+    void *sq_ring = MAP_FAILED;
+    size_t sq_ring_size = 0;
+    void *cq_ring = MAP_FAILED;
+    size_t cq_ring_size = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqes_size = 0;
+
+    unsigned *sq_tail = nullptr;
+    unsigned *sq_mask = nullptr;
+    unsigned *sq_array = nullptr;
+    unsigned *cq_head = nullptr;
+    unsigned *cq_tail = nullptr;
+    unsigned *cq_mask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+
+    ~Ring() {
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED)
+            munmap(sq_ring, sq_ring_size);
+        if (fd != -1)
+            close(fd);
+    }
+
+    static std::unique_ptr<Ring> create(unsigned depth) {
+        io_uring_params params{};
+        int ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+        if (ring_fd < 0)
+            return nullptr;
+
+        auto ring = std::make_unique<Ring>();
+        ring->fd = ring_fd;
+        ring->entries = params.sq_entries;
+
+        ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap)
+            ring->sq_ring_size = ring->cq_ring_size = std::max(ring->sq_ring_size, ring->cq_ring_size);
+
+        ring->sq_ring = mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring_fd, IORING_OFF_SQ_RING);
+        if (ring->sq_ring == MAP_FAILED)
+            return nullptr;
+        ring->cq_ring = single_mmap ? ring->sq_ring
+                                    : mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+            return nullptr;
+        ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        ring->sqes = static_cast<io_uring_sqe *>(mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+        if (ring->sqes == MAP_FAILED)
+            return nullptr;
+
+        auto *sq = static_cast<char *>(ring->sq_ring);
+        auto *cq = static_cast<char *>(ring->cq_ring);
+        ring->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        ring->sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        ring->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        ring->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        ring->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        ring->cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        // Kernels older than 5.6 accept the ring but reject the opcodes used here. Probe one before relying on it.
+        struct statx probe{};
+        bool supported = false;
+        ring->run(
+            1,
+            [&](size_t, io_uring_sqe &sqe) {
+                sqe.opcode = IORING_OP_STATX;
+                sqe.fd = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uint64_t>(".");
+                sqe.len = STATX_MTIME;
+                sqe.off = reinterpret_cast<uint64_t>(&probe);
+            },
+            [&](size_t, int res) { supported = res == 0; });
+        return supported ? std::move(ring) : nullptr;
+    }
+
+    /**
+     * @brief Runs `count` requests with up to `entries` of them in flight.
+     * @param prep Fills in the submission entry for request `i`.
+     * @param complete Receives the result of request `i` (negative errno on failure).
+     */
+    void run(size_t count, auto prep, auto complete) {
+        size_t next = 0;
+        size_t in_flight = 0;
+        size_t unsubmitted = 0;
+        std::vector<bool> completed(count);
+        while (next < count || in_flight > 0) {
+            unsigned tail = *sq_tail;
+            while (next < count && in_flight < entries) {
+                const unsigned idx = tail & *sq_mask;
+                io_uring_sqe &sqe = sqes[idx];
+                std::memset(&sqe, 0, sizeof(sqe));
+                prep(next, sqe);
+                sqe.user_data = next;
+                sq_array[idx] = idx;
+                ++tail;
+                ++next;
+                ++in_flight;
+                ++unsubmitted;
+            }
+            __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+            int ret = static_cast<int>(
+                syscall(__NR_io_uring_enter, fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (ret < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                    continue;
+                // The ring is unusable; fail everything that has not completed rather than hang.
+                const int err = errno;
+                for (size_t i = 0; i < count; ++i) {
+                    if (!completed[i])
+                        complete(i, -err);
+                }
+                return;
+            }
+            unsubmitted -= std::min<size_t>(unsubmitted, static_cast<size_t>(ret));
+
+            unsigned head = *cq_head;
+            const unsigned ready = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != ready; ++head) {
+                const io_uring_cqe &cqe = cqes[head & *cq_mask];
+                completed[cqe.user_data] = true;
+                complete(static_cast<size_t>(cqe.user_data), cqe.res);
+                --in_flight;
+            }
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+};
+#else
+struct BatchIO::Ring {};
+#endif
+
+BatchIO::BatchIO(size_t threads) : threads_(threads) {
+    if (threads_ == 0)
+        threads_ = std::max(1U, std::thread::hardware_concurrency()) * TUNABLE_FALLBACK_THREADS_PER_CORE;
+#if CBE_HAS_IO_URING
+    ring_ = Ring::create(TUNABLE_QUEUE_DEPTH);
+#endif
+}
+
+BatchIO::~BatchIO() = default;
+
+void BatchIO::stat(std::span<const std::string_view> paths, std::span<FileStat> results) {
+    Stats::add(Counter::STAT_CALLS, paths.size());
+#if CBE_HAS_IO_URING
+    if (ring_) {
+        const PathBlock names(paths);
+        std::vector<struct statx> buffers(paths.size());
+        ring_->run(
+            paths.size(),
+            [&](size_t i, io_uring_sqe &sqe) {
+                sqe.opcode = IORING_OP_STATX;
+                sqe.fd = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uint64_t>(names[i]);
+                sqe.len = STATX_MTIME;
+                sqe.off = reinterpret_cast<uint64_t>(&buffers[i]);
+            },
+            [&](size_t i, int res) {
+                if (res < 0) {
+                    results[i] = {.mtime = {}, .ec = errnoCode(-res)};
+                } else {
+                    results[i] = {.mtime = fromStatx(buffers[i].stx_mtime), .ec = {}};
+                }
+            });
+        return;
+    }
+#endif
+    parallelFor(paths.size(), threads_, TUNABLE_FALLBACK_OPS_PER_THREAD, [&](size_t i) {
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(paths[i], ec);
+        results[i] = {.mtime = mtime, .ec = ec};
+    });
+}
+
+void BatchIO::read(std::span<const std::string_view> paths, std::span<std::string> buffers,
+                   std::span<std::error_code> errors) {
+#if CBE_HAS_IO_URING
+    if (ring_) {
+        const PathBlock names(paths);
+        std::vector<int> fds(paths.size(), -1);
+        std::vector<struct statx> sizes(paths.size());
+        std::ranges::fill(errors, std::error_code{});
+
+        // 1. Open every file and stat it for its size. Request 2i opens file i, request 2i+1 stats it.
+        ring_->run(
+            paths.size() * 2,
+            [&](size_t op, io_uring_sqe &sqe) {
+                const size_t i = op / 2;
+                sqe.fd = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uint64_t>(names[i]);
+                if (op % 2 == 0) {
+                    sqe.opcode = IORING_OP_OPENAT;
+                    sqe.open_flags = O_RDONLY | O_CLOEXEC;
+                } else {
+                    sqe.opcode = IORING_OP_STATX;
+                    sqe.len = STATX_SIZE;
+                    sqe.off = reinterpret_cast<uint64_t>(&sizes[i]);
+                }
+            },
+            [&](size_t op, int res) {
+                const size_t i = op / 2;
+                if (op % 2 == 0 && res >= 0)
+                    fds[i] = res;
+                else if (res < 0 && !errors[i])
+                    errors[i] = errnoCode(-res);
+            });
+
+        // 2. One read per file, one byte past the stat-ed size so that a file which grew is noticed.
+        std::vector<size_t> pending;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            buffers[i].clear();
+            if (fds[i] == -1 || errors[i])
+                continue;
+            buffers[i].resize(sizes[i].stx_size + 1);
+            pending.push_back(i);
+        }
+        ring_->run(
+            pending.size(),
+            [&](size_t op, io_uring_sqe &sqe) {
+                const size_t i = pending[op];
+                sqe.opcode = IORING_OP_READ;
+                sqe.fd = fds[i];
+                sqe.addr = reinterpret_cast<uint64_t>(buffers[i].data());
+                sqe.len = static_cast<uint32_t>(buffers[i].size());
+                sqe.off = 0;
+            },
+            [&](size_t op, int res) {
+                const size_t i = pending[op];
+                if (res < 0) {
+                    errors[i] = errnoCode(-res);
+                    buffers[i].clear();
+                    return;
+                }
+                const auto expected = static_cast<size_t>(sizes[i].stx_size);
+                const auto got = static_cast<size_t>(res);
+                if (got != expected) {
+                    // Short read, or the file changed size since the stat: finish it synchronously.
+                    buffers[i].resize(std::max(got, expected) + 1);
+                    size_t done = got;
+                    ssize_t n = 0;
+                    while ((n = pread(fds[i], buffers[i].data() + done, buffers[i].size() - done,
+                                      static_cast<off_t>(done))) > 0) {
+                        done += static_cast<size_t>(n);
+                        if (done == buffers[i].size())
+                            buffers[i].resize(buffers[i].size() * 2);
+                    }
+                    if (n < 0)
+                        errors[i] = errnoCode(errno);
+                    buffers[i].resize(done);
+                } else {
+                    buffers[i].resize(got);
+                }
+            });
+
+        // 3. Close everything that was opened.
+        std::vector<size_t> open;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (fds[i] != -1)
+                open.push_back(i);
+        }
+        ring_->run(
+            open.size(),
+            [&](size_t op, io_uring_sqe &sqe) {
+                sqe.opcode = IORING_OP_CLOSE;
+                sqe.fd = fds[open[op]];
+            },
+            [](size_t, int) {});
+        return;
+    }
+#endif
+    parallelFor(paths.size(), threads_, TUNABLE_FALLBACK_OPS_PER_THREAD, [&](size_t i) {
+        errors[i] = readFile(paths[i], buffers[i]) ? std::error_code{} : std::make_error_code(std::errc::io_error);
+    });
+}
+
+void BatchIO::write(std::span<const std::string_view> paths, std::span<const std::string_view> contents,
+                    std::span<std::error_code> errors) {
+#if CBE_HAS_IO_URING
+    if (ring_) {
+        const PathBlock names(paths);
+        std::vector<int> fds(paths.size(), -1);
+        std::ranges::fill(errors, std::error_code{});
+
+        // 1. Create or truncate every file.
+        ring_->run(
+            paths.size(),
+            [&](size_t i, io_uring_sqe &sqe) {
+                sqe.opcode = IORING_OP_OPENAT;
+                sqe.fd = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uint64_t>(names[i]);
+                sqe.open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+                sqe.len = 0666;
+            },
+            [&](size_t i, int res) {
+                if (res < 0)
+                    errors[i] = errnoCode(-res);
+                else
+                    fds[i] = res;
+            });
+
+        // 2. One write per file.
+        std::vector<size_t> open;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (fds[i] != -1)
+                open.push_back(i);
+        }
+        ring_->run(
+            open.size(),
+            [&](size_t op, io_uring_sqe &sqe) {
+                const size_t i = open[op];
+                sqe.opcode = IORING_OP_WRITE;
+                sqe.fd = fds[i];
+                sqe.addr = reinterpret_cast<uint64_t>(contents[i].data());
+                sqe.len = static_cast<uint32_t>(contents[i].size());
+                sqe.off = 0;
+            },
+            [&](size_t op, int res) {
+                const size_t i = open[op];
+                if (res < 0) {
+                    errors[i] = errnoCode(-res);
+                    return;
+                }
+                // Short write: finish it synchronously.
+                for (auto done = static_cast<size_t>(res); done < contents[i].size();) {
+                    ssize_t n = pwrite(fds[i], contents[i].data() + done, contents[i].size() - done,
+                                       static_cast<off_t>(done));
+                    if (n <= 0) {
+                        errors[i] = errnoCode(n < 0 ? errno : EIO);
+                        break;
+                    }
+                    done += static_cast<size_t>(n);
+                }
+            });
+
+        // 3. Close.
+        ring_->run(
+            open.size(),
+            [&](size_t op, io_uring_sqe &sqe) {
+                sqe.opcode = IORING_OP_CLOSE;
+                sqe.fd = fds[open[op]];
+            },
+            [&](size_t op, int res) {
+                if (res < 0 && !errors[open[op]])
+                    errors[open[op]] = errnoCode(-res);
+            });
+        return;
+    }
+#endif
+    parallelFor(paths.size(), threads_, TUNABLE_FALLBACK_OPS_PER_THREAD, [&](size_t i) {
+        std::ofstream out{std::filesystem::path(paths[i]), std::ios::binary | std::ios::trunc};
+        out.write(contents[i].data(), static_cast<std::streamsize>(contents[i].size()));
+        out.close();
+        errors[i] = out ? std::error_code{} : std::make_error_code(std::errc::io_error);
+    });
+}
+
+} // namespace catalyst
@@ -10,7 +10,9 @@
 #include <fcntl.h>
 #include <fstream>
 #include <memory>
+#include <span>
 #include <string_view>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -54,6 +56,14 @@ struct BinHeader {
     uint64_t num_definitions;
     uint64_t num_nodes;
     uint64_t num_steps;
+    uint64_t num_inputs;
+    uint64_t num_pools;
+    uint64_t num_rules;
+    uint64_t num_aliases;
+    uint64_t num_commands;
+    uint64_t num_segments;
+    uint64_t num_literal_offsets;
+    StringRef literals; ///< Compiled command text, see `CommandTemplates`.
     uint64_t strings_size;
 };
 
@@ -62,6 +72,43 @@ struct BinDefinition {
     StringRef val;
 };
 
+struct BinNode {
+    StringRef path;
+    uint64_t path_hash; ///< Lets the path table be rebuilt without rehashing.
+    uint32_t step_id;
+    uint32_t reserved;
+};
+
+struct BinPool {
+    StringRef name;
+    uint32_t depth;
+    uint32_t reserved;
+};
+
+struct BinRule {
+    StringRef name;
+    StringRef command;
+    StringRef depfile;
+    StringRef rsp;
+    PoolId pool;
+    std::array<uint16_t, 3> reserved;
+};
+
+struct BinAlias {
+    StringRef name;
+    StringRef targets;
+};
+
+// Depfile inputs are not cached: they change with every build and are loaded afterwards.
+struct BinStep {
+    NodeId output;
+    uint8_t tool;
+    uint8_t reserved;
+    RuleId rule;
+    InputRange inputs;
+    InputRange opaque;
+};
+
 } // namespace
 
 Result<void> parse_bin(CBEBuilder &builder) {
@@ -79,11 +126,11 @@ Result<void> parse_bin(CBEBuilder &builder) {
 
     const auto *header = reinterpret_cast<const BinHeader *>(content.data());
 #ifdef __linux__
-    if (std::memcmp(header->magic.data(), "CATBL001", BIN_HEADER_MAGIC_BIT_LEN) != 0) {
+    if (std::memcmp(header->magic.data(), "CATBL007", BIN_HEADER_MAGIC_BIT_LEN) != 0) {
 #elifdef __apple__
-    if (std::memcmp(header->magic, "CATBM001", 8) != 0) {
+    if (std::memcmp(header->magic, "CATBM007", 8) != 0) {
 #elifdef _WIN32 || _WIN64
-    if (std::memcmp(header->magic, "CATBW001", 8) != 0) {
+    if (std::memcmp(header->magic, "CATBW007", 8) != 0) {
 #endif
         return std::unexpected("Invalid magic or version in .catalyst.bin");
     }
@@ -104,76 +151,76 @@ Result<void> parse_bin(CBEBuilder &builder) {
         ptr += sizeof(BinDefinition);
     }
 
-    // 2. Nodes
-    builder.graph_.nodes_.reserve(header->num_nodes);
+    // 2. Nodes, with their precomputed path hashes.
+    BuildGraph &graph = builder.graph_;
+    graph.paths_.reserve(header->num_nodes);
+    graph.step_of_.reserve(header->num_nodes);
     for (uint64_t i = 0; i < header->num_nodes; ++i) {
-        StringRef path_ref = *reinterpret_cast<const StringRef *>(ptr);
-        ptr += sizeof(StringRef);
-        uint64_t step_id_raw = *reinterpret_cast<const uint64_t *>(ptr);
-        ptr += sizeof(uint64_t);
-        uint64_t num_out_edges = *reinterpret_cast<const uint64_t *>(ptr);
-        ptr += sizeof(uint64_t);
-
-        std::optional<size_t> step_id = (step_id_raw == UINT64_MAX) ? std::nullopt : std::make_optional(step_id_raw);
-        std::vector<size_t> out_edges;
-        out_edges.reserve(num_out_edges);
-        for (uint64_t j = 0; j < num_out_edges; ++j) {
-            out_edges.push_back(*reinterpret_cast<const uint64_t *>(ptr));
-            ptr += sizeof(uint64_t);
-        }
+        const auto *node = reinterpret_cast<const BinNode *>(ptr);
+        ptr += sizeof(BinNode);
 
-        std::string_view path = get_sv(path_ref);
-        builder.graph_.nodes_.push_back({path, std::move(out_edges), step_id});
-        builder.graph_.index_.emplace(path, i);
+        graph.paths_.adopt(get_sv(node->path), node->path_hash);
+        graph.step_of_.push_back(node->step_id);
     }
 
-    // 3. Steps
-    builder.graph_.steps_.reserve(header->num_steps);
-    for (uint64_t i = 0; i < header->num_steps; ++i) {
-        StringRef tool_ref = *reinterpret_cast<const StringRef *>(ptr);
-        ptr += sizeof(StringRef);
-        StringRef inputs_ref = *reinterpret_cast<const StringRef *>(ptr);
-        ptr += sizeof(StringRef);
-        StringRef output_ref = *reinterpret_cast<const StringRef *>(ptr);
-        ptr += sizeof(StringRef);
-        uint64_t depfile_count = *reinterpret_cast<const uint64_t *>(ptr);
-        ptr += sizeof(uint64_t);
-
-        std::optional<std::vector<std::string_view>> depfile_inputs;
-        if (depfile_count != UINT64_MAX) {
-            depfile_inputs.emplace();
-            depfile_inputs->reserve(depfile_count);
-            for (uint64_t j = 0; j < depfile_count; ++j) {
-                StringRef ref = *reinterpret_cast<const StringRef *>(ptr);
-                ptr += sizeof(StringRef);
-                depfile_inputs->push_back(get_sv(ref));
-            }
-        }
+    // 3. Pools, rules and aliases.
+    for (uint64_t i = 0; i < header->num_pools; ++i) {
+        const auto *pool = reinterpret_cast<const BinPool *>(ptr);
+        graph.pools_.push_back({.name = get_sv(pool->name), .depth = pool->depth});
+        ptr += sizeof(BinPool);
+    }
+    for (uint64_t i = 0; i < header->num_rules; ++i) {
+        const auto *rule = reinterpret_cast<const BinRule *>(ptr);
+        graph.rules_.push_back({.name = get_sv(rule->name),
+                                .command = get_sv(rule->command),
+                                .depfile = get_sv(rule->depfile),
+                                .rsp = get_sv(rule->rsp),
+                                .pool = rule->pool});
+        ptr += sizeof(BinRule);
+    }
 
-        std::vector<std::string_view> parsed_inputs;
-        std::string_view remaining = get_sv(inputs_ref);
-        while (!remaining.empty()) {
-            size_t comma_pos = remaining.find(',');
-            std::string_view in_path;
-            if (comma_pos == std::string_view::npos) {
-                in_path = remaining;
-                remaining = {};
-            } else {
-                in_path = remaining.substr(0, comma_pos);
-                remaining = remaining.substr(comma_pos + 1);
-            }
-            if (!in_path.empty()) {
-                parsed_inputs.push_back(in_path);
-            }
-        }
+    for (uint64_t i = 0; i < header->num_aliases; ++i) {
+        const auto *alias = reinterpret_cast<const BinAlias *>(ptr);
+        graph.aliases_.push_back({.name = get_sv(alias->name), .targets = get_sv(alias->targets)});
+        ptr += sizeof(BinAlias);
+    }
 
-        builder.graph_.steps_.push_back({get_sv(tool_ref),
-                                         get_sv(inputs_ref),
-                                         get_sv(output_ref),
-                                         std::nullopt,
-                                         std::move(depfile_inputs),
-                                         std::move(parsed_inputs)});
+    // 4. Steps, column by column, followed by the input arena.
+    const auto *bin_steps = reinterpret_cast<const BinStep *>(ptr);
+    graph.step_tool_.reserve(header->num_steps);
+    graph.step_rule_.reserve(header->num_steps);
+    graph.step_output_.reserve(header->num_steps);
+    graph.step_inputs_.reserve(header->num_steps);
+    graph.step_opaque_.reserve(header->num_steps);
+    graph.step_depset_.reserve(header->num_steps);
+    for (uint64_t i = 0; i < header->num_steps; ++i) {
+        const BinStep &step = bin_steps[i];
+        graph.step_tool_.push_back(static_cast<Tool>(step.tool));
+        graph.step_rule_.push_back(step.rule);
+        graph.step_output_.push_back(step.output);
+        graph.step_inputs_.push_back(step.inputs);
+        graph.step_opaque_.push_back(step.opaque);
+        graph.step_depset_.push_back(INVALID_ID);
     }
+    ptr += header->num_steps * sizeof(BinStep);
+
+    const auto *arena = reinterpret_cast<const NodeId *>(ptr);
+    graph.input_arena_.assign(arena, arena + header->num_inputs);
+    ptr += header->num_inputs * sizeof(NodeId);
+
+    // 5. Compiled command templates, so rules are not compiled again.
+    using Segment = CommandTemplates::Segment;
+    CommandTemplates &templates = builder.templates_;
+    const auto *commands = reinterpret_cast<const InputRange *>(ptr);
+    templates.commands_.assign(commands, commands + header->num_commands);
+    ptr += header->num_commands * sizeof(InputRange);
+    const auto *segments = reinterpret_cast<const Segment *>(ptr);
+    templates.segments_.assign(segments, segments + header->num_segments);
+    ptr += header->num_segments * sizeof(Segment);
+    const auto *literal_offsets = reinterpret_cast<const uint32_t *>(ptr);
+    templates.literal_offsets_.assign(literal_offsets, literal_offsets + header->num_literal_offsets);
+    templates.literals_ = get_sv(header->literals);
+    builder.templates_compiled_ = true;
 
     builder.add_resource(file);
     return {};
@@ -187,90 +234,92 @@ Result<void> emit_bin(CBEBuilder &builder) {
 
     StringBuffer sb;
     const auto &definitions = builder.definitions();
-    const auto &nodes = builder.graph().nodes();
-    const auto &steps = builder.graph().steps();
+    const BuildGraph &graph = builder.graph();
 
     std::vector<BinDefinition> bin_defs;
     for (const auto &[k, v] : definitions) {
         bin_defs.push_back({sb.add(k), sb.add(v)});
     }
 
-    // Nodes and steps are variable length, we'll write them in two passes or buffer.
-    // Let's buffer to calculate sizes.
-    std::vector<char> nodes_buf;
-    for (const auto &node : nodes) {
-        StringRef path_ref = sb.add(node.path);
-        nodes_buf.insert(nodes_buf.end(),
-                         reinterpret_cast<const char *>(&path_ref),
-                         reinterpret_cast<const char *>(&path_ref) + sizeof(StringRef));
-
-        uint64_t step_id = node.step_id.value_or(UINT64_MAX);
-        nodes_buf.insert(nodes_buf.end(),
-                         reinterpret_cast<const char *>(&step_id),
-                         reinterpret_cast<const char *>(&step_id) + sizeof(uint64_t));
-
-        uint64_t num_out_edges = node.out_edges.size();
-        nodes_buf.insert(nodes_buf.end(),
-                         reinterpret_cast<const char *>(&num_out_edges),
-                         reinterpret_cast<const char *>(&num_out_edges) + sizeof(uint64_t));
-
-        for (size_t edge : node.out_edges) {
-            uint64_t edge_u64 = edge;
-            nodes_buf.insert(nodes_buf.end(),
-                             reinterpret_cast<const char *>(&edge_u64),
-                             reinterpret_cast<const char *>(&edge_u64) + sizeof(uint64_t));
-        }
+    std::vector<BinNode> bin_nodes;
+    bin_nodes.reserve(graph.node_count());
+    for (NodeId i = 0; i < graph.node_count(); ++i) {
+        bin_nodes.push_back({.path = sb.add(graph.node_path(i)),
+                             .path_hash = graph.paths_.hash(i),
+                             .step_id = graph.step_of_[i],
+                             .reserved = 0});
     }
 
-    std::vector<char> steps_buf;
-    for (const auto &step : steps) {
-        StringRef tool_ref = sb.add(step.tool);
-        StringRef inputs_ref = sb.add(step.inputs);
-        StringRef output_ref = sb.add(step.output);
-
-        steps_buf.insert(steps_buf.end(),
-                         reinterpret_cast<const char *>(&tool_ref),
-                         reinterpret_cast<const char *>(&tool_ref) + sizeof(StringRef));
-        steps_buf.insert(steps_buf.end(),
-                         reinterpret_cast<const char *>(&inputs_ref),
-                         reinterpret_cast<const char *>(&inputs_ref) + sizeof(StringRef));
-        steps_buf.insert(steps_buf.end(),
-                         reinterpret_cast<const char *>(&output_ref),
-                         reinterpret_cast<const char *>(&output_ref) + sizeof(StringRef));
-
-        uint64_t depfile_count = step.depfile_inputs ? step.depfile_inputs->size() : UINT64_MAX;
-        steps_buf.insert(steps_buf.end(),
-                         reinterpret_cast<const char *>(&depfile_count),
-                         reinterpret_cast<const char *>(&depfile_count) + sizeof(uint64_t));
-
-        if (step.depfile_inputs) {
-            for (const auto &di : *step.depfile_inputs) {
-                StringRef ref = sb.add(di);
-                steps_buf.insert(steps_buf.end(),
-                                 reinterpret_cast<const char *>(&ref),
-                                 reinterpret_cast<const char *>(&ref) + sizeof(StringRef));
-            }
-        }
+    std::vector<BinPool> bin_pools;
+    for (const Pool &pool : graph.pools()) {
+        bin_pools.push_back({.name = sb.add(pool.name), .depth = pool.depth, .reserved = 0});
     }
 
+    std::vector<BinRule> bin_rules;
+    for (const Rule &rule : graph.rules()) {
+        bin_rules.push_back({.name = sb.add(rule.name),
+                             .command = sb.add(rule.command),
+                             .depfile = sb.add(rule.depfile),
+                             .rsp = sb.add(rule.rsp),
+                             .pool = rule.pool,
+                             .reserved = {}});
+    }
+
+    std::vector<BinAlias> bin_aliases;
+    for (const Alias &alias : graph.aliases()) {
+        bin_aliases.push_back({.name = sb.add(alias.name), .targets = sb.add(alias.targets)});
+    }
+
+    std::vector<BinStep> bin_steps;
+    bin_steps.reserve(graph.step_count());
+    for (size_t i = 0; i < graph.step_count(); ++i) {
+        bin_steps.push_back({.output = graph.step_output_[i],
+                             .tool = static_cast<uint8_t>(graph.step_tool_[i]),
+                             .reserved = 0,
+                             .rule = graph.step_rule_[i],
+                             .inputs = graph.step_inputs_[i],
+                             .opaque = graph.step_opaque_[i]});
+    }
+
+    const CommandTemplates &templates = builder.templates();
+    using Segment = CommandTemplates::Segment;
+    static_assert(std::is_trivially_copyable_v<Segment> && std::has_unique_object_representations_v<Segment>);
+
     BinHeader header{};
 #ifdef __linux__
-    std::memcpy(header.magic.data(), "CATBL001", BIN_HEADER_MAGIC_BIT_LEN);
+    std::memcpy(header.magic.data(), "CATBL007", BIN_HEADER_MAGIC_BIT_LEN);
 #elifdef __apple__
-    std::memcpy(header.magic, "CATBM001", 8);
+    std::memcpy(header.magic, "CATBM007", 8);
 #elifdef _WIN32 || _WIN64
-    std::memcpy(header.magic, "CATBW001", 8);
+    std::memcpy(header.magic, "CATBW007", 8);
 #endif
     header.num_definitions = bin_defs.size();
-    header.num_nodes = nodes.size();
-    header.num_steps = steps.size();
+    header.num_nodes = graph.node_count();
+    header.num_steps = bin_steps.size();
+    header.num_inputs = graph.input_arena_.size();
+    header.num_pools = bin_pools.size();
+    header.num_rules = bin_rules.size();
+    header.num_aliases = bin_aliases.size();
+    header.num_commands = templates.commands_.size();
+    header.num_segments = templates.segments_.size();
+    header.num_literal_offsets = templates.literal_offsets_.size();
+    header.literals = sb.add(templates.literals_);
     header.strings_size = sb.data().size();
 
     // NOLINTBEGIN(cppcoreguidelines-narrowing-conversions, bugprone-narrowing-conversions)
     out.write(reinterpret_cast<const char *>(&header), sizeof(BinHeader));
     out.write(reinterpret_cast<const char *>(bin_defs.data()), bin_defs.size() * sizeof(BinDefinition));
-    out.write(nodes_buf.data(), nodes_buf.size());
-    out.write(steps_buf.data(), steps_buf.size());
+    out.write(reinterpret_cast<const char *>(bin_nodes.data()), bin_nodes.size() * sizeof(BinNode));
+    out.write(reinterpret_cast<const char *>(bin_pools.data()), bin_pools.size() * sizeof(BinPool));
+    out.write(reinterpret_cast<const char *>(bin_rules.data()), bin_rules.size() * sizeof(BinRule));
+    out.write(reinterpret_cast<const char *>(bin_aliases.data()), bin_aliases.size() * sizeof(BinAlias));
+    out.write(reinterpret_cast<const char *>(bin_steps.data()), bin_steps.size() * sizeof(BinStep));
+    out.write(reinterpret_cast<const char *>(graph.input_arena_.data()), graph.input_arena_.size() * sizeof(NodeId));
+    out.write(reinterpret_cast<const char *>(templates.commands_.data()),
+              templates.commands_.size() * sizeof(InputRange));
+    out.write(reinterpret_cast<const char *>(templates.segments_.data()), templates.segments_.size() * sizeof(Segment));
+    out.write(reinterpret_cast<const char *>(templates.literal_offsets_.data()),
+              templates.literal_offsets_.size() * sizeof(uint32_t));
     out.write(sb.data().data(), sb.data().size());
 
     return {};
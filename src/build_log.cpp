@@ -0,0 +1,110 @@
+#include "cbe/build_log.hpp"
+
+#if FF_cbe__logging
+
+#include <cstdio>
+#include <format>
+#include <iostream>
+#include <print>
+#include <utility>
+
+#ifndef _WIN32
+#include <csignal>
+#include <pthread.h>
+#endif
+
+namespace catalyst {
+
+Result<std::unique_ptr<BuildLog>> BuildLog::open(const std::string &path, std::mutex &console_mutex) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        return std::unexpected(std::format("Failed to open build log file: {}", path));
+    }
+    return std::unique_ptr<BuildLog>(new BuildLog(std::move(file), console_mutex));
+}
+
+BuildLog::BuildLog(std::ofstream &&file, std::mutex &console_mutex)
+    : file_(std::move(file)), console_mutex_(console_mutex), thread_([this] { run(); }) {
+}
+
+BuildLog::~BuildLog() {
+    push(&stop_);
+    thread_.join();
+}
+
+void BuildLog::submit(std::unique_ptr<Entry> entry) {
+    push(entry.release());
+}
+
+void BuildLog::push(Entry *node) {
+    Entry *head = pending_.load(std::memory_order_relaxed);
+    do {
+        node->next_ = head;
+    } while (!pending_.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    // The writer only sleeps on an empty list, so only the entry that ends it needs to wake it.
+    if (head == nullptr)
+        pending_.notify_one();
+}
+
+void BuildLog::run() {
+#ifndef _WIN32
+    // The log is opened before the executor blocks SIGINT/SIGTERM, and a thread that leaves them unblocked would
+    // take Ctrl-C with the default action instead of letting the build cancel its steps.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+#endif
+    bool stopping = false;
+    while (!stopping) {
+        pending_.wait(nullptr, std::memory_order_acquire);
+        Entry *batch = pending_.exchange(nullptr, std::memory_order_acquire);
+
+        Entry *ordered = nullptr;
+        while (batch != nullptr) {
+            Entry *next = batch->next_;
+            batch->next_ = ordered;
+            ordered = batch;
+            batch = next;
+        }
+
+        while (ordered != nullptr) {
+            Entry *entry = ordered;
+            ordered = entry->next_;
+            if (entry == &stop_) {
+                stopping = true;
+                continue;
+            }
+            write(*entry);
+            delete entry;
+        }
+        file_.flush();
+    }
+}
+
+void BuildLog::write(const Entry &entry) {
+    if ((entry.echo && !entry.output.empty()) || !entry.message.empty()) {
+        std::lock_guard lock(console_mutex_);
+        if (entry.echo && !entry.output.empty()) {
+            entry.output.write_to(std::cout);
+            std::cout.flush();
+        }
+        if (!entry.message.empty()) {
+            std::println(stderr, "{}", entry.message);
+        }
+    }
+
+    if (!entry.output.empty()) {
+        file_ << "=== " << entry.header << " ===\n";
+        entry.output.write_to(file_);
+        if (entry.output.back() != '\n') {
+            file_ << '\n';
+        }
+        file_ << '\n';
+    }
+}
+
+} // namespace catalyst
+
+#endif
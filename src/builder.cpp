@@ -9,4 +9,34 @@ Result<void> CBEBuilder::add_step(BuildStep &&bs) {
     return {};
 }
 
+Result<void> CBEBuilder::add_pool(std::string_view name, uint32_t depth) {
+    auto res = graph_.add_pool(name, depth);
+    if (!res)
+        return std::unexpected(res.error());
+    return {};
+}
+
+Result<void> CBEBuilder::add_rule(const RuleSpec &spec) {
+    auto res = graph_.add_rule(spec);
+    if (!res)
+        return std::unexpected(res.error());
+    return {};
+}
+
+Result<void> CBEBuilder::add_alias(const Alias &alias) {
+    return graph_.add_alias(alias);
+}
+
+Result<void> CBEBuilder::compile_templates() {
+    if (templates_compiled_)
+        return {};
+    TraceScope trace("compile commands", "phase");
+    auto templates = CommandTemplates::compile(definitions_, graph_);
+    if (!templates)
+        return std::unexpected(templates.error());
+    templates_ = std::move(*templates);
+    templates_compiled_ = true;
+    return {};
+}
+
 } // namespace catalyst
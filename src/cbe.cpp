@@ -2,6 +2,8 @@
 #include "cbe/cli_args.hpp"
 #include "cbe/executor.hpp"
 #include "cbe/parser.hpp"
+#include "cbe/stats.hpp"
+#include "cbe/trace.hpp"
 
 #include <filesystem>
 #include <format>
@@ -19,7 +21,11 @@ int main(const int argc, const char *const *argv) {
         }
         return 0;
     }
-    const auto [config, compdb, graph, commands, work_dir, definition_overrides] = *res;
+    const auto [config, compdb, graph, commands, simulate, explain, hotspots, work_dir, definition_overrides] = *res;
+    if (!config.trace_file.empty()) {
+        catalyst::Trace::enable();
+        catalyst::Trace::name_thread("main");
+    }
 
     if (work_dir != ".") {
         std::error_code ec;
@@ -47,22 +53,57 @@ int main(const int argc, const char *const *argv) {
     }
 
     catalyst::Executor executor{std::move(builder), config};
+    int exit_code = 0;
 
     if (compdb) {
-        auto _ = executor.emit_compdb();
+        if (auto res = executor.emit_compdb(); !res) {
+            std::println(std::cerr, "Compilation database failed: {}", res.error());
+            exit_code = 1;
+        }
     } else if (graph) {
-        auto _ = executor.emit_graph();
+        if (auto res = executor.emit_graph(); !res) {
+            std::println(std::cerr, "Graph failed: {}", res.error());
+            exit_code = 1;
+        }
     } else if (commands) {
-        auto _ = executor.emit_commands();
+        if (auto res = executor.emit_commands(); !res) {
+            std::println(std::cerr, "Commands failed: {}", res.error());
+            exit_code = 1;
+        }
+    } else if (simulate) {
+        if (auto res = executor.simulate(); !res) {
+            std::println(std::cerr, "Simulation failed: {}", res.error());
+            exit_code = 1;
+        }
+    } else if (explain) {
+        if (auto res = executor.explain(); !res) {
+            std::println(std::cerr, "Explain failed: {}", res.error());
+            exit_code = 1;
+        }
+    } else if (hotspots) {
+        if (auto res = executor.hotspots(); !res) {
+            std::println(std::cerr, "Hotspot analysis failed: {}", res.error());
+            exit_code = 1;
+        }
     } else if (config.clean) {
         if (auto res = executor.clean(); !res) {
             std::println(std::cerr, "Clean failed: {}", res.error());
-            return 1;
+            exit_code = 1;
         }
     } else if (auto res = executor.execute(); !res) {
         std::println(std::cerr, "Execution failed: {}", res.error());
-        return 1;
+        exit_code = 1;
     }
 
-    return 0;
+    if (config.print_stats) {
+        catalyst::Stats::print(stdout, !config.dry_run);
+    }
+    // The trace is written once, after every thread that recorded into it is gone.
+    if (catalyst::Trace::enabled()) {
+        if (auto res = catalyst::Trace::write(config.trace_file); !res) {
+            std::println(std::cerr, "{}", res.error());
+            exit_code = 1;
+        }
+    }
+    return exit_code;
 }
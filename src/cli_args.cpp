@@ -37,6 +37,16 @@ Result<CliArgs> cliArgs(const int argc, const char *const *argv) {
                 return unexpected(format("Missing argument for {}", arg));
             continue;
         }
+        if (arg == "--touches") {
+            if (!set_next_arg(par.config.touches_file, i))
+                return unexpected(format("Missing argument for {}", arg));
+            continue;
+        }
+        if (arg == "--trace") {
+            if (!set_next_arg(par.config.trace_file, i))
+                return unexpected(format("Missing argument for {}", arg));
+            continue;
+        }
 #if FF_cbe__estimates
         if (arg == "--estimates") {
             if (!set_next_arg(par.config.estimates_file, i))
@@ -78,9 +88,22 @@ Result<CliArgs> cliArgs(const int argc, const char *const *argv) {
                 par.graph = true;
             } else if (tool == "commands") {
                 par.commands = true;
+            } else if (tool == "simulate") {
+                par.simulate = true;
+            } else if (tool == "hotspots") {
+                par.hotspots = true;
+            } else if (tool == "explain") {
+                par.explain = true;
+            } else if (tool == "stats") {
+                // Everything up to running the steps, then the report; `--stats` runs them too.
+                par.config.dry_run = true;
+                par.config.silent = true;
+                par.config.print_stats = true;
             } else {
                 return unexpected(format("Unknown tool: {}", tool));
             }
+        } else if (arg == "--stats") {
+            par.config.print_stats = true;
         } else if (arg == "-s" || arg == "--silent") {
             par.config.silent = true;
         } else if (arg == "-k" || arg == "--keep-going") {
@@ -88,16 +111,21 @@ Result<CliArgs> cliArgs(const int argc, const char *const *argv) {
         } else if (const std::string_view::iterator pos = std::ranges::find(arg, '='); pos != arg.end()) {
             par.definition_overrides.emplace_back(std::string_view(arg.begin(), pos),
                                                   std::string_view(pos + 1, arg.end()));
+        } else if (!arg.starts_with('-')) {
+            par.config.targets.emplace_back(arg);
         } else {
             return unexpected(format("Unknown argument: {}. Run {} --help for more information.", arg, argv[0]));
         }
     }
+    // Both are about the whole tree: a simulated full build, and what a change to each file rebuilds in it.
+    if (!par.config.targets.empty() && (par.simulate || par.hotspots))
+        return unexpected(format("-t {} takes no targets", par.simulate ? "simulate" : "hotspots"));
     return par;
 }
 
 void printHelp() {
     using std::println;
-    println("Usage: cbe [options]");
+    println("Usage: cbe [options] [targets...]");
     println("Options:");
     println("  -h, --help                    Show this help message");
     println("  -v, --version                 Show version");
@@ -112,6 +140,21 @@ void printHelp() {
     println("                                  compdb   - generate compile_commands.json");
     println("                                  graph    - generate DOT graph of build");
     println("                                  commands - print commands that would be executed");
+    println("                                  simulate - predict the build time for -j <N> (or a range of job");
+    println("                                             counts) and each scheduling policy, from the step");
+    println("                                             durations recorded in .catalyst.usage");
+    println("                                  explain  - print why every step of the next build (or of the");
+    println("                                             targets) would run, and the files that set off the");
+    println("                                             most rebuilds");
+    println("                                  hotspots - rank source files by the cost of the rebuilds a");
+    println("                                             change to them causes");
+    println("                                  stats    - load and analyse the build without running it, then");
+    println("                                             print the runtime counters; spawn and step duration");
+    println("                                             counters need a build, with --stats");
+    println("  --stats                       Print the runtime counters and histograms after the build");
+    println("  --touches <file>              Change counts per file for -t hotspots, as printed by");
+    println("                                `git log --format= --name-only | sort | uniq -c`");
+    println("  --trace <file>                Write a Chrome trace of the run to <file>");
 #if FF_cbe__estimates
     println("  --estimates <estimate>        Use <estimate> as the estimate file (default: catalyst.estimates)");
 #endif
@@ -0,0 +1,198 @@
+#include "cbe/command.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace catalyst {
+
+Result<CommandTemplates> CommandTemplates::compile(const Definitions &definitions, const BuildGraph &graph) {
+    CommandTemplates templates;
+    for (size_t i = 0; i < BUILTIN_COMMANDS.size(); ++i) {
+        if (auto res = templates.add_command(TOOL_NAMES[i], BUILTIN_COMMANDS[i], definitions); !res)
+            return std::unexpected(res.error());
+    }
+    for (const Rule &rule : graph.rules()) {
+        if (auto res = templates.add_command(rule.name, rule.command, definitions); !res)
+            return std::unexpected(res.error());
+    }
+    return templates;
+}
+
+Result<void> CommandTemplates::add_command(std::string_view name, std::string_view command,
+                                           const Definitions &definitions) {
+    auto def = [&definitions](std::string_view key) -> std::string_view {
+        auto it = definitions.find(key);
+        return it == definitions.end() ? std::string_view{} : it->second;
+    };
+
+    InputRange &compiled = commands_.emplace_back(InputRange{.offset = static_cast<uint32_t>(segments_.size())});
+    std::string text;
+    std::string prefix;
+    // Arguments are split on single spaces; empty words (from repeated spaces) are dropped.
+    size_t pos = 0;
+    while (pos <= command.size()) {
+        size_t end = command.find(' ', pos);
+        if (end == std::string_view::npos)
+            end = command.size();
+        const std::string_view word = command.substr(pos, end - pos);
+        pos = end + 1;
+        if (word.empty())
+            continue;
+
+        std::optional<Part> slot;
+        size_t definitions_used = 0;
+        bool has_literal_text = false;
+        text.clear();
+        for (size_t i = 0; i < word.size();) {
+            if (word[i] != '$') {
+                text.push_back(word[i++]);
+                has_literal_text = true;
+                continue;
+            }
+            if (i + 1 < word.size() && word[i + 1] == '$') {
+                text.push_back('$');
+                has_literal_text = true;
+                i += 2;
+                continue;
+            }
+
+            std::string_view var;
+            if (i + 1 < word.size() && word[i + 1] == '{') {
+                const size_t close = word.find('}', i + 2);
+                if (close == std::string_view::npos)
+                    return std::unexpected(std::format("Rule {}: unterminated '${{' in '{}'", name, word));
+                var = word.substr(i + 2, close - (i + 2));
+                i = close + 1;
+            } else {
+                size_t var_end = i + 1;
+                while (var_end < word.size() && isVariableChar(word[var_end]))
+                    ++var_end;
+                var = word.substr(i + 1, var_end - (i + 1));
+                i = var_end;
+            }
+            if (var.empty())
+                return std::unexpected(std::format("Rule {}: '$' without a name in '{}'", name, word));
+
+            if (var == "in" || var == "out") {
+                if (slot)
+                    return std::unexpected(std::format("Rule {}: more than one of $in/$out in '{}'", name, word));
+                slot = var == "in" ? Part::INPUTS : Part::OUTPUT;
+                prefix = std::move(text);
+                text.clear();
+            } else {
+                text.append(def(var));
+                ++definitions_used;
+            }
+        }
+
+        if (slot) {
+            TextRange before = add_text(prefix);
+            segments_.push_back({.part = *slot, .text = before, .suffix = add_text(text)});
+            compiled.count++;
+        } else if (definitions_used == 1 && !has_literal_text) {
+            // A definition on its own is a list of arguments, like `$cflags`.
+            std::string_view value = text;
+            size_t arg_pos = 0;
+            while (arg_pos <= value.size()) {
+                size_t arg_end = value.find(' ', arg_pos);
+                if (arg_end == std::string_view::npos)
+                    arg_end = value.size();
+                if (arg_end > arg_pos)
+                    add_literal(compiled, value.substr(arg_pos, arg_end - arg_pos));
+                arg_pos = arg_end + 1;
+            }
+        } else if (!text.empty()) {
+            add_literal(compiled, text);
+        }
+    }
+    return {};
+}
+
+void CommandTemplates::add_literal(InputRange &command, std::string_view word) {
+    const auto start = static_cast<uint32_t>(literals_.size());
+    literals_.append(word);
+    literals_.push_back('\0');
+    const auto end = static_cast<uint32_t>(literals_.size());
+    // Literals are stored in the order they are added, so the last run of a command can keep growing.
+    if (command.count > 0 && segments_.back().part == Part::LITERALS && segments_.back().text.end == start) {
+        Segment &run = segments_.back();
+        literal_offsets_.push_back(start - run.text.begin);
+        run.count++;
+        run.text.end = end;
+        return;
+    }
+    segments_.push_back({.part = Part::LITERALS,
+                         .first = static_cast<uint32_t>(literal_offsets_.size()),
+                         .count = 1,
+                         .text = {.begin = start, .end = end}});
+    literal_offsets_.push_back(0);
+    command.count++;
+}
+
+CommandTemplates::TextRange CommandTemplates::add_text(std::string_view text) {
+    const auto begin = static_cast<uint32_t>(literals_.size());
+    literals_.append(text);
+    return {.begin = begin, .end = static_cast<uint32_t>(literals_.size())};
+}
+
+std::span<const char *const> CommandTemplates::emit(const BuildGraph &graph, const StepView &step,
+                                                    CommandArena &arena, std::string_view rsp_path) const {
+    arena.clear();
+    const std::string_view output = graph.node_path(step.output);
+    for (const Segment &segment : command(step)) {
+        switch (segment.part) {
+        case Part::LITERALS:
+            arena.append_block(text(segment.text), std::span(literal_offsets_).subspan(segment.first, segment.count));
+            break;
+        case Part::INPUTS:
+            if (!rsp_path.empty()) {
+                arena.append("@", rsp_path, {});
+            } else {
+                for (NodeId input : step.inputs) {
+                    arena.append(text(segment.text), graph.node_path(input), text(segment.suffix));
+                }
+            }
+            break;
+        case Part::OUTPUT:
+            arena.append(text(segment.text), output, text(segment.suffix));
+            break;
+        }
+    }
+    return arena.finish();
+}
+
+size_t CommandTemplates::argv_size(const BuildGraph &graph, const StepView &step) const {
+    size_t bytes = 0;
+    size_t args = 0;
+    for (const Segment &segment : command(step)) {
+        const size_t affixes = (segment.text.end - segment.text.begin) + (segment.suffix.end - segment.suffix.begin);
+        switch (segment.part) {
+        case Part::LITERALS:
+            bytes += segment.text.end - segment.text.begin; // Terminators included.
+            args += segment.count;
+            break;
+        case Part::INPUTS:
+            for (NodeId input : step.inputs) {
+                bytes += affixes + graph.node_path(input).size() + 1;
+            }
+            args += step.inputs.size();
+            break;
+        case Part::OUTPUT:
+            bytes += affixes + graph.node_path(step.output).size() + 1;
+            args++;
+            break;
+        }
+    }
+    return bytes + (args + 1) * sizeof(char *);
+}
+
+bool CommandTemplates::takes_inputs(const StepView &step) const {
+    return std::ranges::any_of(command(step), [](const Segment &segment) { return segment.part == Part::INPUTS; });
+}
+
+} // namespace catalyst
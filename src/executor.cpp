@@ -1,120 +1,204 @@
 #include "cbe/executor.hpp"
 
+#include "cbe/build_log.hpp"
 #include "cbe/builder.hpp"
+#include "cbe/command.hpp"
 #include "cbe/domain.hpp"
 #include "cbe/process_exec.hpp"
+#include "cbe/progress.hpp"
+#include "cbe/simulator.hpp"
+#include "cbe/stats.hpp"
+#include "cbe/trace.hpp"
+#include "cbe/usage_log.hpp"
 #include "cbe/utility.hpp"
 #include "nlohmann/json_fwd.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <csignal>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <nlohmann/json.hpp>
 #include <ostream>
 #include <print>
 #include <queue>
-#include <ranges>
+#include <span>
 #include <string>
 #include <string_view>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#ifndef _WIN32
+extern char **environ; // NOLINT(readability-redundant-declaration)
+#endif
+
 namespace {
 struct BuildCompdbParams {
-    const std::vector<size_t> &order;
+    std::span<const catalyst::NodeId> order;
     const catalyst::BuildGraph &build_graph;
-    std::vector<std::string> cc_vec;
-    std::vector<std::string> cxx_vec;
-    std::vector<std::string> cflags_vec;
-    std::vector<std::string> cxxflags_vec;
+    const catalyst::CommandTemplates &templates;
 };
 
 nlohmann::json buildCompdb(const BuildCompdbParams &params) {
-    auto [order, build_graph, cc_vec, cxx_vec, cflags_vec, cxxflags_vec] = params;
+    auto [order, build_graph, templates] = params;
     using JSON = nlohmann::json;
     JSON compdb = JSON::array();
     auto cwd = std::filesystem::current_path().string();
+    catalyst::CommandArena arena;
 
-    for (size_t node_idx : order) {
-        const auto &node = build_graph.nodes()[node_idx];
-        if (!node.step_id.has_value())
+    for (catalyst::NodeId node_idx : order) {
+        auto step_id = build_graph.node_step(node_idx);
+        if (!step_id.has_value())
             continue;
-        const auto &step = build_graph.steps()[*node.step_id];
+        const catalyst::StepView step = build_graph.step(*step_id);
 
         // Only emit for compilation steps
-        if (step.tool != "cc" && step.tool != "cxx")
+        if (step.tool != catalyst::Tool::CC && step.tool != catalyst::Tool::CXX)
             continue;
 
-        const std::vector<std::string_view> &inputs = step.parsed_inputs;
-
-        std::vector<std::string> args;
-        auto add_parts = [&args](const auto &parts) {
-            for (const auto &part : parts) {
-                if (part.begin() != part.end()) {
-                    args.push_back(std::ranges::to<std::string>(part));
-                }
-            }
-        };
-
-        constexpr static size_t EXTRA_ARGS_RESERVED_SPACE = 7;
-        if (step.tool == "cc") {
-            add_parts(cc_vec);
-            add_parts(cflags_vec);
-            args.reserve(args.size() + inputs.size() + EXTRA_ARGS_RESERVED_SPACE);
-            args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        } else if (step.tool == "cxx") {
-            add_parts(cxx_vec);
-            add_parts(cxxflags_vec);
-            args.reserve(args.size() + inputs.size() + EXTRA_ARGS_RESERVED_SPACE);
-            args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-            args.reserve(args.size() + inputs.size());
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
+        const std::string_view output = build_graph.node_path(step.output);
+        JSON arguments = JSON::array();
+        for (const char *arg : templates.emit(build_graph, step, arena)) {
+            arguments.push_back(arg);
         }
 
         JSON entry;
         entry["directory"] = cwd;
-        entry["arguments"] = args;
-        if (!inputs.empty()) {
-            entry["file"] = inputs[0];
+        entry["arguments"] = std::move(arguments);
+        if (!step.inputs.empty()) {
+            entry["file"] = build_graph.node_path(step.inputs[0]);
         }
-        entry["output"] = step.output;
+        entry["output"] = output;
         compdb.push_back(entry);
     }
 
     return compdb;
 }
-} // namespace
 
-namespace catalyst {
+/**
+ * @brief Writes the response file path of a step into `path`: the rule's pattern for rule steps, `<output>.rsp`
+ * otherwise. The output is kept whole, so `foo.a` and `foo.so` do not share a response file.
+ */
+void rspPathOf(const catalyst::BuildGraph &graph, const catalyst::StepView &step, std::string &path) {
+    const std::string_view output = graph.node_path(step.output);
+    if (step.tool == catalyst::Tool::RULE) {
+        catalyst::expandOutput(graph.rules()[step.rule].rsp, output, path);
+        return;
+    }
+    path.assign(output).append(".rsp");
+}
 
-bool isNewer(const std::filesystem::path &new_file, const std::filesystem::path &old_file) {
-    std::error_code ec;
-    auto new_time = std::filesystem::last_write_time(new_file, ec);
-    if (ec)
-        return true;
-    auto old_time = std::filesystem::last_write_time(old_file, ec);
-    if (ec)
-        return true;
-    return new_time > old_time;
+/** @brief Appends the inputs of a step to a response file, one per line, quoted where GNU tools need it. */
+void appendRspContent(const catalyst::BuildGraph &graph, const catalyst::StepView &step, std::string &content) {
+    for (catalyst::NodeId input : step.inputs) {
+        const std::string_view path = graph.node_path(input);
+        if (path.find_first_of(" \t\"'\\") == std::string_view::npos) {
+            content += path;
+        } else {
+            content += '"';
+            for (char c : path) {
+                if (c == '"' || c == '\\')
+                    content += '\\';
+                content += c;
+            }
+            content += '"';
+        }
+        content += '\n';
+    }
 }
 
+/**
+ * @brief Bytes of arguments a command may take before it has to use a response file.
+ *
+ * This is `ARG_MAX` less the environment, which shares the same space, and some headroom. On Windows,
+ * `CreateProcess` limits the whole command line instead.
+ */
+size_t argumentLimit() {
+    constexpr size_t TUNABLE_ARG_HEADROOM = 4096;
+#ifdef _WIN32
+    constexpr size_t WINDOWS_COMMAND_LINE_MAX = 32767;
+    return WINDOWS_COMMAND_LINE_MAX - TUNABLE_ARG_HEADROOM;
+#else
+    long arg_max = ::sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0)
+        arg_max = _POSIX_ARG_MAX;
+    size_t environment = 0;
+    for (char **env = environ; *env != nullptr; ++env) {
+        environment += std::strlen(*env) + 1 + sizeof(char *);
+    }
+    const size_t used = environment + TUNABLE_ARG_HEADROOM;
+    return static_cast<size_t>(arg_max) > used ? static_cast<size_t>(arg_max) - used : 0;
+#endif
+}
+
+/**
+ * @brief Calls back on SIGINT or SIGTERM for as long as it lives.
+ *
+ * The signals are blocked in the calling thread, so every thread started afterwards inherits the mask, and a
+ * dedicated thread takes them with `sigwait`. The callback therefore runs as ordinary code and may lock. The
+ * previous mask is restored on destruction. Subprocesses reset their mask, see `process_exec`.
+ */
+class InterruptWatcher {
+public:
+    explicit InterruptWatcher(std::function<void()> on_interrupt) : on_interrupt_(std::move(on_interrupt)) {
+#ifndef _WIN32
+        sigemptyset(&signals_);
+        sigaddset(&signals_, SIGINT);
+        sigaddset(&signals_, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals_, &previous_);
+        thread_ = std::thread([this] {
+            while (true) {
+                int signal = 0;
+                if (sigwait(&signals_, &signal) != 0 || stopping_)
+                    return;
+                on_interrupt_();
+            }
+        });
+#endif
+    }
+
+    InterruptWatcher(const InterruptWatcher &) = delete;
+    InterruptWatcher &operator=(const InterruptWatcher &) = delete;
+
+    ~InterruptWatcher() {
+#ifndef _WIN32
+        stopping_ = true;
+        pthread_kill(thread_.native_handle(), SIGTERM);
+        thread_.join();
+        pthread_sigmask(SIG_SETMASK, &previous_, nullptr);
+#endif
+    }
+
+private:
+    std::function<void()> on_interrupt_;
+#ifndef _WIN32
+    sigset_t signals_{};
+    sigset_t previous_{};
+    std::atomic<bool> stopping_ = false;
+    std::thread thread_;
+#endif
+};
+} // namespace
+
+namespace catalyst {
+
 Executor::Executor(CBEBuilder &&builder, const ExecutorConfig &config) : builder(std::move(builder)), config(config) {
 #if FF_cbe__estimates
     estimator = std::make_unique<WorkEstimate>(config.estimates_file);
@@ -122,86 +206,108 @@ Executor::Executor(CBEBuilder &&builder, const ExecutorConfig &config) : builder
 }
 
 Result<void> Executor::clean() {
-    catalyst::BuildGraph build_graph = builder.emit_graph();
+    std::vector<NodeId> selection;
+    auto emitted = emit_selected_graph(selection);
+    if (!emitted)
+        return std::unexpected(emitted.error());
+    catalyst::BuildGraph build_graph = std::move(*emitted);
     std::println("Cleaning build artifacts...");
 
-    for (const auto &step : build_graph.steps()) {
-        if (std::filesystem::exists(step.output)) {
+    // With targets, only the outputs they are built from; they need no order.
+    std::vector<size_t> steps;
+    if (config.targets.empty()) {
+        for (size_t i = 0; i < build_graph.step_count(); ++i) {
+            steps.push_back(i);
+        }
+    } else {
+        for (NodeId node : selection) {
+            if (auto step_id = build_graph.node_step(node); step_id.has_value())
+                steps.push_back(*step_id);
+        }
+    }
+    for (size_t i : steps) {
+        const std::string_view output = build_graph.node_path(build_graph.step(i).output);
+        if (std::filesystem::exists(output)) {
             std::error_code ec;
-            std::filesystem::remove(step.output, ec);
+            std::filesystem::remove(output, ec);
             if (ec) {
-                std::println(stderr, "Failed to remove {}: {}", step.output, ec.message());
+                std::println(stderr, "Failed to remove {}: {}", output, ec.message());
             } else {
-                std::println("Removed {}", step.output);
+                std::println("Removed {}", output);
             }
         }
         // Also clean .d files if they exist
-        auto d_file = std::string(step.output) + ".d";
-        if (std::filesystem::exists(d_file)) {
+        std::string d_file;
+        if (build_graph.depfile_path(build_graph.step(i), d_file) && std::filesystem::exists(d_file)) {
             std::filesystem::remove(d_file);
         }
     }
     return {};
 }
 
-[[clang::always_inline]]
-bool inline Executor::needs_rebuild(const BuildStep &step, StatCache &stat_cache) const {
-    if (!std::filesystem::exists(step.output))
-        return true;
-
-    auto output_modtime = std::filesystem::last_write_time(step.output);
-
-    if (stat_cache.changed_since(config.build_file, output_modtime)) {
-        return true;
-    }
-
-    if (step.depfile_inputs.has_value()) {
-        for (const auto &dep : *step.depfile_inputs) {
-            if (stat_cache.changed_since(std::filesystem::path(dep), output_modtime)) {
-                return true;
-            }
+std::vector<uint8_t> Executor::find_dirty(const BuildGraph &graph, std::span<const NodeId> order,
+                                          const StatCache &stat_cache) {
+    TraceScope trace("dirty analysis", "phase");
+    std::vector<uint8_t> dirty(graph.node_count(), 0);
+    // Counted per step, not per lookup: a counter bump would cost more than the lookup itself.
+    uint64_t hits = 0;
+    for (NodeId i : order) {
+        auto step_id = graph.node_step(i);
+        if (!dirty[i] && step_id.has_value()) {
+            const StepView step = graph.step(*step_id);
+            hits += 1 + step.inputs.size() + step.opaque_inputs.size() + (step.depfile_set != INVALID_ID ? 1 : 0);
+            dirty[i] = static_cast<uint8_t>(stat_cache.stale_cause(step));
         }
-    }
-    if (step.opaque_inputs.has_value()) {
-        for (const auto &opaque : *step.opaque_inputs) {
-            if (stat_cache.changed_since(std::filesystem::path(opaque), output_modtime)) {
-                return true;
+        if (dirty[i]) {
+            for (NodeId out : graph.out_edges(i)) {
+                dirty[out] = static_cast<uint8_t>(RebuildCause::INPUT_DIRTY);
             }
         }
     }
-    // this is our way of making sure that the .d file isn't stale
-    for (const auto &input : step.parsed_inputs) {
-        if (stat_cache.changed_since(input, output_modtime)) {
-            return true;
-        }
-    }
-    return false;
+    Stats::add(Counter::STAT_CACHE_HITS, hits);
+    return dirty;
 }
 
 Result<void> Executor::emit_graph() {
-    catalyst::BuildGraph build_graph = builder.emit_graph();
+    std::vector<NodeId> selection;
+    auto emitted = emit_selected_graph(selection);
+    if (!emitted)
+        return std::unexpected(emitted.error());
+    catalyst::BuildGraph build_graph = std::move(*emitted);
+    std::optional<TopoLevels> levels;
+    auto ordered = selected_order(build_graph, selection, levels);
+    if (!ordered)
+        return std::unexpected(ordered.error());
+    std::vector<uint8_t> selected(build_graph.node_count(), config.targets.empty() ? 1 : 0);
+    for (NodeId i : selection) {
+        selected[i] = 1;
+    }
+
+    BatchIO io(config.jobs);
     StatCache stat_cache;
+    stat_cache.prefetch(build_graph, config.build_file, io, selection);
+    const std::vector<uint8_t> dirty = find_dirty(build_graph, *ordered, stat_cache);
 
     std::cout << "digraph catalyst_build {\n";
     std::cout << "  rankdir=LR;\n";
     std::cout << "  node [shape=box, style=filled, fontname=\"Helvetica\"];\n";
 
-    for (size_t i = 0; i < build_graph.nodes().size(); ++i) {
-        const auto &node = build_graph.nodes()[i];
+    for (NodeId i : *ordered) {
         std::string color = "0.9 0.9 0.9"; // light gray for source files
 
-        if (node.step_id.has_value()) {
-            const auto &step = build_graph.steps()[*node.step_id];
-            if (needs_rebuild(step, stat_cache)) {
+        if (auto step_id = build_graph.node_step(i); step_id.has_value()) {
+            if (dirty[i]) {
                 color = "green";
             } else {
                 color = "white";
             }
         }
 
-        std::cout << "  n" << i << " [label=\"" << node.path << "\", fillcolor=\"" << color << "\"];\n";
+        std::cout << "  n" << i << " [label=\"" << build_graph.node_path(i) << "\", fillcolor=\"" << color << "\"];\n";
 
-        for (size_t target_idx : node.out_edges) {
+        for (NodeId target_idx : build_graph.out_edges(i)) {
+            if (!selected[target_idx])
+                continue;
             std::cout << "  n" << i << " -> n" << target_idx << ";\n";
         }
     }
@@ -210,21 +316,24 @@ Result<void> Executor::emit_graph() {
 }
 
 Result<void> Executor::emit_compdb() {
-    catalyst::BuildGraph build_graph = builder.emit_graph();
-    std::vector<size_t> order;
-    auto res = build_graph.topo_sort();
-    if (!res)
-        return std::unexpected(res.error());
-    order = *res;
+    if (auto res = builder.compile_templates(); !res)
+        return res;
+    std::vector<NodeId> selection;
+    auto emitted = emit_selected_graph(selection);
+    if (!emitted)
+        return std::unexpected(emitted.error());
+    catalyst::BuildGraph build_graph = std::move(*emitted);
+    std::optional<TopoLevels> levels;
+    auto ordered = selected_order(build_graph, selection, levels);
+    if (!ordered)
+        return std::unexpected(ordered.error());
+    const std::span<const NodeId> order = *ordered;
 
     using JSON = nlohmann::json;
     JSON compdb = buildCompdb({
         .order = order,
         .build_graph = build_graph,
-        .cc_vec = builder.getDefinitionOf<std::vector<std::string>>("cc"),
-        .cxx_vec = builder.getDefinitionOf<std::vector<std::string>>("cxx"),
-        .cflags_vec = builder.getDefinitionOf<std::vector<std::string>>("cflags"),
-        .cxxflags_vec = builder.getDefinitionOf<std::vector<std::string>>("cxxflags"),
+        .templates = builder.templates(),
     });
 
     std::ofstream f("compile_commands.json");
@@ -233,122 +342,240 @@ Result<void> Executor::emit_compdb() {
 }
 
 Result<void> Executor::emit_commands() {
-    catalyst::BuildGraph build_graph = builder.emit_graph();
-    std::vector<size_t> order;
-    auto res = build_graph.topo_sort();
-    if (!res)
-        return std::unexpected(res.error());
-    order = *res;
-
-    const auto cc_vec = builder.getDefinitionOf<std::vector<std::string>>("cc");
-    const auto cxx_vec = builder.getDefinitionOf<std::vector<std::string>>("cxx");
-    const auto cflags_vec = builder.getDefinitionOf<std::vector<std::string>>("cflags");
-    const auto cxxflags_vec = builder.getDefinitionOf<std::vector<std::string>>("cxxflags");
-
-    auto build_command_args_internal = [&](const BuildStep &step) -> std::vector<std::string> {
-        std::vector<std::string> args;
-        auto add_parts = [&args](const auto &parts) {
-            for (const auto &part : parts) {
-                if (part.begin() != part.end()) {
-                    args.push_back(std::ranges::to<std::string>(part));
-                }
-            }
-        };
-
-        const auto &inputs = step.parsed_inputs;
-
-        if (step.tool == "cc") {
-            add_parts(cc_vec);
-            add_parts(cflags_vec);
-            args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        } else if (step.tool == "cxx") {
-            add_parts(cxx_vec);
-            add_parts(cxxflags_vec);
-            args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        } else if (step.tool == "ld") {
-            add_parts(cxx_vec);
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        } else if (step.tool == "ar") {
-            args.insert(args.end(), {"ar", "rcs", std::string(step.output)});
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-        } else if (step.tool == "sld") {
-            add_parts(cxx_vec);
-            args.emplace_back("-shared");
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        }
-        return args;
-    };
-
-    for (size_t node_idx : order) {
-        const auto &node = build_graph.nodes()[node_idx];
-        if (!node.step_id.has_value())
+    if (auto res = builder.compile_templates(); !res)
+        return res;
+    std::vector<NodeId> selection;
+    auto emitted = emit_selected_graph(selection);
+    if (!emitted)
+        return std::unexpected(emitted.error());
+    catalyst::BuildGraph build_graph = std::move(*emitted);
+    std::optional<TopoLevels> levels;
+    auto ordered = selected_order(build_graph, selection, levels);
+    if (!ordered)
+        return std::unexpected(ordered.error());
+    const std::span<const NodeId> order = *ordered;
+
+    const CommandTemplates &templates = builder.templates();
+    CommandArena arena;
+    for (NodeId node_idx : order) {
+        auto step_id = build_graph.node_step(node_idx);
+        if (!step_id.has_value())
             continue;
-        const auto &step = build_graph.steps()[*node.step_id];
-        auto args = build_command_args_internal(step);
-        for (size_t i = 0; i < args.size(); ++i) {
-            std::cout << args[i] << (i == args.size() - 1 ? "" : " ");
+        auto argv = templates.emit(build_graph, build_graph.step(*step_id), arena);
+        for (size_t i = 0; i < argv.size(); ++i) {
+            std::cout << argv[i] << (i == argv.size() - 1 ? "" : " ");
         }
         std::cout << "\n";
     }
     return {};
 }
 
+Result<std::vector<uint64_t>> Executor::recorded_durations(const BuildGraph &graph, size_t &estimated) const {
+    auto usage_log = UsageLog::load(config.usage_file);
+    if (!usage_log)
+        return std::unexpected(usage_log.error());
+
+    // Steps that never ran successfully take the median of their tool, or of every step if the tool never ran.
+    std::vector<uint64_t> durations(graph.step_count(), 0);
+    std::vector<uint8_t> recorded(graph.step_count(), 0);
+    std::unordered_map<std::string_view, std::vector<uint64_t>> by_tool;
+    std::vector<uint64_t> all;
+    for (size_t s = 0; s < graph.step_count(); ++s) {
+        const StepView step = graph.step(s);
+        auto it = usage_log->records().find(std::string(graph.node_path(step.output)));
+        if (it == usage_log->records().end())
+            continue;
+        durations[s] = it->second.usage.wall_us;
+        recorded[s] = 1;
+        by_tool[graph.tool_name(step)].push_back(durations[s]);
+        all.push_back(durations[s]);
+    }
+    estimated = 0;
+    if (all.empty())
+        return std::vector<uint64_t>{};
+    auto median = [](std::vector<uint64_t> &values) {
+        std::ranges::nth_element(values, values.begin() + static_cast<ptrdiff_t>(values.size() / 2));
+        return values[values.size() / 2];
+    };
+    const uint64_t overall_median = median(all);
+    std::unordered_map<std::string_view, uint64_t> tool_medians;
+    for (auto &[tool, values] : by_tool) {
+        tool_medians.emplace(tool, median(values));
+    }
+    for (size_t s = 0; s < graph.step_count(); ++s) {
+        if (recorded[s] != 0)
+            continue;
+        auto it = tool_medians.find(graph.tool_name(graph.step(s)));
+        durations[s] = it == tool_medians.end() ? overall_median : it->second;
+        estimated++;
+    }
+    return durations;
+}
+
+Result<void> Executor::simulate() {
+    catalyst::BuildGraph build_graph = builder.emit_graph(config.jobs);
+    auto levels = build_graph.topo_sort(config.jobs);
+    if (!levels)
+        return std::unexpected(levels.error());
+    size_t estimated = 0;
+    auto durations = recorded_durations(build_graph, estimated);
+    if (!durations)
+        return std::unexpected(durations.error());
+    if (durations->empty())
+        return std::unexpected(std::format("No step durations recorded in {}; build once to record them",
+                                           config.usage_file));
+
+    const BuildSimulator simulator(build_graph, levels->order, *durations);
+    auto seconds = [](uint64_t us) { return std::format("{:.2f}s", static_cast<double>(us) / 1e6); };
+    std::println("Simulated {} steps ({} without a recorded duration, estimated from the median of their tool)",
+                 build_graph.step_count(), estimated);
+    std::println("Total work {}, critical path {} ({} steps)\n", seconds(simulator.total_work_us()),
+                 seconds(simulator.critical_path_us()), simulator.critical_path().size());
+
+    std::vector<size_t> job_counts;
+    if (config.jobs != 0) {
+        job_counts.push_back(config.jobs);
+    } else {
+        const size_t hardware = std::max(1U, std::thread::hardware_concurrency());
+        for (size_t jobs = 1; jobs <= 2 * hardware; jobs *= 2) {
+            job_counts.push_back(jobs);
+        }
+    }
+    std::print("{:>6}  {:>10}", "jobs", "bound");
+    for (std::string_view policy : POLICY_NAMES) {
+        std::print("  {:>19}", policy);
+    }
+    std::println("");
+    for (size_t jobs : job_counts) {
+        // No schedule beats the critical path, nor keeps more than every job busy.
+        const uint64_t bound = std::max(simulator.critical_path_us(), simulator.total_work_us() / jobs);
+        std::print("{:>6}  {:>10}", jobs, seconds(bound));
+        for (size_t p = 0; p < POLICY_NAMES.size(); ++p) {
+            const SimulationResult result = simulator.run(jobs, static_cast<SchedulingPolicy>(p));
+            std::print("  {:>12} ({:>3.0f}%)", seconds(result.wall_us), result.utilization * 100);
+        }
+        std::println("");
+    }
+
+    std::println("\nCritical path:");
+    for (NodeId node : simulator.critical_path()) {
+        const StepView step = build_graph.step(*build_graph.node_step(node));
+        std::println("  {:>10}  {} -> {}", seconds(simulator.duration_us(node)), build_graph.tool_name(step),
+                     build_graph.node_path(node));
+    }
+    return {};
+}
+
+Result<BuildGraph> Executor::emit_selected_graph(std::vector<NodeId> &selection) {
+    selection.clear();
+    if (config.targets.empty())
+        return builder.emit_graph(config.jobs);
+
+    // Node ids change when the graph is finalized, so the targets are looked up again afterwards.
+    auto targets = builder.graph().resolve_targets(config.targets);
+    if (!targets)
+        return std::unexpected(targets.error());
+    catalyst::BuildGraph build_graph = builder.emit_graph(config.jobs, *targets);
+    targets = build_graph.resolve_targets(config.targets);
+    if (!targets)
+        return std::unexpected(targets.error());
+    selection = build_graph.closure(*targets);
+    return build_graph;
+}
+
+Result<std::span<const NodeId>> Executor::selected_order(const BuildGraph &graph, std::span<const NodeId> selection,
+                                                         std::optional<TopoLevels> &levels) const {
+    if (!config.targets.empty() && graph.is_acyclic(selection))
+        return selection;
+    auto sorted = graph.topo_sort(config.jobs);
+    if (!sorted)
+        return std::unexpected(sorted.error());
+    levels = std::move(*sorted);
+    return std::span<const NodeId>(levels->order);
+}
+
 Result<void> Executor::execute() {
     pool.clear(); // Ensure clean state
 
-    catalyst::BuildGraph build_graph = builder.emit_graph();
+    if (auto res = builder.compile_templates(); !res)
+        return res;
+    std::vector<NodeId> selection;
+    auto emitted = emit_selected_graph(selection);
+    if (!emitted)
+        return std::unexpected(emitted.error());
+    catalyst::BuildGraph build_graph = std::move(*emitted);
+
+    // Reject cycles up front, with every cycle listed, instead of stalling mid-build.
+    std::optional<TopoLevels> levels;
+    auto ordered = selected_order(build_graph, selection, levels);
+    if (!ordered)
+        return std::unexpected(ordered.error());
+
+    // With targets, only the nodes they are built from are stat-ed, checked and scheduled, and edges leaving that
+    // selection are not counted, so the build finishes once the targets are done.
+    const std::span<const NodeId> order = *ordered;
+    std::vector<uint8_t> selected;
+    if (!config.targets.empty()) {
+        selected.assign(build_graph.node_count(), 0);
+        for (NodeId i : selection) {
+            selected[i] = 1;
+        }
+    }
+    auto is_selected = [&](NodeId node) { return selected.empty() || selected[node] != 0; };
 
-    const auto cc_vec = builder.getDefinitionOf<std::vector<std::string>>("cc");
-    const auto cxx_vec = builder.getDefinitionOf<std::vector<std::string>>("cxx");
-    const auto cflags_vec = builder.getDefinitionOf<std::vector<std::string>>("cflags");
-    const auto cxxflags_vec = builder.getDefinitionOf<std::vector<std::string>>("cxxflags");
-    const auto ldflags_vec = builder.getDefinitionOf<std::vector<std::string>>("ldflags");
-    const auto ldlibs_vec = builder.getDefinitionOf<std::vector<std::string>>("ldlibs");
+    const CommandTemplates &templates = builder.templates();
 
     // Build in-degrees
-    std::vector<int> in_degrees(build_graph.nodes().size(), 0);
-    for (const auto &node : build_graph.nodes()) {
-        for (size_t out : node.out_edges) {
-            in_degrees[out]++;
+    std::vector<uint32_t> in_degrees(build_graph.node_count(), 0);
+    size_t edge_count = 0;
+    for (NodeId i : order) {
+        for (NodeId out : build_graph.out_edges(i)) {
+            if (is_selected(out)) {
+                in_degrees[out]++;
+                edge_count++;
+            }
         }
     }
+    Stats::add(Counter::NODES, build_graph.node_count());
+    Stats::add(Counter::EDGES, edge_count);
+    Stats::add(Counter::STEPS, build_graph.step_count());
+
+    // Step durations are kept per tool, built-in tools first, then rules, as commands are indexed.
+    std::vector<Stats::HistogramId> step_histograms;
+    for (std::string_view tool : TOOL_NAMES) {
+        step_histograms.push_back(Stats::histogram(tool, "us"));
+    }
+    for (const Rule &rule : build_graph.rules()) {
+        step_histograms.push_back(Stats::histogram(rule.name, "us"));
+    }
+    const Stats::HistogramId queue_histogram = Stats::histogram("ready queue depth", "steps");
 
     struct Task {
-        size_t node_idx;
+        NodeId node_idx;
         size_t estimate;
+        uint64_t sequence; ///< Breaks ties in the order steps became ready.
         bool operator<(const Task &other) const {
-            return estimate < other.estimate;
+            return estimate != other.estimate ? estimate < other.estimate : sequence > other.sequence;
         }
     };
     std::priority_queue<Task> ready_queue;
+    uint64_t ready_sequence = 0;
 
-    auto push_ready = [&](size_t idx) {
+    // Only kept while tracing, to show how long each step waited in the ready queue.
+    std::vector<Trace::Clock::time_point> ready_at(Trace::enabled() ? build_graph.node_count() : 0);
+    auto push_ready = [&](NodeId idx) {
+        if (!ready_at.empty())
+            ready_at[idx] = Trace::Clock::now();
         size_t est = 0;
 #if FF_cbe__estimates
-        const auto &node = build_graph.nodes()[idx];
-        if (node.step_id.has_value()) {
-            est = estimator->getWorkEstimate(build_graph.steps()[*node.step_id].output);
+        if (auto step_id = build_graph.node_step(idx); step_id.has_value()) {
+            est = estimator->getWorkEstimate(build_graph.node_path(idx));
         }
 #endif
-        ready_queue.push({.node_idx = idx, .estimate = est});
+        ready_queue.push({.node_idx = idx, .estimate = est, .sequence = ready_sequence++});
     };
 
-    for (size_t i = 0; i < in_degrees.size(); ++i) {
+    for (NodeId i : order) {
         if (in_degrees[i] == 0) {
             push_ready(i);
         }
@@ -357,197 +584,211 @@ Result<void> Executor::execute() {
     std::mutex mtx;
     std::condition_variable cv_ready;
     std::atomic<size_t> completed_count = 0;
-    size_t total_nodes = build_graph.nodes().size();
+    size_t total_nodes = order.size();
     bool error_occurred = false;
     size_t active_workers = 0;
 
+    // Stat every file in the graph up front, in one batch, instead of one syscall at a time from the workers.
+    BatchIO io(config.jobs);
     StatCache stat_cache;
+    stat_cache.prefetch(build_graph, config.build_file, io, selection);
 
     std::mutex cout_tty_mtx;
     bool is_tty = ::isatty(STDOUT_FILENO) != 0;
 
 #if FF_cbe__logging
+    // Steps hand their output to the log writer instead of writing it themselves.
+    std::unique_ptr<BuildLog> build_log;
     if (!config.build_log_file.empty()) {
-        std::ofstream log_file(config.build_log_file, std::ios::trunc);
-        if (!log_file) {
-            return std::unexpected(std::format("Failed to open build log file: {}", config.build_log_file));
+        auto log = BuildLog::open(config.build_log_file, cout_tty_mtx);
+        if (!log) {
+            return std::unexpected(log.error());
         }
+        build_log = std::move(*log);
     }
 #endif
 
-    // Pre-count steps that need rebuilding and find final output target
+    // Steps whose command line would not fit pass their inputs in a response file, as do rules that ask for one.
+    const size_t argument_limit = argumentLimit();
+    auto needs_rsp = [&](const StepView &step) {
+        if (step.tool == Tool::RULE)
+            return !build_graph.rules()[step.rule].rsp.empty();
+        return templates.takes_inputs(step) && templates.argv_size(build_graph, step) > argument_limit;
+    };
+
+    // Decide up front which steps run, so that the dependents of a rebuilt step run in the same build, then
+    // pre-count them and find final output target
+    const std::vector<uint8_t> dirty = find_dirty(build_graph, order, stat_cache);
     size_t steps_to_build = 0;
     std::string final_output_name;
-    for (size_t i = 0; i < build_graph.nodes().size(); ++i) {
-        const auto &node = build_graph.nodes()[i];
-        if (node.step_id.has_value()) {
-            const auto &step = build_graph.steps()[*node.step_id];
-            if (needs_rebuild(step, stat_cache)) {
+    std::vector<size_t> rsp_steps;
+    std::vector<uint8_t> step_uses_rsp(build_graph.step_count(), 0);
+    std::vector<uint64_t> step_work(build_graph.step_count(), 0);
+    for (NodeId i : order) {
+        if (auto step_id = build_graph.node_step(i); step_id.has_value()) {
+            const StepView step = build_graph.step(*step_id);
+            if (dirty[i]) {
                 steps_to_build++;
+                uint64_t work = 1;
+#if FF_cbe__estimates
+                work = std::max<uint64_t>(work, estimator->getWorkEstimate(build_graph.node_path(i)));
+#endif
+                step_work[*step_id] = work;
+                if (needs_rsp(step)) {
+                    step_uses_rsp[*step_id] = 1;
+                    rsp_steps.push_back(*step_id);
+                }
             }
-            if (node.out_edges.empty()) {
-                final_output_name = step.output;
+            if (std::ranges::none_of(build_graph.out_edges(i), is_selected)) {
+                final_output_name = build_graph.node_path(i);
             }
         }
     }
-    std::atomic<size_t> steps_completed = 0;
+
+    // Workers only report to the renderer, which owns the console's progress output.
+    ProgressMode progress_mode = ProgressMode::LINES;
+    if (config.silent) {
+        progress_mode = ProgressMode::SILENT;
+    } else if (config.dry_run) {
+        progress_mode = ProgressMode::DRY_RUN;
+    } else if (is_tty) {
+        progress_mode = ProgressMode::STATUS_LINE;
+    }
+    Progress progress(build_graph, step_work, steps_to_build, progress_mode, cout_tty_mtx);
+    auto status_line_shown = [&] { return progress_mode == ProgressMode::STATUS_LINE && progress.started() > 0; };
+
+    // Write the response files of every step that will use one in one batch, before any step starts. A file is
+    // only rewritten when its content changed, so an incremental build neither rewrites nor re-times it.
+    if (!config.dry_run && !rsp_steps.empty()) {
+        TraceScope trace("write response files", "phase");
+        std::vector<std::string> rsp_paths(rsp_steps.size());
+        std::vector<std::string> contents(rsp_steps.size());
+        for (size_t i = 0; i < rsp_steps.size(); ++i) {
+            const StepView step = build_graph.step(rsp_steps[i]);
+            rspPathOf(build_graph, step, rsp_paths[i]);
+            constexpr auto TUNABLE_RSP_PATH_ESTIMATE = 100;
+            contents[i].reserve(step.inputs.size() * TUNABLE_RSP_PATH_ESTIMATE);
+            appendRspContent(build_graph, step, contents[i]);
+        }
+        std::vector<std::string_view> rsp_views(rsp_paths.begin(), rsp_paths.end());
+        std::vector<std::string> current(rsp_steps.size());
+        std::vector<std::error_code> read_errors(rsp_steps.size());
+        io.read(rsp_views, current, read_errors);
+
+        std::vector<std::string_view> stale_paths;
+        std::vector<std::string_view> stale_contents;
+        for (size_t i = 0; i < rsp_steps.size(); ++i) {
+            if (!read_errors[i] && current[i] == contents[i])
+                continue;
+            stale_paths.push_back(rsp_views[i]);
+            stale_contents.push_back(contents[i]);
+        }
+        std::vector<std::error_code> errors(stale_paths.size());
+        io.write(stale_paths, stale_contents, errors);
+        for (size_t i = 0; i < errors.size(); ++i) {
+            if (errors[i])
+                return std::unexpected(std::format("Failed to write response file {}: {}", stale_paths[i],
+                                                   errors[i].message()));
+        }
+    }
 
     // If graph is empty
     if (total_nodes == 0)
         return {};
 
-    auto build_command_args = [&](const BuildStep &step, bool dry_run_mode) -> std::vector<std::string> {
-        std::vector<std::string> args;
-        static constexpr auto ARGS_VEC_INIT_SZ = 40;
-        args.reserve(ARGS_VEC_INIT_SZ);
-
-        auto add_parts = [&args](const auto &parts) {
-            args.reserve(args.size() + parts.size());
-            for (const auto &part : parts) {
-                if (part.begin() != part.end()) {
-                    args.push_back(std::ranges::to<std::string>(part));
-                }
-            }
-        };
-
-        const auto &inputs = step.parsed_inputs;
-
-        if (step.tool == "cc") {
-            add_parts(cc_vec);
-            add_parts(cflags_vec);
-            args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        } else if (step.tool == "cxx") {
-            add_parts(cxx_vec);
-            add_parts(cxxflags_vec);
-            args.insert(args.end(), {"-MMD", "-MF", std::string(step.output) + ".d", "-c"});
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        } else if (step.tool == "ld") {
-            add_parts(cxx_vec);
-            static constexpr auto TUNABLE_INPUT_SZ = 50;
-            std::filesystem::path rsp_path = std::filesystem::path(step.output).replace_extension(".rsp");
-
-            bool use_rsp = false;
-            if (std::filesystem::exists(rsp_path) && isNewer(rsp_path, config.build_file)) {
-                use_rsp = true;
-            } else if (inputs.size() > TUNABLE_INPUT_SZ) {
-                use_rsp = true;
-                if (!dry_run_mode) {
-                    std::string rsp_content;
-                    constexpr auto TUNABLE_RSP_PATH_ESTIMATE = 100;
-                    rsp_content.reserve(inputs.size() * TUNABLE_RSP_PATH_ESTIMATE);
-                    for (const auto &input : inputs) {
-                        rsp_content += input;
-                        rsp_content += '\n';
-                    }
-                    std::ofstream rsp_file(rsp_path);
-                    rsp_file.write(rsp_content.data(), static_cast<long>(rsp_content.size()));
-                }
-            }
-
-            if (use_rsp) {
-                 args.push_back(std::string("@") + rsp_path.string());
-            } else {
-                for (const auto &in : inputs)
-                    args.emplace_back(in);
-            }
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-            add_parts(ldflags_vec);
-            add_parts(ldlibs_vec);
-        } else if (step.tool == "ar") {
-            args.insert(args.end(), {"ar", "rcs", std::string(step.output)});
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-        } else if (step.tool == "sld") {
-            add_parts(cxx_vec);
-            args.emplace_back("-shared");
-            for (const auto &in : inputs)
-                args.emplace_back(in);
-            args.emplace_back("-o");
-            args.emplace_back(step.output);
-        }
-        return args;
+    // The response files were written before the build.
+    auto rsp_for = [&](size_t step_id, const StepView &step, std::string &rsp_path) -> std::string_view {
+        if (!step_uses_rsp[step_id])
+            return {};
+        rspPathOf(build_graph, step, rsp_path);
+        return rsp_path;
     };
 
-    auto print_message = [&](const BuildStep &step) {
-        if (config.silent) {
-            return;
-        }
+    // Running subprocesses, so a failure or an interrupt can stop them instead of waiting for them.
+    RunningProcesses running;
+    std::atomic<bool> interrupted = false;
+    constexpr auto TUNABLE_KILL_GRACE = std::chrono::milliseconds(1000);
 
-        std::lock_guard lock(cout_tty_mtx);
-        if (config.dry_run) {
-            std::cout << "[DRY RUN] " << step.tool << " -> " << step.output << std::endl;
-        } else {
-            auto current = steps_completed.fetch_add(1, std::memory_order_relaxed) + 1;
-            if (is_tty) {
-                std::print("\r\033[K[{}/{}] {:>3} -> {}", current, steps_to_build, step.tool, step.output);
-                std::cout.flush();
-            } else {
-                std::println("[{}/{}] {:>3} -> {}", current, steps_to_build, step.tool, step.output);
-            }
-        }
-    };
+    // Filled by the worker that ran the step, so no two threads write the same slot.
+    std::vector<StepUsage> step_usage(config.usage_file.empty() ? 0 : build_graph.step_count());
+    std::vector<uint8_t> step_usage_recorded(step_usage.size(), 0);
 
-    auto process_step = [&](size_t node_idx) {
+    // Each worker builds its command lines in its own arena, so steps do not allocate once it has warmed up.
+    auto process_step = [&](NodeId node_idx, CommandArena &arena, std::string &rsp_path) {
         // NOLINTBEGIN(performance-avoid-endl)
-        const auto &node = build_graph.nodes()[node_idx];
-        if (node.step_id.has_value()) {
-            const auto &step = build_graph.steps()[*node.step_id];
-
-            if (needs_rebuild(step, stat_cache)) {
-                print_message(step);
-                if (config.dry_run)
+        if (auto step_id = build_graph.node_step(node_idx); step_id.has_value()) {
+            const StepView step = build_graph.step(*step_id);
+            const std::string_view output_path = build_graph.node_path(step.output);
+
+            if (dirty[node_idx]) {
+                progress.step_started(static_cast<uint32_t>(*step_id));
+                if (config.dry_run) {
+                    progress.step_finished(static_cast<uint32_t>(*step_id));
                     return 0;
+                }
 
-                auto args = build_command_args(step, false);
+                auto argv = templates.emit(build_graph, step, arena, rsp_for(*step_id, step, rsp_path));
 
 #if FF_cbe__profiling
                 auto start = std::chrono::steady_clock::now();
 #endif
 #if FF_cbe__logging
-                bool capture_output = !config.build_log_file.empty();
+                std::unique_ptr<BuildLog::Entry> log_entry;
+                if (build_log) {
+                    log_entry = std::make_unique<BuildLog::Entry>();
+                }
+                OutputCapture *capture = log_entry ? &log_entry->output : nullptr;
 #else
-                bool capture_output = false;
+                OutputCapture *capture = nullptr;
 #endif
-                auto res = catalyst::process_exec(std::move(args), std::nullopt, std::nullopt, capture_output);
+                ProcessUsage process_usage;
+                const auto exec_begin = std::chrono::steady_clock::now();
+                auto res =
+                    catalyst::process_exec(argv, std::nullopt, std::nullopt, capture, &running, &process_usage);
+                const auto exec_end = std::chrono::steady_clock::now();
+                progress.step_finished(static_cast<uint32_t>(*step_id));
+                if (res && *res == 0 && !step_usage.empty()) {
+                    step_usage[*step_id] = {
+                        .wall_us = static_cast<uint64_t>(
+                            std::chrono::duration_cast<std::chrono::microseconds>(exec_end - exec_begin).count()),
+                        .process = process_usage};
+                    step_usage_recorded[*step_id] = 1;
+                }
 #if FF_cbe__profiling
                 auto end = std::chrono::steady_clock::now();
                 std::chrono::duration<double> diff = end - start;
                 {
                     std::lock_guard lock(cout_tty_mtx);
-                    std::println("Step {} took {:.4f}s", step.output, diff.count());
+                    std::println("Step {} took {:.4f}s", output_path, diff.count());
                 }
 #endif
 
                 if (res) {
-                    auto [ec, output] = *res;
-#if FF_cbe__logging
-                    if (capture_output && !output.empty()) {
-                        std::lock_guard lock(cout_tty_mtx);
-                        if (!config.silent || ec != 0) {
-                            std::print("{}", output);
-                        }
-
-                        std::ofstream log_file(config.build_log_file, std::ios_base::app);
-                        if (log_file) {
-                            log_file << "=== " << step.tool << " -> " << step.output << " ===\n";
-                            log_file << output;
-                            if (output.back() != '\n') {
-                                log_file << '\n';
-                            }
-                            log_file << '\n';
+                    const int ec = *res;
+                    std::string failure;
+                    if (ec != 0) {
+                        // Whatever the step left behind is newer than its inputs and would pass as up to date.
+                        std::error_code remove_ec;
+                        std::filesystem::remove(output_path, remove_ec);
+                        // Steps stopped by a cancellation did not fail on their own, the cause was reported.
+                        if (!running.cancelled()) {
+                            failure = std::format("Build failed: {} -> {} (exit code {})", build_graph.tool_name(step),
+                                                  output_path, ec);
                         }
                     }
+#if FF_cbe__logging
+                    // The failure is reported after the output that explains it.
+                    if (log_entry && (!log_entry->output.empty() || !failure.empty())) {
+                        log_entry->header = std::format("{} -> {}", build_graph.tool_name(step), output_path);
+                        log_entry->echo = !config.silent || ec != 0;
+                        log_entry->message = std::exchange(failure, {});
+                        build_log->submit(std::move(log_entry));
+                    }
 #endif
+                    if (!failure.empty()) {
+                        std::println(stderr, "{}", failure);
+                    }
                     if (ec != 0) {
-                        std::println(stderr, "Build failed: {} -> {} (exit code {})", step.tool, step.output, ec);
                         return ec;
                     }
                 } else {
@@ -558,7 +799,7 @@ Result<void> Executor::execute() {
 #if FF_cbe__logging
             else {
                 std::lock_guard lock(cout_tty_mtx);
-                std::println("Skipping {} (up to date)", step.output);
+                std::println("Skipping {} (up to date)", output_path);
             }
 #endif
         }
@@ -566,34 +807,123 @@ Result<void> Executor::execute() {
         // NOLINTEND(performance-avoid-endl)
     };
 
-    auto worker = [&]() {
+    // Steps of a pool that is full are set aside until a step of the same pool finishes, and resume in the order of
+    // the ready queue. Only steps that run take a slot.
+    std::vector<uint32_t> pool_running(build_graph.pools().size(), 0);
+    std::vector<std::priority_queue<Task>> pool_waiting(build_graph.pools().size());
+    auto pool_of = [&](NodeId idx) -> PoolId {
+        auto step_id = build_graph.node_step(idx);
+        if (!step_id.has_value() || !dirty[idx])
+            return NO_INDEX;
+        return build_graph.step_pool(build_graph.step(*step_id));
+    };
+
+    auto stop_build = [&] {
+        {
+            std::lock_guard lock(mtx);
+            completed_count = total_nodes; // Force exit
+        }
+        cv_ready.notify_all();
+        running.cancel(TUNABLE_KILL_GRACE);
+    };
+
+    // The time workers wait for the scheduler is where a high job count stops scaling.
+    auto lock_scheduler = [&] {
+        const auto begin = std::chrono::steady_clock::now();
+        std::unique_lock lock(mtx);
+        const std::chrono::nanoseconds wait = std::chrono::steady_clock::now() - begin;
+        Stats::add(Counter::SCHEDULER_LOCKS);
+        Stats::add(Counter::SCHEDULER_LOCK_WAIT_NS, static_cast<uint64_t>(wait.count()));
+        return lock;
+    };
+
+    auto worker = [&](size_t lane) {
+        CommandArena arena;
+        std::string rsp_path;
+        Trace::Clock::time_point idle_since;
+        if (Trace::enabled()) {
+            Trace::name_thread(std::format("worker {}", lane));
+            idle_since = Trace::Clock::now();
+        }
         while (true) {
-            size_t node_idx;
+            NodeId node_idx;
+            PoolId node_pool;
             {
-                std::unique_lock lock(mtx);
+                std::unique_lock lock = lock_scheduler();
                 cv_ready.wait(lock, [&] {
-                    return !ready_queue.empty() || completed_count == total_nodes || active_workers == 0; //
+                    return !ready_queue.empty() || completed_count >= total_nodes || active_workers == 0; //
                 });
 
-                if (ready_queue.empty()) {
+                // Steps still queued after a fail-fast stop or an interrupt are not started.
+                if (ready_queue.empty() || completed_count >= total_nodes) {
                     if (completed_count == total_nodes)
                         return;
                     // If queue is empty and no active workers, but work not done -> Cycle
                     return;
                 }
 
-                node_idx = ready_queue.top().node_idx;
+                Stats::peak(Counter::PEAK_QUEUE_DEPTH, ready_queue.size());
+                Stats::record(queue_histogram, ready_queue.size());
+                const Task task = ready_queue.top();
                 ready_queue.pop();
+                node_idx = task.node_idx;
+                node_pool = pool_of(node_idx);
+                if (node_pool != NO_INDEX) {
+                    if (pool_running[node_pool] == build_graph.pools()[node_pool].depth) {
+                        pool_waiting[node_pool].push(task);
+                        continue;
+                    }
+                    pool_running[node_pool]++;
+                }
                 active_workers++;
             }
 
-            int result = process_step(node_idx);
+            // A lane is idle from the end of its last step to the start of the next, whatever it did in between.
+            std::optional<size_t> traced_step;
+            Trace::Clock::time_point step_begin;
+            if (Trace::enabled() && dirty[node_idx]) {
+                traced_step = build_graph.node_step(node_idx);
+                step_begin = Trace::Clock::now();
+                const std::string_view output = build_graph.node_path(node_idx);
+                Trace::complete("idle", "scheduler", idle_since, step_begin);
+                Trace::async(std::string(output), "queue", node_idx, ready_at[node_idx], step_begin);
+            }
+
+            const auto run_begin = std::chrono::steady_clock::now();
+            int result = process_step(node_idx, arena, rsp_path);
+            if (dirty[node_idx] && !config.dry_run) {
+                const StepView step = build_graph.step(*build_graph.node_step(node_idx));
+                const size_t tool =
+                    step.tool == Tool::RULE ? TOOL_NAMES.size() + step.rule : static_cast<size_t>(step.tool);
+                const auto duration =
+                    std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - run_begin);
+                Stats::add(Counter::STEPS_RUN);
+                Stats::record(step_histograms[tool], static_cast<uint64_t>(duration.count()));
+            }
+            if (traced_step) {
+                idle_since = Trace::Clock::now();
+                const StepView step = build_graph.step(*traced_step);
+                Trace::complete(std::format("{} -> {}", build_graph.tool_name(step), build_graph.node_path(node_idx)),
+                                "step", step_begin, idle_since);
+            }
+            if (result != 0 && !config.keep_going) {
+                // Fail fast: whatever else is running would only delay the report of the failure.
+                running.cancel(TUNABLE_KILL_GRACE);
+            }
 
             {
-                std::lock_guard lock(mtx);
+                std::unique_lock lock = lock_scheduler();
                 active_workers--;
 
                 size_t new_work_count = 0;
+                if (node_pool != NO_INDEX) {
+                    pool_running[node_pool]--;
+                    if (!pool_waiting[node_pool].empty()) {
+                        ready_queue.push(pool_waiting[node_pool].top());
+                        pool_waiting[node_pool].pop();
+                        new_work_count++;
+                    }
+                }
 
                 if (result != 0) {
                     error_occurred = true;
@@ -604,8 +934,9 @@ Result<void> Executor::execute() {
                     }
                 } else {
                     completed_count.fetch_add(1, std::memory_order_relaxed);
-                    const auto &node = build_graph.nodes()[node_idx];
-                    for (size_t neighbor : node.out_edges) {
+                    for (NodeId neighbor : build_graph.out_edges(node_idx)) {
+                        if (!is_selected(neighbor))
+                            continue;
                         in_degrees[neighbor]--;
                         if (in_degrees[neighbor] == 0) {
                             push_ready(neighbor);
@@ -638,21 +969,59 @@ Result<void> Executor::execute() {
     if (thread_count == 0)
         thread_count = 1;
 
-    for (size_t i = 0; i < thread_count; ++i) {
-        pool.emplace_back(worker);
+    {
+        InterruptWatcher watcher([&] {
+            interrupted = true;
+            stop_build();
+        });
+        TraceScope trace("run steps", "phase");
+        progress.start();
+        for (size_t i = 0; i < thread_count; ++i) {
+            pool.emplace_back(worker, i);
+        }
+
+        pool.clear(); // Join all threads
+        progress.stop();
+    }
+#if FF_cbe__logging
+    build_log.reset(); // Flush the output of the last steps before the summary
+#endif
+
+    // Steps that succeeded are recorded even if the build failed; the others keep their last record.
+    if (std::ranges::find(step_usage_recorded, 1) != step_usage_recorded.end()) {
+        TraceScope trace("write usage log", "phase");
+        // The record is a by-product of the build; failing to keep it does not fail the build.
+        if (auto usage_log = UsageLog::load(config.usage_file); !usage_log) {
+            std::println(stderr, "{}", usage_log.error());
+        } else {
+            for (size_t s = 0; s < step_usage.size(); ++s) {
+                if (step_usage_recorded[s] != 0) {
+                    const StepView step = build_graph.step(s);
+                    usage_log->set(build_graph.node_path(step.output), build_graph.tool_name(step), step_usage[s]);
+                }
+            }
+            if (auto res = usage_log->save(config.usage_file); !res) {
+                std::println(stderr, "{}", res.error());
+            }
+        }
     }
 
-    pool.clear(); // Join all threads
+    if (interrupted) {
+        if (status_line_shown()) {
+            std::print("\n");
+        }
+        return std::unexpected("Build interrupted");
+    }
 
     if (error_occurred) {
-        if (!config.silent && is_tty && steps_completed > 0) {
+        if (status_line_shown()) {
             std::print("\n");
         }
         return std::unexpected("Build Failed");
     }
 
     if (completed_count != total_nodes) {
-        if (!config.silent && is_tty && steps_completed > 0) {
+        if (status_line_shown()) {
             std::print("\n");
         }
         return std::unexpected("Cycle detected: Build stalled with pending nodes.");
@@ -0,0 +1,189 @@
+#include "cbe/executor.hpp"
+
+#include "cbe/batch_io.hpp"
+#include "cbe/graph.hpp"
+#include "cbe/trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <optional>
+#include <print>
+#include <span>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using catalyst::BuildGraph;
+using catalyst::INVALID_ID;
+using catalyst::NodeId;
+using catalyst::RebuildCause;
+using catalyst::StatCache;
+using catalyst::StepView;
+
+namespace {
+
+/** @brief Which file set off the rebuild of a step. */
+struct Explanation {
+    NodeId input = INVALID_ID;  ///< The input named by the cause, if any.
+    uint32_t root = INVALID_ID; ///< Index of the root cause the rebuild is counted against.
+};
+
+/** @brief A file (or the manifest) whose change makes steps rebuild. */
+struct RootCause {
+    RebuildCause cause;
+    NodeId node; ///< INVALID_ID for the manifest.
+    size_t rebuilds = 0;
+};
+
+std::string formatTime(int64_t nanos) {
+    using namespace std::chrono;
+    using std::filesystem::file_time_type;
+    const file_time_type time(duration_cast<file_time_type::duration>(nanoseconds(nanos)));
+    return std::format("{:%F %T}", floor<microseconds>(file_clock::to_sys(time)));
+}
+
+/** @brief Why a path that the stat cache holds as missing could not be stat-ed. */
+std::string statError(std::string_view path) {
+    std::error_code ec;
+    static_cast<void>(std::filesystem::last_write_time(path, ec));
+    return ec ? ec.message() : "missing when the build started";
+}
+
+std::string describeRoot(const BuildGraph &graph, const RootCause &root) {
+    switch (root.cause) {
+    case RebuildCause::OUTPUT_MISSING:
+        return std::format("{} does not exist", graph.node_path(root.node));
+    case RebuildCause::MANIFEST:
+        return "the manifest changed";
+    case RebuildCause::INPUT_MISSING:
+        return std::format("{} cannot be stat-ed", graph.node_path(root.node));
+    case RebuildCause::INPUT_NEWER:
+        return std::format("{} changed", graph.node_path(root.node));
+    default:
+        return "";
+    }
+}
+
+} // namespace
+
+namespace catalyst {
+
+Result<void> Executor::explain() {
+    std::vector<NodeId> selection;
+    auto emitted = emit_selected_graph(selection);
+    if (!emitted)
+        return std::unexpected(emitted.error());
+    catalyst::BuildGraph build_graph = std::move(*emitted);
+    std::optional<catalyst::TopoLevels> levels;
+    auto ordered = selected_order(build_graph, selection, levels);
+    if (!ordered)
+        return std::unexpected(ordered.error());
+    const std::span<const NodeId> order = *ordered;
+
+    BatchIO io(config.jobs);
+    StatCache stat_cache;
+    stat_cache.prefetch(build_graph, config.build_file, io, selection);
+
+    // The causes are those of `find_dirty()`; what is left is naming the file behind each one. A step that
+    // rebuilds because an upstream step does is counted against that step's root cause, not against its own (now
+    // stale) inputs.
+    const std::vector<uint8_t> causes = find_dirty(build_graph, order, stat_cache);
+    TraceScope trace("explain", "phase");
+    std::vector<Explanation> explanations(build_graph.node_count());
+    std::vector<RootCause> roots;
+    std::vector<uint32_t> root_of_node(build_graph.node_count(), INVALID_ID);
+    uint32_t manifest_root = INVALID_ID;
+    auto root_index = [&](RebuildCause cause, NodeId node) {
+        uint32_t &index = node == INVALID_ID ? manifest_root : root_of_node[node];
+        if (index == INVALID_ID) {
+            index = static_cast<uint32_t>(roots.size());
+            roots.push_back({.cause = cause, .node = node});
+        }
+        return index;
+    };
+
+    size_t rebuilds = 0;
+    for (NodeId node : order) {
+        auto step_id = build_graph.node_step(node);
+        const auto cause = static_cast<RebuildCause>(causes[node]);
+        if (!step_id.has_value() || cause == RebuildCause::CLEAN)
+            continue;
+        const StepView step = build_graph.step(*step_id);
+        Explanation &explanation = explanations[node];
+        switch (cause) {
+        case RebuildCause::OUTPUT_MISSING:
+            explanation.root = root_index(cause, node);
+            break;
+        case RebuildCause::MANIFEST:
+            explanation.root = root_index(cause, INVALID_ID);
+            break;
+        case RebuildCause::INPUT_DIRTY:
+            build_graph.for_each_input(step, [&](NodeId input) {
+                if (explanation.input == INVALID_ID && causes[input] != 0)
+                    explanation.input = input;
+            });
+            explanation.root = explanations[explanation.input].root;
+            break;
+        case RebuildCause::INPUT_MISSING:
+        case RebuildCause::INPUT_NEWER:
+            build_graph.for_each_input(step, [&](NodeId input) {
+                if (explanation.input == INVALID_ID || stat_cache.mtime(input) > stat_cache.mtime(explanation.input))
+                    explanation.input = input;
+            });
+            explanation.root = root_index(cause, explanation.input);
+            break;
+        case RebuildCause::CLEAN:
+            break;
+        }
+        rebuilds++;
+        roots[explanation.root].rebuilds++;
+
+        const int64_t output_mtime = stat_cache.mtime(node);
+        const std::string_view output = build_graph.node_path(node);
+        switch (cause) {
+        case RebuildCause::OUTPUT_MISSING:
+            std::println("{}: output does not exist", output);
+            break;
+        case RebuildCause::MANIFEST:
+            std::println("{}: manifest {} is newer ({} >= {}); a command may have changed", output,
+                         config.build_file, formatTime(stat_cache.manifest_mtime()), formatTime(output_mtime));
+            break;
+        case RebuildCause::INPUT_DIRTY:
+            std::println("{}: input {} will be rebuilt", output, build_graph.node_path(explanation.input));
+            break;
+        case RebuildCause::INPUT_MISSING:
+            std::println("{}: cannot stat input {}: {}", output, build_graph.node_path(explanation.input),
+                         statError(build_graph.node_path(explanation.input)));
+            break;
+        case RebuildCause::INPUT_NEWER:
+            std::println("{}: input {} is newer ({} >= {})", output, build_graph.node_path(explanation.input),
+                         formatTime(stat_cache.mtime(explanation.input)), formatTime(output_mtime));
+            break;
+        case RebuildCause::CLEAN:
+            break;
+        }
+    }
+
+    if (rebuilds == 0) {
+        std::println("Nothing to rebuild.");
+        return {};
+    }
+    std::ranges::stable_sort(roots, std::greater{}, &RootCause::rebuilds);
+    constexpr size_t TUNABLE_MAX_ROOTS = 20;
+    std::println("\n{} of {} steps will rebuild. Root causes, by the rebuilds they cause:", rebuilds,
+                 build_graph.step_count());
+    for (const RootCause &root : roots | std::views::take(TUNABLE_MAX_ROOTS)) {
+        std::println("  {:>8}  {}", root.rebuilds, describeRoot(build_graph, root));
+    }
+    if (roots.size() > TUNABLE_MAX_ROOTS)
+        std::println("  ... and {} more", roots.size() - TUNABLE_MAX_ROOTS);
+    return {};
+}
+
+} // namespace catalyst
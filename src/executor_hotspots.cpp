@@ -0,0 +1,189 @@
+#include "cbe/executor.hpp"
+
+#include "cbe/file_handle.hpp"
+#include "cbe/graph.hpp"
+#include "cbe/trace.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <memory>
+#include <print>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using catalyst::BuildGraph;
+using catalyst::INVALID_ID;
+using catalyst::NodeId;
+using catalyst::StepView;
+
+namespace {
+
+/**
+ * @brief Reads how often every file changed, one `<count> <path>` line per file.
+ *
+ * That is the output of `git log --format= --name-only | sort | uniq -c`; leading blanks are skipped. Paths are
+ * looked up in the graph, lines for other files are ignored.
+ */
+catalyst::Result<std::vector<uint64_t>> loadTouches(const BuildGraph &graph, const std::string &path) {
+    std::shared_ptr<catalyst::MappedFile> file;
+    try {
+        file = std::make_shared<catalyst::MappedFile>(path);
+    } catch (const std::runtime_error &e) {
+        return std::unexpected(std::format("Cannot read touch file {}: {}", path, e.what()));
+    }
+    std::vector<uint64_t> touches(graph.node_count(), 0);
+    std::string_view content = file->content();
+    while (!content.empty()) {
+        const size_t newline = content.find('\n');
+        std::string_view line = content.substr(0, newline);
+        content.remove_prefix(newline == std::string_view::npos ? content.size() : newline + 1);
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        line.remove_prefix(std::min(line.find_first_not_of(" \t"), line.size()));
+        uint64_t count = 0;
+        auto [end, ec] = std::from_chars(line.data(), line.data() + line.size(), count);
+        if (ec != std::errc() || end == line.data() + line.size() || *end != ' ')
+            continue;
+        const NodeId node = graph.find_node(line.substr(static_cast<size_t>(end - line.data()) + 1));
+        if (node != INVALID_ID)
+            touches[node] += count;
+    }
+    return touches;
+}
+
+} // namespace
+
+namespace catalyst {
+
+Result<void> Executor::hotspots() {
+    catalyst::BuildGraph build_graph = builder.emit_graph(config.jobs);
+    auto levels = build_graph.topo_sort(config.jobs);
+    if (!levels)
+        return std::unexpected(levels.error());
+
+    // Steps are weighted by their recorded wall time, then by their work estimate, then they all count as one.
+    size_t estimated = 0;
+    auto weights = recorded_durations(build_graph, estimated);
+    if (!weights)
+        return std::unexpected(weights.error());
+    std::string weighted_by = std::format("recorded step durations ({} steps estimated)", estimated);
+    std::function<std::string(uint64_t)> format_weight = [](uint64_t us) {
+        return std::format("{:.2f}s", static_cast<double>(us) / 1e6);
+    };
+    if (weights->empty()) {
+        weights->assign(build_graph.step_count(), 1);
+        weighted_by = "step count";
+        format_weight = [](uint64_t cost) { return std::format("{}", cost); };
+#if FF_cbe__estimates
+        bool has_estimates = false;
+        for (size_t s = 0; s < build_graph.step_count(); ++s) {
+            const size_t work = estimator->getWorkEstimate(build_graph.node_path(build_graph.step(s).output));
+            (*weights)[s] = std::max<uint64_t>(work, 1);
+            has_estimates = has_estimates || work != 0;
+        }
+        if (has_estimates)
+            weighted_by = std::format("work estimates from {}", config.estimates_file);
+#endif
+    }
+
+    std::vector<uint64_t> touches;
+    if (!config.touches_file.empty()) {
+        auto loaded = loadTouches(build_graph, config.touches_file);
+        if (!loaded)
+            return std::unexpected(loaded.error());
+        touches = std::move(*loaded);
+    }
+
+    const std::vector<Hotspot> hotspots = rank_hotspots(build_graph, *weights, touches);
+
+    constexpr size_t TUNABLE_MAX_HOTSPOTS = 50;
+    std::println("Rebuild cost of a change to each of {} input files, weighted by {}:\n", hotspots.size(), weighted_by);
+    if (touches.empty()) {
+        std::println("{:>10}  {:>12}  {}", "rebuilds", "cost", "input");
+    } else {
+        std::println("{:>10}  {:>12}  {:>8}  {:>12}  {}", "rebuilds", "cost", "touches", "total", "input");
+    }
+    for (const Hotspot &hotspot : hotspots | std::views::take(TUNABLE_MAX_HOTSPOTS)) {
+        const std::string_view path = build_graph.node_path(hotspot.input);
+        if (touches.empty()) {
+            std::println("{:>10}  {:>12}  {}", hotspot.rebuilds, format_weight(hotspot.cost), path);
+        } else {
+            std::println("{:>10}  {:>12}  {:>8}  {:>12}  {}", hotspot.rebuilds, format_weight(hotspot.cost),
+                         hotspot.touches, format_weight(hotspot.cost * hotspot.touches), path);
+        }
+    }
+    if (hotspots.size() > TUNABLE_MAX_HOTSPOTS)
+        std::println("... and {} more", hotspots.size() - TUNABLE_MAX_HOTSPOTS);
+    return {};
+}
+
+std::vector<Hotspot> Executor::rank_hotspots(const BuildGraph &graph, std::span<const uint64_t> weights,
+                                             std::span<const uint64_t> touches) {
+    TraceScope trace("hotspots", "phase");
+    // The steps that read every file no step produces, depfile inputs included, as a CSR.
+    std::vector<size_t> reader_offsets(graph.node_count() + 1, 0);
+    for (size_t s = 0; s < graph.step_count(); ++s) {
+        graph.for_each_input(graph.step(s), [&](NodeId input) {
+            if (!graph.node_step(input).has_value())
+                reader_offsets[input + 1]++;
+        });
+    }
+    for (size_t i = 1; i < reader_offsets.size(); ++i) {
+        reader_offsets[i] += reader_offsets[i - 1];
+    }
+    std::vector<NodeId> readers(reader_offsets.back());
+    std::vector<size_t> fill(reader_offsets.begin(), reader_offsets.end() - 1);
+    for (size_t s = 0; s < graph.step_count(); ++s) {
+        const StepView step = graph.step(s);
+        graph.for_each_input(step, [&](NodeId input) {
+            if (!graph.node_step(input).has_value())
+                readers[fill[input]++] = step.output;
+        });
+    }
+
+    // A step reached from an input is stamped with it and not expanded again, so a link step that thousands of
+    // objects feed is counted, and walked past, once per input.
+    std::vector<NodeId> stamp(graph.node_count(), INVALID_ID);
+    std::vector<NodeId> pending;
+    std::vector<Hotspot> hotspots;
+    for (NodeId input = 0; input < graph.node_count(); ++input) {
+        if (reader_offsets[input] == reader_offsets[input + 1])
+            continue;
+        Hotspot hotspot{.input = input, .rebuilds = 0, .cost = 0, .touches = touches.empty() ? 1 : touches[input]};
+        auto reach = [&](NodeId node) {
+            if (stamp[node] == input)
+                return;
+            stamp[node] = input;
+            pending.push_back(node);
+        };
+        for (size_t r = reader_offsets[input]; r < reader_offsets[input + 1]; ++r) {
+            reach(readers[r]);
+        }
+        while (!pending.empty()) {
+            const NodeId node = pending.back();
+            pending.pop_back();
+            hotspot.rebuilds++;
+            hotspot.cost += weights[*graph.node_step(node)];
+            for (NodeId next : graph.out_edges(node)) {
+                reach(next);
+            }
+        }
+        hotspots.push_back(hotspot);
+    }
+    std::ranges::sort(hotspots, [](const Hotspot &a, const Hotspot &b) {
+        if (a.cost * a.touches != b.cost * b.touches)
+            return a.cost * a.touches > b.cost * b.touches;
+        if (a.rebuilds != b.rebuilds)
+            return a.rebuilds > b.rebuilds;
+        return a.input < b.input;
+    });
+    return hotspots;
+}
+
+} // namespace catalyst
@@ -1,40 +1,142 @@
 #include "cbe/executor.hpp"
 
+#include "cbe/trace.hpp"
+
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <limits>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CBE_HAS_AVX2_KERNEL 1
+#include <immintrin.h>
+#else
+#define CBE_HAS_AVX2_KERNEL 0
+#endif
+
+using catalyst::NodeId;
 using catalyst::StatCache;
 
-bool StatCache::Entry::operator<(const Entry &other) const {
-    return path < other.path;
+namespace {
+
+constexpr int64_t OLDEST = std::numeric_limits<int64_t>::min();
+
+int64_t toNanos(const catalyst::FileStat &stat) {
+    if (stat.ec)
+        return StatCache::MISSING;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(stat.mtime.time_since_epoch()).count();
 }
-bool StatCache::Entry::operator<(const std::filesystem::path &other_path) const {
-    return path < other_path;
+
+int64_t newestScalar(const int64_t *mtimes, std::span<const NodeId> ids) {
+    // Four independent accumulators, so the loads are not serialized behind one dependency chain.
+    int64_t m0 = OLDEST;
+    int64_t m1 = OLDEST;
+    int64_t m2 = OLDEST;
+    int64_t m3 = OLDEST;
+    size_t i = 0;
+    for (; i + 4 <= ids.size(); i += 4) {
+        m0 = std::max(m0, mtimes[ids[i]]);
+        m1 = std::max(m1, mtimes[ids[i + 1]]);
+        m2 = std::max(m2, mtimes[ids[i + 2]]);
+        m3 = std::max(m3, mtimes[ids[i + 3]]);
+    }
+    for (; i < ids.size(); ++i)
+        m0 = std::max(m0, mtimes[ids[i]]);
+    return std::max(std::max(m0, m1), std::max(m2, m3));
 }
 
-auto StatCache::get_or_update(const std::filesystem::path &p)
-    -> std::pair<std::filesystem::file_time_type, std::error_code> {
-    {
-        std::shared_lock read_lock(cache_mtx);
+#if CBE_HAS_AVX2_KERNEL
+__attribute__((target("avx2"))) int64_t newestAvx2(const int64_t *mtimes, std::span<const NodeId> ids) {
+    const auto *base = reinterpret_cast<const long long *>(mtimes);
+    __m256i best0 = _mm256_set1_epi64x(OLDEST);
+    __m256i best1 = best0;
+    size_t i = 0;
+    // Eight ids per round: two 4-lane gathers into separate accumulators. AVX2 has no 64-bit max, so it is a
+    // compare plus blend.
+    for (; i + 8 <= ids.size(); i += 8) {
+        __m128i idx0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ids.data() + i));
+        __m128i idx1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ids.data() + i + 4));
+        __m256i v0 = _mm256_i32gather_epi64(base, idx0, sizeof(int64_t));
+        __m256i v1 = _mm256_i32gather_epi64(base, idx1, sizeof(int64_t));
+        best0 = _mm256_blendv_epi8(best0, v0, _mm256_cmpgt_epi64(v0, best0));
+        best1 = _mm256_blendv_epi8(best1, v1, _mm256_cmpgt_epi64(v1, best1));
+    }
+    best0 = _mm256_blendv_epi8(best0, best1, _mm256_cmpgt_epi64(best1, best0));
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), best0);
+    int64_t best = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    return std::max(best, newestScalar(mtimes, ids.subspan(i)));
+}
 
-        auto it = std::ranges::lower_bound(cache, p, {}, &Entry::path);
+bool cpuHasAvx2() {
+    static const bool has_avx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return has_avx2;
+}
+#endif
 
-        if (it != cache.end() && it->path == p) {
-            return {it->time, it->ec};
+} // namespace
+
+void StatCache::prefetch(const BuildGraph &graph, std::string_view build_file, BatchIO &io,
+                          std::span<const NodeId> nodes) {
+    catalyst::TraceScope trace("stat files", "phase");
+    std::vector<std::string_view> paths;
+    if (nodes.empty()) {
+        paths.reserve(graph.node_count() + 1);
+        for (NodeId i = 0; i < graph.node_count(); ++i) {
+            paths.push_back(graph.node_path(i));
+        }
+    } else {
+        paths.reserve(nodes.size() + 1);
+        for (NodeId i : nodes) {
+            paths.push_back(graph.node_path(i));
         }
     }
+    paths.push_back(build_file);
 
-    std::lock_guard write_lock(cache_mtx);
-    auto it = std::ranges::lower_bound(cache, p, {}, &Entry::path);
-    std::error_code ec;
-    auto time = std::filesystem::last_write_time(p, ec);
+    std::vector<FileStat> stats(paths.size());
+    io.stat(paths, stats);
 
-    cache.insert(it, {p, time, ec}); // it is the element right below so we can add here safely
-    return {time, ec};
+    if (nodes.empty()) {
+        mtimes_.resize(graph.node_count());
+        for (NodeId i = 0; i < graph.node_count(); ++i) {
+            mtimes_[i] = toNanos(stats[i]);
+        }
+    } else {
+        mtimes_.assign(graph.node_count(), MISSING);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            mtimes_[nodes[i]] = toNanos(stats[i]);
+        }
+    }
+    manifest_mtime_ = toNanos(stats.back());
+
+    std::vector<int64_t> chunk_mtimes(graph.dep_chunk_count());
+    uint64_t hits = 0;
+    for (uint32_t c = 0; c < graph.dep_chunk_count(); ++c) {
+        chunk_mtimes[c] = newest(graph.dep_chunk(c));
+        hits += graph.dep_chunk(c).size();
+    }
+    catalyst::Stats::add(catalyst::Counter::STAT_CACHE_HITS, hits);
+    depset_mtimes_.resize(graph.depset_count());
+    for (uint32_t set = 0; set < graph.depset_count(); ++set) {
+        int64_t set_newest = OLDEST;
+        for (uint32_t chunk : graph.depset_chunks(set)) {
+            set_newest = std::max(set_newest, chunk_mtimes[chunk]);
+        }
+        depset_mtimes_[set] = set_newest;
+    }
 }
 
-bool StatCache::changed_since(const std::filesystem::path &input, std::filesystem::file_time_type output_time) {
-    auto [input_time, ec] = get_or_update(input);
-    if (ec)
-        return true; // If input missing/error, assume rebuild needed
-    return input_time >= output_time;
+int64_t StatCache::newest(std::span<const NodeId> ids) const {
+#if CBE_HAS_AVX2_KERNEL
+    // The gather takes signed 32-bit indices.
+    constexpr size_t TUNABLE_AVX2_MIN_IDS = 8;
+    if (ids.size() >= TUNABLE_AVX2_MIN_IDS && mtimes_.size() <= std::numeric_limits<int32_t>::max() && cpuHasAvx2())
+        return newestAvx2(mtimes_.data(), ids);
+#endif
+    return newestScalar(mtimes_.data(), ids);
 }
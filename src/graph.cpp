@@ -1,7 +1,10 @@
 #include "cbe/graph.hpp"
 
+#include "cbe/batch_io.hpp"
+#include "cbe/depfile.hpp"
 #include "cbe/domain.hpp"
-#include "cbe/file_handle.hpp"
+#include "cbe/stats.hpp"
+#include "cbe/trace.hpp"
 #include "cbe/utility.hpp"
 
 #include <algorithm>
@@ -9,228 +12,777 @@
 #include <cstring>
 #include <filesystem>
 #include <format>
-#include <functional>
+#include <ranges>
+#include <atomic>
+#include <barrier>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 
 namespace fs = std::filesystem;
 
 namespace catalyst {
 
-size_t BuildGraph::get_or_create_node(std::string_view path) {
-    if (auto it = index_.find(path); it != index_.end()) {
-        return it->second;
+NodeId BuildGraph::get_or_create_node(std::string_view path) {
+    NodeId id = paths_.intern(path);
+    if (id == step_of_.size()) {
+        step_of_.push_back(INVALID_ID);
     }
-
-    size_t id = nodes_.size();
-    nodes_.push_back({path, {}, std::nullopt});
-    index_.emplace(path, id);
     return id;
 }
 
-namespace {
-// Helper to skip whitespace and handle line continuations
-const char *skipWhitespace(const char *ptr, const char *end) {
-    while (ptr < end) {
-        unsigned char c = *ptr;
-        if (c > ' ' && c != '\\')
-            break;
-
-        if (c <= ' ') {
-            ptr++;
-        } else if (c == '\\') {
-            if (ptr + 1 < end && (ptr[1] == '\n' || ptr[1] == '\r')) {
-                ptr++; // skip backslash
-                if (ptr < end && *ptr == '\r')
-                    ptr++;
-                if (ptr < end && *ptr == '\n')
-                    ptr++;
+Result<size_t> BuildGraph::add_step(BuildStep step) {
+    if (finalized_) {
+        return std::unexpected(std::format("Cannot add step for {}: build graph is already finalized", step.output));
+    }
+
+    auto tool = toolFromName(step.tool);
+    RuleId rule = NO_INDEX;
+    if (!tool) {
+        auto it = std::ranges::find(rules_, step.tool, &Rule::name);
+        if (it == rules_.end()) {
+            return std::unexpected(std::format("Unknown tool '{}' for output: {}", step.tool, step.output));
+        }
+        tool = Tool::RULE;
+        rule = static_cast<RuleId>(it - rules_.begin());
+    }
+
+    NodeId out_id = get_or_create_node(step.output);
+
+    if (step_of_[out_id] != INVALID_ID) { // 2 different steps create the same file.
+        return std::unexpected(std::format("Duplicate producer for output: {}", step.output));
+    }
+
+    // Append explicit inputs, then opaque (`!` prefixed) inputs, straight into the arena.
+    auto append_inputs = [this, &step](bool opaque) -> InputRange {
+        auto offset = static_cast<uint32_t>(input_arena_.size());
+        std::string_view remaining = step.inputs;
+        // PERF: posibily faster to do with memchr
+        while (!remaining.empty()) {
+            size_t comma_pos = remaining.find(',');
+            std::string_view in_path;
+            if (comma_pos == std::string_view::npos) {
+                in_path = remaining;
+                remaining = {};
             } else {
-                break; // Escaped character, start of a filename
+                in_path = remaining.substr(0, comma_pos);
+                remaining = remaining.substr(comma_pos + 1);
             }
+
+            if (in_path.empty() || in_path.starts_with('!') != opaque)
+                continue;
+            input_arena_.push_back(get_or_create_node(opaque ? in_path.substr(1) : in_path));
         }
+        return {.offset = offset, .count = static_cast<uint32_t>(input_arena_.size() - offset)};
+    };
+
+    size_t step_id = step_tool_.size();
+    step_tool_.push_back(*tool);
+    step_rule_.push_back(rule);
+    step_output_.push_back(out_id);
+    step_inputs_.push_back(append_inputs(false));
+    step_opaque_.push_back(append_inputs(true));
+    step_of_[out_id] = static_cast<uint32_t>(step_id);
+
+    // Depfile inputs are filled in by load_depfiles(), once all steps are known.
+    step_depset_.push_back(INVALID_ID);
+
+    return step_id;
+}
+
+Result<PoolId> BuildGraph::add_pool(std::string_view name, uint32_t depth) {
+    if (std::ranges::find(pools_, name, &Pool::name) != pools_.end()) {
+        return std::unexpected(std::format("Duplicate pool: {}", name));
+    }
+    if (depth == 0) {
+        return std::unexpected(std::format("Pool {} must have a depth of at least 1", name));
+    }
+    if (pools_.size() == NO_INDEX) {
+        return std::unexpected(std::format("Too many pools, cannot add {}", name));
     }
-    return ptr;
+    pools_.push_back({.name = name, .depth = depth});
+    return static_cast<PoolId>(pools_.size() - 1);
 }
 
-// Helper to extract a single token, handling escaped spaces
-const char *extractToken(const char *ptr, const char *end, std::string_view &out_token) {
-    const char *start = ptr;
-    while (ptr < end) {
-        unsigned char c = *ptr;
-        if (c <= ' ' || c == '\\')
-            break;
-        ptr++;
+Result<RuleId> BuildGraph::add_rule(const RuleSpec &spec) {
+    if (spec.name.empty()) {
+        return std::unexpected("Rule without a name");
+    }
+    if (toolFromName(spec.name) || std::ranges::find(rules_, spec.name, &Rule::name) != rules_.end()) {
+        return std::unexpected(std::format("Duplicate rule: {}", spec.name));
+    }
+    if (rules_.size() == NO_INDEX) {
+        return std::unexpected(std::format("Too many rules, cannot add {}", spec.name));
     }
 
-    // Handle escaped characters (spaces, etc.)
-    if (ptr < end && *ptr == '\\') {
-        while (ptr < end) {
-            if (*ptr == '\\') {
-                if (ptr + 1 >= end) {
-                    ptr++; // Dangling backslash
-                    break;
-                }
-                if (ptr[1] == '\n' || ptr[1] == '\r') {
-                    break; // Line continuation means end of token
-                }
-                ptr += 2; // Skip escaped char
-            } else if (static_cast<unsigned char>(*ptr) <= ' ') {
-                break; // Unescaped whitespace ends token
+    // Depfile and response file paths are expanded per step, where only the output is known.
+    for (std::string_view pattern : {spec.depfile, spec.rsp}) {
+        for (size_t pos = pattern.find('$'); pos != std::string_view::npos; pos = pattern.find('$', pos)) {
+            std::string_view rest = pattern.substr(pos + 1);
+            if (rest.starts_with('$')) {
+                pos += 2;
+            } else if (rest.starts_with("{out}")) {
+                pos += 6;
+            } else if (rest.starts_with("out") && (rest.size() == 3 || !isVariableChar(rest[3]))) {
+                pos += 4;
             } else {
-                ptr++;
+                return std::unexpected(std::format("Rule {}: only $out can be used in '{}'", spec.name, pattern));
             }
         }
     }
 
-    out_token = std::string_view(start, ptr - start);
-    return ptr;
+    Rule rule{.name = spec.name, .command = spec.command, .depfile = spec.depfile, .rsp = spec.rsp};
+    if (!spec.pool.empty()) {
+        auto it = std::ranges::find(pools_, spec.pool, &Pool::name);
+        if (it == pools_.end()) {
+            return std::unexpected(std::format("Rule {} uses unknown pool: {}", spec.name, spec.pool));
+        }
+        rule.pool = static_cast<PoolId>(it - pools_.begin());
+    }
+    rules_.push_back(rule);
+    return static_cast<RuleId>(rules_.size() - 1);
+}
+
+Result<void> BuildGraph::add_alias(const Alias &alias) {
+    if (alias.name.empty()) {
+        return std::unexpected("Alias without a name");
+    }
+    if (std::ranges::find(aliases_, alias.name, &Alias::name) != aliases_.end()) {
+        return std::unexpected(std::format("Duplicate alias: {}", alias.name));
+    }
+    aliases_.push_back(alias);
+    return {};
 }
-} // namespace
 
-/**
- * @brief Parses a Makefile-style dependency file (.d).
- *
- * This parser handles line continuations (\) and escaped spaces.
- * It invokes the callback for each dependency found.
- *
- * @param graph The build graph (used to keep the memory mapped file alive).
- * @param path The path to the dependency file.
- * @param callback A callable that accepts a std::string_view for each dependency.
- */
-void parseDepfile(BuildGraph &graph, const std::filesystem::path &path, auto callback) {
-    if (!fs::exists(path)) {
-        return;
+Result<std::vector<NodeId>> BuildGraph::resolve_targets(std::span<const std::string> names) const {
+    std::vector<NodeId> targets;
+    std::vector<std::string_view> pending(names.begin(), names.end());
+    // Every alias is expanded once, which also ends cycles between them.
+    std::vector<uint8_t> expanded(aliases_.size(), 0);
+    while (!pending.empty()) {
+        const std::string_view name = pending.back();
+        pending.pop_back();
+        if (auto it = std::ranges::find(aliases_, name, &Alias::name); it != aliases_.end()) {
+            if (!std::exchange(expanded[it - aliases_.begin()], 1)) {
+                for (auto target : std::views::split(it->targets, ',')) {
+                    if (!target.empty())
+                        pending.emplace_back(target.begin(), target.end());
+                }
+            }
+            continue;
+        }
+        const NodeId node = find_node(name);
+        if (node == INVALID_ID) {
+            return std::unexpected(std::format("Unknown target: {}", name));
+        }
+        targets.push_back(node);
+    }
+    return targets;
+}
+
+std::vector<NodeId> BuildGraph::closure(std::span<const NodeId> targets) const {
+    std::vector<uint8_t> reached(node_count(), 0);
+    std::vector<NodeId> nodes;
+    std::vector<NodeId> stack;
+    auto reach = [&](NodeId node) {
+        if (!reached[node]) {
+            reached[node] = 1;
+            nodes.push_back(node);
+            stack.push_back(node);
+        }
+    };
+    for (NodeId target : targets) {
+        reach(target);
     }
-    auto map = std::make_shared<MappedUnfaultedFile>(path);
-    graph.add_resource(map);
-    std::string_view content = map->content();
+    while (!stack.empty()) {
+        const NodeId node = stack.back();
+        stack.pop_back();
+        if (auto step_id = node_step(node); step_id.has_value())
+            for_each_input(step(*step_id), reach);
+    }
+    std::ranges::sort(nodes);
+    return nodes;
+}
+
+bool BuildGraph::is_acyclic(std::span<const NodeId> closure) const {
+    for (NodeId node : closure) {
+        auto step_id = node_step(node);
+        if (!step_id.has_value())
+            continue;
+        bool backwards = false;
+        for_each_input(step(*step_id), [&](NodeId input) { backwards = backwards || input >= node; });
+        if (backwards)
+            return false;
+    }
+    return true;
+}
+
+void expandOutput(std::string_view pattern, std::string_view output, std::string &path) {
+    path.clear();
+    size_t pos = 0;
+    for (size_t dollar = pattern.find('$'); dollar != std::string_view::npos; dollar = pattern.find('$', pos)) {
+        path.append(pattern.substr(pos, dollar - pos));
+        std::string_view rest = pattern.substr(dollar + 1);
+        if (rest.starts_with("{out}")) {
+            path.append(output);
+            pos = dollar + 6;
+        } else if (rest.starts_with("out")) {
+            path.append(output);
+            pos = dollar + 4;
+        } else {
+            // `$$`, or a stray `$` that add_rule() would have rejected.
+            path.push_back('$');
+            pos = dollar + (rest.starts_with('$') ? 2 : 1);
+        }
+    }
+    path.append(pattern.substr(std::min(pos, pattern.size())));
+}
 
-    if (content.empty())
+bool BuildGraph::depfile_path(const StepView &step, std::string &path) const {
+    if (step.tool == Tool::CC || step.tool == Tool::CXX) {
+        path.assign(node_path(step.output)).append(".d");
+        return true;
+    }
+    if (step.tool == Tool::RULE && !rules_[step.rule].depfile.empty()) {
+        expandOutput(rules_[step.rule].depfile, node_path(step.output), path);
+        return true;
+    }
+    return false;
+}
+
+bool BuildGraph::has_depfile(uint32_t s) const {
+    return step_tool_[s] == Tool::CC || step_tool_[s] == Tool::CXX ||
+           (step_tool_[s] == Tool::RULE && !rules_[step_rule_[s]].depfile.empty());
+}
+
+void BuildGraph::load_depfiles(size_t threads, std::span<const NodeId> targets) {
+    if (finalized_)
+        return;
+
+    std::vector<uint32_t> compile_steps;
+    if (targets.empty()) {
+        for (uint32_t s = 0; s < step_tool_.size(); ++s) {
+            if (has_depfile(s) && step_depset_[s] == INVALID_ID)
+                compile_steps.push_back(s);
+        }
+        read_depfiles(compile_steps, threads);
         return;
+    }
 
-    const char *ptr = content.data();
-    const char *end = ptr + content.size();
+    // Walk back from the targets through the explicit and opaque inputs, and read the depfiles of the steps
+    // reached. A depfile can name a generated header, whose producer joins the walk for the next round.
+    std::vector<uint8_t> reached(node_count(), 0);
+    std::vector<NodeId> stack;
+    for (NodeId target : targets) {
+        if (!reached[target]) {
+            reached[target] = 1;
+            stack.push_back(target);
+        }
+    }
+    while (!stack.empty()) {
+        compile_steps.clear();
+        while (!stack.empty()) {
+            const NodeId node = stack.back();
+            stack.pop_back();
+            const uint32_t s = step_of_[node];
+            if (s == INVALID_ID)
+                continue;
+            if (has_depfile(s) && step_depset_[s] == INVALID_ID)
+                compile_steps.push_back(s);
+            for (InputRange listed : {step_inputs_[s], step_opaque_[s]}) {
+                for (NodeId input : arena_span(listed)) {
+                    if (!reached[input]) {
+                        reached[input] = 1;
+                        stack.push_back(input);
+                    }
+                }
+            }
+        }
+        read_depfiles(compile_steps, threads);
+        // Reading interns new paths, which have no producer and need no walk.
+        reached.resize(node_count(), 0);
+        for (uint32_t s : compile_steps) {
+            for_each_depfile_input(step(s), [&](NodeId input) {
+                if (!reached[input] && step_of_[input] != INVALID_ID) {
+                    reached[input] = 1;
+                    stack.push_back(input);
+                }
+            });
+        }
+    }
+}
 
-    // 1. Skip to deps, ignoring final output
-    const char *colon = static_cast<const char *>(std::memchr(ptr, ':', end - ptr));
-    if (!colon)
+void BuildGraph::read_depfiles(std::span<const uint32_t> compile_steps, size_t threads) {
+    if (compile_steps.empty())
         return;
-    ptr = colon + 1;
+    TraceScope trace("parse depfiles", "phase");
 
-    // Main parsing loop
-    while (ptr < end) {
-        ptr = skipWhitespace(ptr, end);
-        if (ptr >= end)
-            break;
+    // Dependencies are packed back to back, so a parsed depfile holds two allocations rather than a mapping.
+    struct Parsed {
+        bool found = false;
+        std::string names;
+        std::vector<uint32_t> ends;
+    };
 
-        std::string_view token;
-        ptr = extractToken(ptr, end, token);
+    // Files are stat-ed and read in batches, so I/O latency is paid once per batch rather than once per file, and
+    // the read buffers are reused from one batch to the next.
+    constexpr size_t TUNABLE_DEPFILE_BATCH = 1024;
+    constexpr size_t TUNABLE_DEPFILES_PER_THREAD = 8;
+    BatchIO io(threads);
+    std::vector<std::string_view> outputs;
+    std::vector<FileStat> output_stats;
+    std::vector<std::string> depfile_paths;
+    std::vector<std::string_view> depfile_views;
+    std::vector<uint32_t> depfile_steps;
+    std::vector<std::string> buffers;
+    std::vector<std::error_code> errors;
+    std::vector<Parsed> parsed;
+
+    // Hash-consing tables. Equal hashes are confirmed by comparing the ids.
+    std::unordered_multimap<uint64_t, uint32_t> chunk_index;
+    std::unordered_multimap<uint64_t, uint32_t> set_index;
+    auto hash_ids = [](std::span<const uint32_t> ids) {
+        return hashPath({reinterpret_cast<const char *>(ids.data()), ids.size_bytes()});
+    };
+    for (uint32_t c = 0; c < dep_chunks_.size(); ++c)
+        chunk_index.emplace(hash_ids(dep_chunk(c)), c);
+    for (uint32_t set = 0; set < depsets_.size(); ++set)
+        set_index.emplace(hash_ids(depset_chunks(set)), set);
+
+    auto intern_chunk = [&](std::span<const NodeId> ids) -> uint32_t {
+        const uint64_t h = hash_ids(ids);
+        for (auto [it, last] = chunk_index.equal_range(h); it != last; ++it) {
+            if (std::ranges::equal(dep_chunk(it->second), ids))
+                return it->second;
+        }
+        auto chunk = static_cast<uint32_t>(dep_chunks_.size());
+        dep_chunks_.push_back({.offset = static_cast<uint32_t>(input_arena_.size()),
+                               .count = static_cast<uint32_t>(ids.size())});
+        input_arena_.insert(input_arena_.end(), ids.begin(), ids.end());
+        chunk_index.emplace(h, chunk);
+        return chunk;
+    };
+    auto intern_set = [&](std::span<const uint32_t> chunks) -> uint32_t {
+        const uint64_t h = hash_ids(chunks);
+        for (auto [it, last] = set_index.equal_range(h); it != last; ++it) {
+            if (std::ranges::equal(depset_chunks(it->second), chunks))
+                return it->second;
+        }
+        auto set = static_cast<uint32_t>(depsets_.size());
+        depsets_.push_back({.offset = static_cast<uint32_t>(depset_arena_.size()),
+                            .count = static_cast<uint32_t>(chunks.size())});
+        depset_arena_.insert(depset_arena_.end(), chunks.begin(), chunks.end());
+        set_index.emplace(h, set);
+        return set;
+    };
 
-        if (!token.empty()) {
-            callback(token);
+    // A chunk ends after an id whose mixed bits say so, so adding or removing one header only changes the chunk
+    // it falls in. The cap bounds the damage of long runs without a boundary.
+    constexpr unsigned TUNABLE_DEP_CHUNK_BITS = 4; // 16 ids per chunk on average
+    constexpr size_t TUNABLE_DEP_CHUNK_MAX = 64;
+    auto is_chunk_end = [](NodeId id) { return ((id * 0x9E3779B1U) >> (32 - TUNABLE_DEP_CHUNK_BITS)) == 0; };
+    std::vector<NodeId> ids;
+    std::vector<uint32_t> chunks;
+
+    for (size_t batch = 0; batch < compile_steps.size(); batch += TUNABLE_DEPFILE_BATCH) {
+        const auto steps = compile_steps.subspan(batch, std::min(TUNABLE_DEPFILE_BATCH, compile_steps.size() - batch));
+
+        // 1. Steps whose output does not exist rebuild anyway, their dependencies don't matter.
+        outputs.clear();
+        for (uint32_t s : steps)
+            outputs.push_back(node_path(step_output_[s]));
+        output_stats.resize(outputs.size());
+        io.stat(outputs, output_stats);
+
+        // 2. Read the depfiles of the others.
+        depfile_paths.resize(steps.size());
+        depfile_views.clear();
+        depfile_steps.clear();
+        for (size_t i = 0; i < steps.size(); ++i) {
+            if (output_stats[i].ec)
+                continue;
+            depfile_path(step(steps[i]), depfile_paths[depfile_steps.size()]);
+            depfile_steps.push_back(steps[i]);
+        }
+        for (size_t i = 0; i < depfile_steps.size(); ++i)
+            depfile_views.push_back(depfile_paths[i]);
+        buffers.resize(std::max(buffers.size(), depfile_views.size()));
+        errors.resize(depfile_views.size());
+        io.read(depfile_views, std::span(buffers).first(depfile_views.size()), errors);
+
+        // 3. Parse them. This only reads the graph, so it runs on all threads.
+        parsed.assign(depfile_steps.size(), {});
+        parallelFor(depfile_steps.size(), threads, TUNABLE_DEPFILES_PER_THREAD, [&](size_t i) {
+            // An unreadable depfile is the same as a missing one: the step rebuilds.
+            if (errors[i])
+                return;
+            Parsed &result = parsed[i];
+            result.found = true;
+            parseDepfile(buffers[i], [&result](std::string_view fn) {
+                result.names.append(fn);
+                result.ends.push_back(static_cast<uint32_t>(result.names.size()));
+            });
+        });
+
+        // 4. Merging interns paths and dependency sets, which is single threaded. Only paths seen for the first
+        // time are copied into the path table.
+        for (size_t i = 0; i < depfile_steps.size(); ++i) {
+            const Parsed &result = parsed[i];
+            if (!result.found)
+                continue;
+            Stats::add(Counter::DEPFILES_READ);
+            const uint32_t s = depfile_steps[i];
+            ids.clear();
+            uint32_t begin = 0;
+            for (uint32_t end : result.ends) {
+                const std::string_view dep = std::string_view(result.names).substr(begin, end - begin);
+                NodeId id = paths_.intern_copy(dep);
+                if (id == step_of_.size())
+                    step_of_.push_back(INVALID_ID);
+                ids.push_back(id);
+                begin = end;
+            }
+
+            std::ranges::sort(ids);
+            ids.erase(std::ranges::unique(ids).begin(), ids.end());
+            // The source file itself (and anything else listed in the manifest) is already tracked.
+            for (InputRange listed : {step_inputs_[s], step_opaque_[s]}) {
+                for (NodeId id : arena_span(listed)) {
+                    if (auto it = std::ranges::lower_bound(ids, id); it != ids.end() && *it == id)
+                        ids.erase(it);
+                }
+            }
+
+            chunks.clear();
+            size_t chunk_begin = 0;
+            for (size_t k = 0; k < ids.size(); ++k) {
+                if (is_chunk_end(ids[k]) || k + 1 - chunk_begin == TUNABLE_DEP_CHUNK_MAX || k + 1 == ids.size()) {
+                    chunks.push_back(intern_chunk(std::span(ids).subspan(chunk_begin, k + 1 - chunk_begin)));
+                    chunk_begin = k + 1;
+                }
+            }
+            step_depset_[s] = intern_set(chunks);
         }
     }
 }
 
-Result<size_t> BuildGraph::add_step(BuildStep step) {
-    size_t out_id = get_or_create_node(step.output);
+void BuildGraph::finalize() {
+    if (finalized_)
+        return;
 
-    if (nodes_[out_id].step_id.has_value()) { // 2 different steps create the same file.
-        return std::unexpected(std::format("Duplicate producer for output: {}", step.output));
+    const size_t node_count = paths_.size();
+
+    // Depfile inputs only need an edge if some step produces them. Most chunks hold none of those.
+    std::vector<uint8_t> chunk_generated(dep_chunks_.size(), 0);
+    for (uint32_t c = 0; c < dep_chunks_.size(); ++c) {
+        chunk_generated[c] =
+            std::ranges::any_of(dep_chunk(c), [this](NodeId id) { return step_of_[id] != INVALID_ID; });
     }
 
-    // Populate parsed_inputs
-    std::string_view remaining = step.inputs;
-    // PERF: posibily faster to do with memchr
-    while (!remaining.empty()) {
-        size_t comma_pos = remaining.find(',');
-        std::string_view in_path;
-        if (comma_pos == std::string_view::npos) {
-            in_path = remaining;
-            remaining = {};
-        } else {
-            in_path = remaining.substr(0, comma_pos);
-            remaining = remaining.substr(comma_pos + 1);
+    // Every explicit and opaque input of a step, and every generated depfile input, is an edge into the step's
+    // output.
+    auto for_each_edge = [&](auto &&fn) {
+        for (size_t s = 0; s < step_tool_.size(); ++s) {
+            const StepView view = step(s);
+            for (auto inputs : {view.inputs, view.opaque_inputs}) {
+                for (NodeId in : inputs) {
+                    fn(in, view.output);
+                }
+            }
+            if (view.depfile_set == INVALID_ID)
+                continue;
+            for (uint32_t chunk : depset_chunks(view.depfile_set)) {
+                if (!chunk_generated[chunk])
+                    continue;
+                for (NodeId in : dep_chunk(chunk)) {
+                    if (step_of_[in] != INVALID_ID)
+                        fn(in, view.output);
+                }
+            }
         }
+    };
 
-        if (in_path.empty())
-            continue;
+    // 1. Bucket the edges by source (counting sort) into a scratch CSR.
+    std::vector<uint32_t> offsets(node_count + 1, 0);
+    for_each_edge([&](NodeId from, NodeId) { offsets[from + 1]++; });
+    for (size_t i = 0; i < node_count; ++i) {
+        offsets[i + 1] += offsets[i];
+    }
+    std::vector<NodeId> targets(offsets[node_count]);
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for_each_edge([&](NodeId from, NodeId to) { targets[cursor[from]++] = to; });
+    }
 
-        if (in_path.starts_with('!')) {
-            auto opaque_path = in_path.substr(1);
-            if (!step.opaque_inputs)
-                step.opaque_inputs.emplace();
-            step.opaque_inputs->push_back(opaque_path);
-        } else {
-            step.parsed_inputs.push_back(in_path);
+    // 2. Deduplicate each row in place and compact.
+    uint32_t write = 0;
+    for (size_t i = 0; i < node_count; ++i) {
+        auto first = targets.begin() + offsets[i];
+        auto last = targets.begin() + offsets[i + 1];
+        std::sort(first, last);
+        auto unique_end = std::unique(first, last);
+        offsets[i] = write;
+        write = static_cast<uint32_t>(std::move(first, unique_end, targets.begin() + write) - targets.begin());
+    }
+    offsets[node_count] = write;
+    targets.resize(write);
+
+    // 3. Kahn's BFS gives the new numbering; whatever is left over sits on a cycle.
+    std::vector<uint32_t> in_degree(node_count, 0);
+    for (NodeId to : targets) {
+        in_degree[to]++;
+    }
+    std::vector<NodeId> order;
+    order.reserve(node_count);
+    for (NodeId i = 0; i < node_count; ++i) {
+        if (in_degree[i] == 0)
+            order.push_back(i);
+    }
+    for (size_t head = 0; head < order.size(); ++head) {
+        NodeId u = order[head];
+        for (uint32_t e = offsets[u]; e < offsets[u + 1]; ++e) {
+            if (--in_degree[targets[e]] == 0)
+                order.push_back(targets[e]);
+        }
+    }
+    if (order.size() != node_count) {
+        for (NodeId i = 0; i < node_count; ++i) {
+            if (in_degree[i] != 0)
+                order.push_back(i);
         }
     }
 
-    size_t step_id = steps_.size();
-    steps_.push_back(step); // Store the step
-    nodes_[out_id].step_id = step_id;
+    std::vector<NodeId> new_id(node_count);
+    for (NodeId i = 0; i < node_count; ++i) {
+        new_id[order[i]] = i;
+    }
 
-    if (step.tool == "cc" || step.tool == "cxx") {
-        auto depfile_parse_callback = [this, out_id, &step = steps_.back()](std::string_view fn) {
-            size_t in_id = get_or_create_node(fn);
-            this->nodes_[in_id].out_edges.push_back(out_id);
-            if (!step.depfile_inputs)
-                step.depfile_inputs.emplace();
-            step.depfile_inputs->emplace_back(fn);
-        };
-        const fs::path depfile_path = std::format("{}.d", step.output);
-        parseDepfile(*this, depfile_path, depfile_parse_callback);
-    } else if (step.tool == "ld" || step.tool == "sld" || step.tool == "ar") {
-        // TODO: parse .rsp file
+    // 4. Emit the final CSR and node tables in the new order.
+    edge_offsets_.assign(node_count + 1, 0);
+    edges_.resize(targets.size());
+    std::vector<uint32_t> step_of(node_count);
+    uint32_t pos = 0;
+    for (NodeId i = 0; i < node_count; ++i) {
+        NodeId old = order[i];
+        step_of[i] = step_of_[old];
+        edge_offsets_[i] = pos;
+        auto row_begin = edges_.begin() + pos;
+        for (uint32_t e = offsets[old]; e < offsets[old + 1]; ++e) {
+            edges_[pos++] = new_id[targets[e]];
+        }
+        std::sort(row_begin, edges_.begin() + pos);
     }
+    edge_offsets_[node_count] = pos;
+    paths_.permute(order);
+    step_of_ = std::move(step_of);
 
-    // Iterate over parsed_inputs to add edges
-    for (const auto &in_path : step.parsed_inputs) {
-        size_t in_id = get_or_create_node(in_path);
-        nodes_[in_id].out_edges.push_back(out_id);
+    for (NodeId &id : step_output_) {
+        id = new_id[id];
+    }
+    for (NodeId &id : input_arena_) {
+        id = new_id[id];
     }
+    finalized_ = true;
+}
+
+namespace {
+// Below this many edges spinning up threads costs more than expanding the frontiers serially.
+constexpr size_t TUNABLE_PARALLEL_TOPO_MIN_EDGES = 1 << 16;
+} // namespace
+
+std::string BuildGraph::describe_cycles(std::span<const uint32_t> in_degree) const {
+    // Iterative Tarjan over the nodes Kahn's algorithm could not place.
+    const size_t n = node_count();
+    std::vector<uint32_t> index(n, INVALID_ID);
+    std::vector<uint32_t> low_link(n, 0);
+    std::vector<bool> on_stack(n, false);
+    std::vector<NodeId> scc_stack;
+    struct Frame {
+        NodeId node;
+        uint32_t next_edge;
+    };
+    std::vector<Frame> call_stack;
+    std::vector<std::vector<NodeId>> cycles;
+    uint32_t next_index = 0;
 
-    // Iterate over opaque_inputs to add edges
-    if (step.opaque_inputs) {
-        for (const auto &in_path : *step.opaque_inputs) {
-            size_t in_id = get_or_create_node(in_path);
-            nodes_[in_id].out_edges.push_back(out_id);
+    for (NodeId root = 0; root < n; ++root) {
+        if (in_degree[root] == 0 || index[root] != INVALID_ID)
+            continue;
+        call_stack.push_back({root, edge_offsets_[root]});
+        index[root] = low_link[root] = next_index++;
+        scc_stack.push_back(root);
+        on_stack[root] = true;
+
+        while (!call_stack.empty()) {
+            Frame &frame = call_stack.back();
+            const NodeId u = frame.node;
+            if (frame.next_edge < edge_offsets_[u + 1]) {
+                const NodeId v = edges_[frame.next_edge++];
+                if (in_degree[v] == 0)
+                    continue; // Only leftover nodes can be part of a cycle.
+                if (index[v] == INVALID_ID) {
+                    index[v] = low_link[v] = next_index++;
+                    scc_stack.push_back(v);
+                    on_stack[v] = true;
+                    call_stack.push_back({v, edge_offsets_[v]});
+                } else if (on_stack[v]) {
+                    low_link[u] = std::min(low_link[u], index[v]);
+                }
+                continue;
+            }
+
+            call_stack.pop_back();
+            if (!call_stack.empty()) {
+                const NodeId parent = call_stack.back().node;
+                low_link[parent] = std::min(low_link[parent], low_link[u]);
+            }
+            if (low_link[u] != index[u])
+                continue;
+
+            std::vector<NodeId> component;
+            NodeId w;
+            do {
+                w = scc_stack.back();
+                scc_stack.pop_back();
+                on_stack[w] = false;
+                component.push_back(w);
+            } while (w != u);
+
+            const auto out = out_edges(u);
+            const bool self_loop = std::ranges::binary_search(out, u);
+            if (component.size() > 1 || self_loop)
+                cycles.push_back(std::move(component));
         }
     }
 
-    return step_id;
-}
+    std::string message = std::format("{} cycle(s) detected in the build graph:", cycles.size());
+    // Shared by every cycle and reset entry by entry, so many small cycles do not clear the whole graph each.
+    std::vector<bool> in_component(n, false);
+    std::vector<uint32_t> position(n, INVALID_ID);
+    std::vector<NodeId> path;
+    for (const auto &component : cycles) {
+        // Walk successors inside the component until a node repeats to print one concrete cycle.
+        for (NodeId c : component)
+            in_component[c] = true;
+        path.clear();
+        NodeId cur = component.front();
+        while (position[cur] == INVALID_ID) {
+            position[cur] = static_cast<uint32_t>(path.size());
+            path.push_back(cur);
+            for (NodeId v : out_edges(cur)) {
+                if (in_component[v]) {
+                    cur = v;
+                    break;
+                }
+            }
+        }
+        message += "\n  ";
+        for (size_t i = position[cur]; i < path.size(); ++i) {
+            message += node_path(path[i]);
+            message += " -> ";
+        }
+        message += node_path(cur);
 
-Result<std::vector<size_t>> BuildGraph::topo_sort() const {
-    enum class STATUS : uint8_t { UNSTARTED, WORKING, FINISHED };
+        for (NodeId c : component)
+            in_component[c] = false;
+        for (NodeId p : path)
+            position[p] = INVALID_ID;
+    }
+    return message;
+}
 
-    std::vector<STATUS> status(nodes_.size(), STATUS::UNSTARTED);
-    std::vector<size_t> order;
-    order.reserve(nodes_.size());
+Result<TopoLevels> BuildGraph::topo_sort(size_t threads) const {
+    TraceScope trace("topological sort", "phase");
+    const size_t n = node_count();
+    std::vector<uint32_t> in_degree(n, 0);
+    for (NodeId to : edges_) {
+        in_degree[to]++;
+    }
 
-    std::function<Result<void>(size_t)> dfs = [&](size_t u) -> Result<void> {
-        status[u] = STATUS::WORKING;
-        for (size_t v : nodes_[u].out_edges) {
-            if (status[v] == STATUS::UNSTARTED) {
-                if (auto res = dfs(v); !res)
-                    return res;
-            } else if (status[v] == STATUS::WORKING) {
-                return std::unexpected(std::format("Cycle detected in the build graph at: {}", nodes_[v].path));
+    TopoLevels levels;
+    levels.order.reserve(n);
+    levels.level_offsets.push_back(0);
+    for (NodeId i = 0; i < n; ++i) {
+        if (in_degree[i] == 0)
+            levels.order.push_back(i);
+    }
+    levels.level_offsets.push_back(static_cast<uint32_t>(levels.order.size()));
+
+    if (threads == 0)
+        threads = std::max(1U, std::thread::hardware_concurrency());
+
+    if (threads == 1 || edges_.size() < TUNABLE_PARALLEL_TOPO_MIN_EDGES) {
+        for (size_t head = 0; head < levels.order.size();) {
+            const size_t level_end = levels.order.size();
+            for (; head < level_end; ++head) {
+                for (NodeId v : out_edges(levels.order[head])) {
+                    if (--in_degree[v] == 0)
+                        levels.order.push_back(v);
+                }
             }
+            if (levels.order.size() != level_end)
+                levels.level_offsets.push_back(static_cast<uint32_t>(levels.order.size()));
         }
-        status[u] = STATUS::FINISHED;
-        order.push_back(u);
-        return {};
-    };
+    } else {
+        // Each worker expands its slice of the current frontier into a private buffer; the barrier's
+        // completion step appends the buffers as the next level.
+        std::vector<std::atomic<uint32_t>> degree(n);
+        for (size_t i = 0; i < n; ++i) {
+            degree[i].store(in_degree[i], std::memory_order_relaxed);
+        }
+        std::vector<std::vector<NodeId>> next(threads);
+        size_t frontier_begin = 0;
+        size_t frontier_end = levels.order.size();
+        bool done = frontier_begin == frontier_end;
+
+        auto on_level_done = [&]() noexcept {
+            for (auto &buffer : next) {
+                levels.order.insert(levels.order.end(), buffer.begin(), buffer.end());
+                buffer.clear();
+            }
+            frontier_begin = frontier_end;
+            frontier_end = levels.order.size();
+            if (frontier_begin == frontier_end) {
+                done = true;
+            } else {
+                levels.level_offsets.push_back(static_cast<uint32_t>(frontier_end));
+            }
+        };
+        std::barrier sync(static_cast<std::ptrdiff_t>(threads), on_level_done);
+
+        auto expand = [&](size_t worker) {
+            while (!done) {
+                const size_t size = frontier_end - frontier_begin;
+                const size_t begin = frontier_begin + (size * worker) / threads;
+                const size_t end = frontier_begin + (size * (worker + 1)) / threads;
+                for (size_t i = begin; i < end; ++i) {
+                    for (NodeId v : out_edges(levels.order[i])) {
+                        if (degree[v].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                            next[worker].push_back(v);
+                    }
+                }
+                sync.arrive_and_wait();
+            }
+        };
 
-    for (size_t i = 0; i < nodes_.size(); ++i) {
-        if (status[i] == STATUS::UNSTARTED) {
-            if (auto res = dfs(i); !res)
-                return std::unexpected(res.error());
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(threads - 1);
+            for (size_t w = 1; w < threads; ++w) {
+                workers.emplace_back(expand, w);
+            }
+            expand(0);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            in_degree[i] = degree[i].load(std::memory_order_relaxed);
         }
     }
 
-    std::ranges::reverse(order);
-    return order;
+    if (levels.order.size() != n) {
+        return std::unexpected(describe_cycles(in_degree));
+    }
+    return levels;
 }
 
 } // namespace catalyst
@@ -3,8 +3,10 @@
 #include "cbe/binary.hpp"
 #include "cbe/builder.hpp"
 #include "cbe/file_handle.hpp"
+#include "cbe/trace.hpp"
 #include "cbe/utility.hpp"
 
+#include <charconv>
 #include <memory>
 #include <string_view>
 
@@ -30,6 +32,70 @@ Result<void> parse_def(const std::string_view line, CBEBuilder &builder) {
     return {};
 }
 
+Result<void> parse_pool(const std::string_view line, CBEBuilder &builder) {
+    size_t first_pipe = line.find('|');
+    size_t second_pipe = line.find('|', first_pipe + 1);
+    if (second_pipe == std::string_view::npos) {
+        return std::unexpected(std::format("Malformed pool line (missing second pipe): {}", line));
+    }
+
+    const std::string_view depth_text = line.substr(second_pipe + 1);
+    uint32_t depth = 0;
+    auto [end, ec] = std::from_chars(depth_text.data(), depth_text.data() + depth_text.size(), depth);
+    if (ec != std::errc() || end != depth_text.data() + depth_text.size()) {
+        return std::unexpected(std::format("Malformed pool line (depth is not a number): {}", line));
+    }
+    return builder.add_pool(line.substr(first_pipe + 1, second_pipe - (first_pipe + 1)), depth);
+}
+
+Result<void> parse_rule(const std::string_view line, CBEBuilder &builder) {
+    size_t first_pipe = line.find('|');
+    size_t second_pipe = line.find('|', first_pipe + 1);
+    if (second_pipe == std::string_view::npos) {
+        return std::unexpected(std::format("Malformed rule line (missing second pipe): {}", line));
+    }
+
+    size_t third_pipe = line.find('|', second_pipe + 1);
+    RuleSpec spec{.name = line.substr(first_pipe + 1, second_pipe - (first_pipe + 1)),
+                  .command = line.substr(second_pipe + 1, third_pipe == std::string_view::npos
+                                                              ? std::string_view::npos
+                                                              : third_pipe - (second_pipe + 1))};
+
+    // Options: comma-separated `key=value` pairs.
+    std::string_view options = third_pipe == std::string_view::npos ? std::string_view{} : line.substr(third_pipe + 1);
+    while (!options.empty()) {
+        size_t comma = options.find(',');
+        std::string_view option = options.substr(0, comma);
+        options = comma == std::string_view::npos ? std::string_view{} : options.substr(comma + 1);
+        if (option.empty())
+            continue;
+
+        size_t eq = option.find('=');
+        std::string_view key = option.substr(0, eq);
+        std::string_view value = eq == std::string_view::npos ? std::string_view{} : option.substr(eq + 1);
+        if (key == "depfile") {
+            spec.depfile = value;
+        } else if (key == "rsp") {
+            spec.rsp = value;
+        } else if (key == "pool") {
+            spec.pool = value;
+        } else {
+            return std::unexpected(std::format("Unknown rule option '{}': {}", key, line));
+        }
+    }
+    return builder.add_rule(spec);
+}
+
+Result<void> parse_alias(const std::string_view line, CBEBuilder &builder) {
+    size_t first_pipe = line.find('|');
+    size_t second_pipe = line.find('|', first_pipe + 1);
+    if (second_pipe == std::string_view::npos) {
+        return std::unexpected(std::format("Malformed alias line (missing second pipe): {}", line));
+    }
+    return builder.add_alias({.name = line.substr(first_pipe + 1, second_pipe - (first_pipe + 1)),
+                              .targets = line.substr(second_pipe + 1)});
+}
+
 Result<void> parse_step(const std::string_view line, CBEBuilder &builder) {
     size_t first_pipe = line.find('|');
     if (first_pipe == std::string_view::npos) {
@@ -42,9 +108,7 @@ Result<void> parse_step(const std::string_view line, CBEBuilder &builder) {
     }
     Result<void> res = builder.add_step({.tool = line.substr(0, first_pipe),
                                          .inputs = line.substr(first_pipe + 1, second_pipe - (first_pipe + 1)),
-                                         .output = line.substr(second_pipe + 1),
-                                         .depfile_inputs = std::nullopt,
-                                         .parsed_inputs = {}});
+                                         .output = line.substr(second_pipe + 1)});
     if (!res) {
         return std::unexpected(res.error());
     }
@@ -57,9 +121,14 @@ Result<void> parse(CBEBuilder &builder, const std::filesystem::path &path) {
 #if FF_cbe__binary == 1
     if (std::filesystem::exists(".catalyst.bin") &&
         std::filesystem::last_write_time(".catalyst.bin") > std::filesystem::last_write_time(path)) {
-        return parse_bin(builder);
+        TraceScope trace("load binary manifest", "phase");
+        // A cache that cannot be used, e.g. one written by another version, is rebuilt from the manifest. Every
+        // check that rejects it comes before anything is loaded.
+        if (auto res = parse_bin(builder); res)
+            return res;
     }
 #endif
+    TraceScope trace("parse manifest", "phase");
     std::string_view content;
     try {
         auto file = std::make_shared<MappedFile>(path);
@@ -90,6 +159,18 @@ Result<void> parse(CBEBuilder &builder, const std::filesystem::path &path) {
                 auto res = parse_def(line, builder);
                 if (!res)
                     return res;
+            } else if (line.starts_with("RULE|")) {
+                auto res = parse_rule(line, builder);
+                if (!res)
+                    return res;
+            } else if (line.starts_with("POOL|")) {
+                auto res = parse_pool(line, builder);
+                if (!res)
+                    return res;
+            } else if (line.starts_with("ALIAS|")) {
+                auto res = parse_alias(line, builder);
+                if (!res)
+                    return res;
             } else {
                 auto res = parse_step(line, builder);
                 if (!res)
@@ -99,6 +180,10 @@ Result<void> parse(CBEBuilder &builder, const std::filesystem::path &path) {
 
         start = end + 1;
     }
+
+    // Rule commands are compiled once here, and stored compiled in the binary cache.
+    if (auto res = builder.compile_templates(); !res)
+        return res;
 #if FF_cbe__binary
     auto _ = emit_bin(builder);
 #endif
@@ -0,0 +1,244 @@
+#include "cbe/path_table.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace catalyst {
+
+namespace {
+
+constexpr uint64_t HASH_P0 = 0xa0761d6478bd642fULL;
+constexpr uint64_t HASH_P1 = 0xe7037ed1a0b428dbULL;
+constexpr uint64_t HASH_P2 = 0x8ebc6af09c88c6e3ULL;
+constexpr uint64_t HASH_P3 = 0x589965cc75374cc3ULL;
+
+inline uint64_t read64(const char *p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32(const char *p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// 64x64 -> 128 multiply, folded back to 64 bits.
+inline uint64_t mix(uint64_t a, uint64_t b) {
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+constexpr size_t MIN_CAPACITY = 64;
+
+// True if `path` has an empty, `.` or `..` component, or a trailing separator.
+bool needsCanonicalization(std::string_view path) {
+    const size_t n = path.size();
+    size_t comp_start = 0;
+    for (size_t i = 0; i <= n; ++i) {
+        if (i != n && path[i] != '/')
+            continue;
+        size_t len = i - comp_start;
+        if (len == 0) {
+            // Empty component from "//" or a trailing "/". A leading "/" is the root and is fine.
+            if (i != 0)
+                return true;
+        } else if (path[comp_start] == '.' && (len == 1 || (len == 2 && path[comp_start + 1] == '.'))) {
+            return true;
+        }
+        comp_start = i + 1;
+    }
+    return false;
+}
+
+} // namespace
+
+uint64_t hashPath(std::string_view path) {
+    const char *p = path.data();
+    size_t n = path.size();
+    uint64_t seed = HASH_P0 ^ mix(HASH_P0 ^ n, HASH_P1);
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    if (n <= 16) {
+        if (n >= 4) {
+            const size_t shift = (n >> 3) << 2;
+            a = (read32(p) << 32) | read32(p + shift);
+            b = (read32(p + n - 4) << 32) | read32(p + n - 4 - shift);
+        } else if (n > 0) {
+            a = (static_cast<uint64_t>(static_cast<unsigned char>(p[0])) << 16) |
+                (static_cast<uint64_t>(static_cast<unsigned char>(p[n >> 1])) << 8) |
+                static_cast<uint64_t>(static_cast<unsigned char>(p[n - 1]));
+        }
+    } else {
+        size_t i = n;
+        if (i > 48) {
+            uint64_t lane1 = seed;
+            uint64_t lane2 = seed;
+            do {
+                seed = mix(read64(p) ^ HASH_P1, read64(p + 8) ^ seed);
+                lane1 = mix(read64(p + 16) ^ HASH_P2, read64(p + 24) ^ lane1);
+                lane2 = mix(read64(p + 32) ^ HASH_P3, read64(p + 40) ^ lane2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= lane1 ^ lane2;
+        }
+        while (i > 16) {
+            seed = mix(read64(p) ^ HASH_P1, read64(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    return mix(HASH_P1 ^ n, mix(a ^ HASH_P1, b ^ seed));
+}
+
+std::string_view canonicalizePath(std::string_view path, std::string &scratch) {
+    if (!needsCanonicalization(path))
+        return path;
+
+    const bool absolute = path.starts_with('/');
+    scratch.clear();
+    if (absolute)
+        scratch.push_back('/');
+    // Length of the leading run of ".." components, which can't be folded further.
+    size_t parent_prefix = scratch.size();
+
+    size_t pos = 0;
+    while (pos <= path.size()) {
+        size_t next = path.find('/', pos);
+        if (next == std::string_view::npos)
+            next = path.size();
+        std::string_view comp = path.substr(pos, next - pos);
+        pos = next + 1;
+
+        if (comp.empty() || comp == ".")
+            continue;
+        if (comp == "..") {
+            if (scratch.size() > parent_prefix) {
+                // Drop the last component (and its separator).
+                size_t cut = scratch.rfind('/');
+                if (cut == std::string::npos || cut < parent_prefix)
+                    cut = parent_prefix;
+                scratch.resize(cut);
+                if (scratch.size() > parent_prefix && scratch.back() == '/')
+                    scratch.pop_back();
+                continue;
+            }
+            if (absolute)
+                continue; // "/.." is "/"
+            if (!scratch.empty())
+                scratch.push_back('/');
+            scratch.append("..");
+            parent_prefix = scratch.size();
+            continue;
+        }
+        if (!scratch.empty() && scratch.back() != '/')
+            scratch.push_back('/');
+        scratch.append(comp);
+    }
+
+    if (scratch.empty())
+        scratch.push_back('.');
+    return scratch;
+}
+
+uint32_t PathTable::intern(std::string_view path) {
+    std::string scratch;
+    std::string_view canonical = canonicalizePath(path, scratch);
+    const uint64_t h = hashPath(canonical);
+    if (uint32_t id = find_canonical(canonical, h); id != NOT_FOUND)
+        return id;
+    if (canonical.data() == scratch.data())
+        canonical = arena_.copy(canonical);
+    return insert_new(canonical, h);
+}
+
+uint32_t PathTable::intern_copy(std::string_view path) {
+    std::string scratch;
+    std::string_view canonical = canonicalizePath(path, scratch);
+    const uint64_t h = hashPath(canonical);
+    if (uint32_t id = find_canonical(canonical, h); id != NOT_FOUND)
+        return id;
+    return insert_new(arena_.copy(canonical), h);
+}
+
+uint32_t PathTable::find(std::string_view path) const {
+    std::string scratch;
+    std::string_view canonical = canonicalizePath(path, scratch);
+    return find_canonical(canonical, hashPath(canonical));
+}
+
+uint32_t PathTable::adopt(std::string_view canonical_path, uint64_t hash) {
+    return insert_new(canonical_path, hash);
+}
+
+uint32_t PathTable::find_canonical(std::string_view path, uint64_t hash) const {
+    if (slots_.empty())
+        return NOT_FOUND;
+    const size_t mask = slots_.size() - 1;
+    const auto tag = static_cast<uint32_t>(hash >> 32);
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Slot &slot = slots_[i];
+        if (slot.id == NOT_FOUND)
+            return NOT_FOUND;
+        if (slot.tag == tag && keys_[slot.id] == path)
+            return slot.id;
+    }
+}
+
+uint32_t PathTable::insert_new(std::string_view path, uint64_t hash) {
+    // Keep the load factor at or below 1/2 so probe runs stay short.
+    if ((keys_.size() + 1) * 2 > slots_.size())
+        rehash(std::max(MIN_CAPACITY, slots_.size() * 2));
+    auto id = static_cast<uint32_t>(keys_.size());
+    keys_.push_back(path);
+    hashes_.push_back(hash);
+    place(id);
+    return id;
+}
+
+void PathTable::place(uint32_t id) {
+    const size_t mask = slots_.size() - 1;
+    const uint64_t h = hashes_[id];
+    size_t i = h & mask;
+    while (slots_[i].id != NOT_FOUND)
+        i = (i + 1) & mask;
+    slots_[i] = {.tag = static_cast<uint32_t>(h >> 32), .id = id};
+}
+
+void PathTable::rehash(size_t capacity) {
+    slots_.assign(std::bit_ceil(capacity), Slot{});
+    for (uint32_t id = 0; id < keys_.size(); ++id)
+        place(id);
+}
+
+void PathTable::reserve(size_t count) {
+    keys_.reserve(count);
+    hashes_.reserve(count);
+    if (count * 2 > slots_.size())
+        rehash(std::max(MIN_CAPACITY, count * 2));
+}
+
+void PathTable::permute(std::span<const uint32_t> order) {
+    std::vector<std::string_view> keys(keys_.size());
+    std::vector<uint64_t> hashes(hashes_.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        keys[i] = keys_[order[i]];
+        hashes[i] = hashes_[order[i]];
+    }
+    keys_ = std::move(keys);
+    hashes_ = std::move(hashes);
+    rehash(slots_.size());
+}
+
+} // namespace catalyst
@@ -1,28 +1,55 @@
 #include "cbe/process_exec.hpp"
 
+#include "cbe/stats.hpp"
+#include "cbe/trace.hpp"
 #include "cbe/utility.hpp"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <expected>
+#include <format>
 #include <future>
+#include <limits>
+#include <mutex>
 #include <optional>
-#include <reproc++/run.hpp>
+#include <span>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
-namespace catalyst {
-Result<std::pair<int, std::string>> process_exec(std::vector<std::string> &&args,
-                         std::optional<std::string> working_dir,
-                         std::optional<std::unordered_map<std::string, std::string>> env,
-                         bool capture_output) {
-    if (args.empty()) {
-        return std::unexpected("Cannot execute empty command");
-    }
+#ifdef _WIN32
+#include <reproc++/arguments.hpp>
+#include <reproc++/run.hpp>
+#else
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ; // NOLINT(readability-redundant-declaration)
+#endif
+
+namespace {
+using catalyst::Counter;
+using catalyst::Result;
+using catalyst::Stats;
+using catalyst::Trace;
 
+#ifdef _WIN32
+Result<int> run(const reproc::arguments &args, std::optional<std::string> working_dir,
+                std::optional<std::unordered_map<std::string, std::string>> env, catalyst::OutputCapture *capture) {
     reproc::options options;
-    std::string captured;
-    if (capture_output) {
+    if (capture != nullptr) {
         options.redirect.out.type = reproc::redirect::pipe;
         options.redirect.err.type = reproc::redirect::pipe;
     } else {
@@ -50,15 +77,309 @@ Result<std::pair<int, std::string>> process_exec(std::vector<std::string> &&args
 
     int status = 0;
     std::error_code ec;
-    if (capture_output) {
-        reproc::sink::string sink(captured);
+    if (capture != nullptr) {
+        auto sink = [capture](reproc::stream, const uint8_t *buffer, size_t size) {
+            capture->append(std::string_view(reinterpret_cast<const char *>(buffer), size));
+            return std::error_code();
+        };
         std::tie(status, ec) = reproc::run(args, options, sink, sink);
     } else {
         std::tie(status, ec) = reproc::run(args, options);
     }
 
     if (ec)
-        return std::pair<int, std::string>{-1, captured};
-    return std::pair<int, std::string>{status, captured};
+        return -1;
+    return status;
+}
+#else
+/**
+ * Spawns with posix_spawn rather than fork, so a large parent address space is not copied, and puts the child in a
+ * process group of its own when it is tracked, so the group can be signalled as a whole.
+ */
+Result<int> run(std::span<const char *const> argv, std::optional<std::string> working_dir,
+                std::optional<std::unordered_map<std::string, std::string>> env, catalyst::OutputCapture *capture,
+                catalyst::RunningProcesses *running, catalyst::ProcessUsage *usage) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attr);
+
+    std::array<int, 2> out_pipe = {-1, -1};
+    if (capture != nullptr) {
+        // Close-on-exec from the start: a step spawned by another worker in between would otherwise inherit the
+        // write end, and reading this step's output would wait for that one to exit.
+#ifdef __APPLE__
+        const int pipe_result = ::pipe(out_pipe.data());
+        if (pipe_result == 0) {
+            ::fcntl(out_pipe[0], F_SETFD, FD_CLOEXEC);
+            ::fcntl(out_pipe[1], F_SETFD, FD_CLOEXEC);
+        }
+#else
+        const int pipe_result = ::pipe2(out_pipe.data(), O_CLOEXEC);
+#endif
+        if (pipe_result != 0) {
+            posix_spawn_file_actions_destroy(&actions);
+            posix_spawnattr_destroy(&attr);
+            return std::unexpected(std::format("Failed to create a pipe: {}", std::strerror(errno)));
+        }
+        posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDERR_FILENO);
+    }
+    // A child in a process group of its own is in the terminal's background, where reading the terminal stops it.
+    if (running != nullptr) {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+    if (working_dir) {
+        posix_spawn_file_actions_addchdir_np(&actions, working_dir->c_str());
+    }
+
+    // The executor blocks the termination signals in its threads; the child gets a clean mask and default handlers.
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTERM);
+    sigaddset(&defaults, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    if (running != nullptr) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, 0);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    std::vector<std::string> env_strings;
+    std::vector<char *> env_ptrs;
+    char **envp = environ;
+    if (env) {
+        for (char **var = environ; *var != nullptr; ++var) {
+            std::string_view entry = *var;
+            if (!env->contains(std::string(entry.substr(0, entry.find('=')))))
+                env_ptrs.push_back(*var);
+        }
+        for (const auto &[key, value] : *env) {
+            env_strings.push_back(key + "=" + value);
+        }
+        for (auto &s : env_strings) {
+            env_ptrs.push_back(s.data());
+        }
+        env_ptrs.push_back(nullptr);
+        envp = env_ptrs.data();
+    }
+
+    pid_t pid = 0;
+    const auto spawn_begin = Trace::Clock::now();
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast): posix_spawn does not modify the arguments.
+    const int rc = posix_spawnp(&pid, argv[0], &actions, &attr, const_cast<char *const *>(argv.data()), envp);
+    const auto spawn_end = Trace::Clock::now();
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (capture != nullptr)
+        ::close(out_pipe[1]);
+    if (rc != 0) {
+        if (capture != nullptr)
+            ::close(out_pipe[0]);
+        return std::unexpected(std::format("Failed to start {}: {}", argv[0], std::strerror(rc)));
+    }
+    if (running != nullptr && !running->add(pid))
+        ::kill(-pid, SIGKILL);
+
+    if (capture != nullptr) {
+        constexpr size_t TUNABLE_PIPE_CHUNK = 64 * 1024;
+        std::array<char, TUNABLE_PIPE_CHUNK> buffer;
+        while (true) {
+            const ssize_t n = ::read(out_pipe[0], buffer.data(), buffer.size());
+            if (n > 0) {
+                capture->append(std::string_view(buffer.data(), static_cast<size_t>(n)));
+            } else if (n == 0 || errno != EINTR) {
+                break;
+            }
+        }
+        ::close(out_pipe[0]);
+    }
+
+    // Wait without reaping first: until the child is reaped its pid (and process group id) cannot be reused, so
+    // `cancel()` never signals a stranger.
+    siginfo_t info{};
+    while (::waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT) != 0 && errno == EINTR) {
+    }
+    if (running != nullptr)
+        running->remove(pid);
+    int status = 0;
+    rusage resources{};
+    while (::wait4(pid, &status, 0, &resources) < 0 && errno == EINTR) {
+    }
+    if (usage != nullptr) {
+        auto micros = [](const timeval &time) {
+            return static_cast<uint64_t>(time.tv_sec) * 1'000'000 + static_cast<uint64_t>(time.tv_usec);
+        };
+        usage->user_us = micros(resources.ru_utime);
+        usage->sys_us = micros(resources.ru_stime);
+#ifdef __APPLE__
+        usage->max_rss_kib = static_cast<uint64_t>(resources.ru_maxrss) / 1024; // Bytes on macOS.
+#else
+        usage->max_rss_kib = static_cast<uint64_t>(resources.ru_maxrss);
+#endif
+        usage->read_blocks = static_cast<uint64_t>(resources.ru_inblock);
+        usage->write_blocks = static_cast<uint64_t>(resources.ru_oublock);
+    }
+
+    const auto spawn_time = std::chrono::duration_cast<std::chrono::nanoseconds>(spawn_end - spawn_begin).count();
+    static const Stats::HistogramId spawn_histogram = Stats::histogram("spawn latency", "us");
+    Stats::add(Counter::SPAWNS);
+    Stats::add(Counter::SPAWN_NS, static_cast<uint64_t>(spawn_time));
+    Stats::record(spawn_histogram, static_cast<uint64_t>(spawn_time / 1000));
+    if (Trace::enabled()) {
+        Trace::complete("spawn", "process", spawn_begin, spawn_end);
+        Trace::complete("run", "process", spawn_end, Trace::Clock::now());
+    }
+
+    int exit_code = -1;
+    if (WIFEXITED(status)) {
+        exit_code = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        exit_code = 128 + WTERMSIG(status);
+    }
+    return exit_code;
+}
+#endif
+} // namespace
+
+namespace catalyst {
+
+void RunningProcesses::cancel(std::chrono::milliseconds grace) {
+    cancelled_.store(true, std::memory_order_release);
+#ifndef _WIN32
+    {
+        std::lock_guard lock(mutex_);
+        for (int pid : pids_) {
+            ::kill(-pid, SIGTERM);
+        }
+    }
+
+    constexpr auto TUNABLE_CANCEL_POLL = std::chrono::milliseconds(10);
+    const auto deadline = std::chrono::steady_clock::now() + grace;
+    while (std::chrono::steady_clock::now() < deadline) {
+        {
+            std::lock_guard lock(mutex_);
+            if (pids_.empty())
+                return;
+        }
+        std::this_thread::sleep_for(TUNABLE_CANCEL_POLL);
+    }
+
+    std::lock_guard lock(mutex_);
+    for (int pid : pids_) {
+        ::kill(-pid, SIGKILL);
+    }
+#else
+    (void)grace;
+#endif
+}
+
+bool RunningProcesses::add(int pid) {
+    std::lock_guard lock(mutex_);
+    pids_.push_back(pid);
+    return !cancelled();
+}
+
+void RunningProcesses::remove(int pid) {
+    std::lock_guard lock(mutex_);
+    std::erase(pids_, pid);
+}
+
+void OutputCapture::append(std::string_view data) {
+    if (data.empty())
+        return;
+    size_ += data.size();
+    last_ = data.back();
+    if (spill_ == nullptr && memory_.size() + data.size() <= memory_limit_) {
+        memory_.append(data);
+        return;
+    }
+    if (spill_ == nullptr) {
+        spill_ = std::tmpfile();
+        if (spill_ == nullptr) {
+            // Without a temporary file, keep what fits and drop the rest rather than fail the step.
+            memory_.append(data.substr(0, memory_limit_ - memory_.size()));
+            size_ = memory_.size();
+            return;
+        }
+    }
+    std::fwrite(data.data(), 1, data.size(), spill_);
+}
+
+void OutputCapture::clear() {
+    if (spill_ != nullptr) {
+        std::fclose(spill_);
+        spill_ = nullptr;
+    }
+    memory_.clear();
+    size_ = 0;
+    last_ = '\0';
+}
+
+void OutputCapture::write_to(std::ostream &out) const {
+    out.write(memory_.data(), static_cast<std::streamsize>(memory_.size()));
+    if (spill_ == nullptr)
+        return;
+    std::fflush(spill_);
+    std::rewind(spill_);
+    constexpr size_t TUNABLE_SPILL_CHUNK = 64 * 1024;
+    std::array<char, TUNABLE_SPILL_CHUNK> buffer;
+    while (true) {
+        const size_t n = std::fread(buffer.data(), 1, buffer.size(), spill_);
+        if (n == 0)
+            break;
+        out.write(buffer.data(), static_cast<std::streamsize>(n));
+    }
+    std::fseek(spill_, 0, SEEK_END);
+}
+
+std::string OutputCapture::str() const {
+    std::ostringstream out;
+    write_to(out);
+    return std::move(out).str();
+}
+
+Result<std::pair<int, std::string>> process_exec(std::vector<std::string> &&args,
+                         std::optional<std::string> working_dir,
+                         std::optional<std::unordered_map<std::string, std::string>> env,
+                         bool capture_output) {
+    if (args.empty()) {
+        return std::unexpected("Cannot execute empty command");
+    }
+    std::vector<const char *> argv;
+    argv.reserve(args.size() + 1);
+    for (const std::string &arg : args) {
+        argv.push_back(arg.c_str());
+    }
+    argv.push_back(nullptr);
+    OutputCapture capture(std::numeric_limits<size_t>::max());
+    auto res = process_exec(std::span(argv.data(), args.size()), std::move(working_dir), std::move(env),
+                            capture_output ? &capture : nullptr);
+    if (!res)
+        return std::unexpected(res.error());
+    return std::pair<int, std::string>{*res, capture.str()};
+}
+
+Result<int> process_exec(std::span<const char *const> argv, std::optional<std::string> working_dir,
+                         std::optional<std::unordered_map<std::string, std::string>> env, OutputCapture *capture,
+                         RunningProcesses *running, ProcessUsage *usage) {
+    if (argv.empty()) {
+        return std::unexpected("Cannot execute empty command");
+    }
+#ifdef _WIN32
+    if (running != nullptr && running->cancelled()) {
+        return -1;
+    }
+    static_cast<void>(usage); // reproc does not report what the child used.
+    // reproc takes a null-terminated argv as is, without copying it.
+    return run(argv.data(), std::move(working_dir), std::move(env), capture);
+#else
+    return run(argv, std::move(working_dir), std::move(env), capture, running, usage);
+#endif
 }
 } // namespace catalyst
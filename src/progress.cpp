@@ -0,0 +1,162 @@
+#include "cbe/progress.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <format>
+#include <iterator>
+#include <string_view>
+
+#ifndef _WIN32
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace catalyst {
+
+namespace {
+void appendDuration(std::string &out, std::chrono::seconds duration) {
+    const auto total = duration.count();
+    if (total >= 3600) {
+        std::format_to(std::back_inserter(out), "{}:{:02}:{:02}", total / 3600, (total / 60) % 60, total % 60);
+    } else {
+        std::format_to(std::back_inserter(out), "{}:{:02}", total / 60, total % 60);
+    }
+}
+} // namespace
+
+Progress::Progress(const BuildGraph &graph, std::span<const uint64_t> step_work, size_t steps_to_build,
+                   ProgressMode mode, std::mutex &console_mutex)
+    : graph_(graph), step_work_(step_work), steps_to_build_(steps_to_build), mode_(mode),
+      console_mutex_(console_mutex), ring_(std::make_unique<Slot[]>(TUNABLE_RING_CAPACITY)) {
+    for (uint64_t work : step_work_) {
+        total_work_ += work;
+    }
+    for (size_t i = 0; i < TUNABLE_RING_CAPACITY; ++i) {
+        ring_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+#ifndef _WIN32
+    winsize size{};
+    if (mode_ == ProgressMode::STATUS_LINE && ::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0)
+        terminal_width_ = size.ws_col;
+#endif
+}
+
+void Progress::start() {
+    start_time_ = std::chrono::steady_clock::now();
+    if (mode_ == ProgressMode::SILENT || thread_.joinable())
+        return;
+    thread_ = std::thread([this] { run(); });
+}
+
+void Progress::stop() {
+    if (!thread_.joinable())
+        return;
+    {
+        std::lock_guard lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void Progress::push(uint32_t step) {
+    // Bounded multi-producer ring: a producer claims a position, then publishes the slot through its sequence.
+    constexpr uint64_t MASK = TUNABLE_RING_CAPACITY - 1;
+    static_assert((TUNABLE_RING_CAPACITY & MASK) == 0, "the ring capacity must be a power of two");
+    uint64_t position = ring_tail_.load(std::memory_order_relaxed);
+    while (true) {
+        Slot &slot = ring_[position & MASK];
+        const auto lag = static_cast<int64_t>(slot.sequence.load(std::memory_order_acquire) - position);
+        if (lag == 0) {
+            if (ring_tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.step = step;
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return;
+            }
+        } else if (lag < 0) {
+            // Full: the renderer is a whole ring behind, and it must not lose lines.
+            std::this_thread::yield();
+            position = ring_tail_.load(std::memory_order_relaxed);
+        } else {
+            position = ring_tail_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Progress::pop(uint32_t &step) {
+    Slot &slot = ring_[ring_head_ & (TUNABLE_RING_CAPACITY - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != ring_head_ + 1)
+        return false;
+    step = slot.step;
+    slot.sequence.store(ring_head_ + TUNABLE_RING_CAPACITY, std::memory_order_release);
+    ++ring_head_;
+    return true;
+}
+
+void Progress::run() {
+    std::unique_lock lock(wake_mutex_);
+    while (true) {
+        const bool stopping = wake_.wait_for(lock, TUNABLE_FRAME_INTERVAL, [this] { return stopping_; });
+        render();
+        if (stopping)
+            return;
+    }
+}
+
+void Progress::render() {
+    frame_.clear();
+    if (mode_ == ProgressMode::STATUS_LINE) {
+        if (started_.load(std::memory_order_acquire) == 0)
+            return;
+        draw_status_line();
+    } else {
+        uint32_t step_id = 0;
+        while (pop(step_id)) {
+            const StepView step = graph_.step(step_id);
+            const std::string_view tool = graph_.tool_name(step);
+            const std::string_view output = graph_.node_path(step.output);
+            if (mode_ == ProgressMode::DRY_RUN) {
+                std::format_to(std::back_inserter(frame_), "[DRY RUN] {} -> {}\n", tool, output);
+            } else {
+                std::format_to(std::back_inserter(frame_), "[{}/{}] {:>3} -> {}\n", ++lines_printed_,
+                               steps_to_build_, tool, output);
+            }
+        }
+    }
+    if (frame_.empty())
+        return;
+    std::lock_guard lock(console_mutex_);
+    std::fwrite(frame_.data(), 1, frame_.size(), stdout);
+    std::fflush(stdout);
+}
+
+void Progress::draw_status_line() {
+    const size_t finished = finished_.load(std::memory_order_relaxed);
+    const size_t running = started_.load(std::memory_order_relaxed) - finished;
+    const uint64_t work_done = work_done_.load(std::memory_order_relaxed);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time_;
+
+    frame_ = "\r\033[K";
+    const size_t visible_start = frame_.size();
+    std::format_to(std::back_inserter(frame_), "[{}/{}] {} running", finished, steps_to_build_, running);
+    if (elapsed.count() > 0) {
+        std::format_to(std::back_inserter(frame_), ", {:.1f}/s", static_cast<double>(finished) / elapsed.count());
+    }
+    frame_ += ", ETA ";
+    if (work_done > 0 && total_work_ >= work_done) {
+        const double remaining = elapsed.count() * static_cast<double>(total_work_ - work_done) /
+                                 static_cast<double>(work_done);
+        appendDuration(frame_, std::chrono::seconds(static_cast<int64_t>(remaining + 0.5)));
+    } else {
+        frame_ += "--";
+    }
+
+    const StepView step = graph_.step(last_started_.load(std::memory_order_relaxed));
+    std::format_to(std::back_inserter(frame_), " | {:>3} -> {}", graph_.tool_name(step),
+                   graph_.node_path(step.output));
+    // A line wider than the terminal wraps, and `\r` would then only return to the start of its last row.
+    if (terminal_width_ > 0 && frame_.size() - visible_start >= terminal_width_)
+        frame_.resize(visible_start + terminal_width_ - 1);
+}
+
+} // namespace catalyst
@@ -0,0 +1,141 @@
+#include "cbe/simulator.hpp"
+
+#include "cbe/domain.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <ranges>
+#include <utility>
+
+namespace catalyst {
+
+BuildSimulator::BuildSimulator(const BuildGraph &graph, std::span<const NodeId> order,
+                               std::span<const uint64_t> durations_us)
+    : graph_(graph), durations_(graph.node_count(), 0), bottom_level_(graph.node_count(), 0),
+      in_degrees_(graph.node_count(), 0) {
+    for (size_t s = 0; s < graph.step_count(); ++s) {
+        durations_[graph.step(s).output] = durations_us[s];
+        total_work_us_ += durations_us[s];
+    }
+    for (NodeId node = 0; node < graph.node_count(); ++node) {
+        for (NodeId next : graph.out_edges(node)) {
+            in_degrees_[next]++;
+        }
+    }
+
+    // Bottom levels, from the end of the build backwards; the critical path follows the largest ones.
+    NodeId start = INVALID_ID;
+    for (NodeId node : std::views::reverse(order)) {
+        uint64_t longest_after = 0;
+        for (NodeId next : graph.out_edges(node)) {
+            longest_after = std::max(longest_after, bottom_level_[next]);
+        }
+        bottom_level_[node] = durations_[node] + longest_after;
+        if (start == INVALID_ID || bottom_level_[node] > bottom_level_[start])
+            start = node;
+    }
+    if (start == INVALID_ID)
+        return;
+    critical_path_us_ = bottom_level_[start];
+    for (NodeId node = start;;) {
+        if (graph.node_step(node).has_value())
+            critical_path_.push_back(node);
+        auto next = std::ranges::max_element(graph.out_edges(node), {}, [&](NodeId n) { return bottom_level_[n]; });
+        if (next == graph.out_edges(node).end())
+            break;
+        node = *next;
+    }
+}
+
+SimulationResult BuildSimulator::run(size_t jobs, SchedulingPolicy policy) const {
+    struct Ready {
+        uint64_t priority;
+        uint64_t sequence; ///< Breaks ties in the order steps became ready.
+        NodeId node;
+        bool operator<(const Ready &other) const {
+            return priority != other.priority ? priority < other.priority : sequence > other.sequence;
+        }
+    };
+    using Running = std::pair<uint64_t, NodeId>; // Finish time, output.
+
+    std::vector<uint32_t> in_degrees = in_degrees_;
+    std::priority_queue<Ready> ready;
+    std::priority_queue<Running, std::vector<Running>, std::greater<>> running;
+    std::vector<uint32_t> pool_running(graph_.pools().size(), 0);
+    std::vector<std::vector<Ready>> pool_waiting(graph_.pools().size());
+    uint64_t sequence = 0;
+    uint64_t now = 0;
+    uint64_t busy = 0;
+
+    // Files that no step produces are done as soon as they are ready, without taking a job.
+    std::vector<NodeId> done;
+    auto make_ready = [&](NodeId node) {
+        if (!graph_.node_step(node).has_value()) {
+            done.push_back(node);
+            return;
+        }
+        uint64_t priority = 0;
+        if (policy == SchedulingPolicy::LONGEST_FIRST)
+            priority = durations_[node];
+        else if (policy == SchedulingPolicy::CRITICAL_PATH)
+            priority = bottom_level_[node];
+        ready.push({.priority = priority, .sequence = sequence++, .node = node});
+    };
+    auto release_done = [&] {
+        while (!done.empty()) {
+            const NodeId finished = done.back();
+            done.pop_back();
+            for (NodeId next : graph_.out_edges(finished)) {
+                if (--in_degrees[next] == 0)
+                    make_ready(next);
+            }
+        }
+    };
+
+    for (NodeId node = 0; node < graph_.node_count(); ++node) {
+        if (in_degrees[node] == 0)
+            make_ready(node);
+    }
+    release_done();
+
+    for (;;) {
+        while (running.size() < jobs && !ready.empty()) {
+            const Ready next = ready.top();
+            ready.pop();
+            const PoolId pool = graph_.step_pool(graph_.step(*graph_.node_step(next.node)));
+            if (pool != NO_INDEX) {
+                if (pool_running[pool] >= graph_.pools()[pool].depth) {
+                    pool_waiting[pool].push_back(next);
+                    continue;
+                }
+                pool_running[pool]++;
+            }
+            running.emplace(now + durations_[next.node], next.node);
+            busy += durations_[next.node];
+        }
+        if (running.empty())
+            break;
+
+        const auto [finish_time, node] = running.top();
+        running.pop();
+        now = finish_time;
+        const PoolId pool = graph_.step_pool(graph_.step(*graph_.node_step(node)));
+        if (pool != NO_INDEX) {
+            pool_running[pool]--;
+            if (!pool_waiting[pool].empty()) {
+                ready.push(pool_waiting[pool].back());
+                pool_waiting[pool].pop_back();
+            }
+        }
+        done.push_back(node);
+        release_done();
+    }
+
+    SimulationResult result{.wall_us = now, .utilization = 0};
+    if (now > 0)
+        result.utilization = static_cast<double>(busy) / (static_cast<double>(now) * static_cast<double>(jobs));
+    return result;
+}
+
+} // namespace catalyst
@@ -0,0 +1,201 @@
+#include "cbe/stats.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <print>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace {
+using catalyst::Counter;
+using catalyst::Stats;
+
+constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+
+constexpr std::array<std::string_view, COUNTER_COUNT> COUNTER_NAMES = {
+    "nodes",
+    "edges",
+    "steps",
+    "steps run",
+    "stat calls",
+    "stat cache hits",
+    "depfiles read",
+    "bytes mapped",
+    "scheduler locks",
+    "scheduler lock wait (ns)",
+    "spawns",
+    "spawn time (ns)",
+    "peak ready queue depth",
+};
+
+constexpr bool isPeak(Counter counter) {
+    return counter == Counter::PEAK_QUEUE_DEPTH;
+}
+
+/** @brief Whether a counter only moves when steps run, so that a dry run leaves it at 0. */
+constexpr bool isStepRun(Counter counter) {
+    return counter == Counter::STEPS_RUN || counter == Counter::SPAWNS || counter == Counter::SPAWN_NS;
+}
+
+struct Histogram {
+    std::array<std::atomic<uint64_t>, Stats::HISTOGRAM_BUCKETS> buckets{};
+    std::atomic<uint64_t> sum = 0;
+    std::atomic<uint64_t> max = 0;
+};
+
+struct ThreadStats {
+    std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+    std::vector<std::unique_ptr<Histogram>> histograms; ///< Indexed by id, grown by the owning thread only.
+};
+
+struct HistogramInfo {
+    std::string name;
+    std::string_view unit;
+};
+
+// Blocks are owned here rather than by their threads, so the updates of workers that already exited are kept.
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadStats>> blocks;
+std::vector<HistogramInfo> histogram_infos;
+
+ThreadStats &localStats() {
+    thread_local ThreadStats *stats = nullptr;
+    if (stats == nullptr) {
+        std::lock_guard lock(registry_mutex);
+        stats = blocks.emplace_back(std::make_unique<ThreadStats>()).get();
+    }
+    return *stats;
+}
+
+size_t bucketOf(uint64_t value) {
+    return std::min<size_t>(std::bit_width(value), Stats::HISTOGRAM_BUCKETS - 1);
+}
+
+/** @brief Upper bound of the bucket holding the `fraction` quantile. */
+uint64_t quantile(const std::array<uint64_t, Stats::HISTOGRAM_BUCKETS> &buckets, uint64_t count, double fraction) {
+    const auto rank = static_cast<uint64_t>(static_cast<double>(count) * fraction);
+    uint64_t seen = 0;
+    for (size_t b = 0; b < buckets.size(); ++b) {
+        seen += buckets[b];
+        if (seen > rank)
+            return b == 0 ? 0 : (uint64_t{1} << b) - 1;
+    }
+    return 0;
+}
+
+uint64_t peakRssKib() {
+#ifndef _WIN32
+    rusage usage{};
+    if (::getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss) / 1024; // Bytes on macOS.
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+    }
+#endif
+    return 0;
+}
+} // namespace
+
+namespace catalyst {
+
+void Stats::add(Counter counter, uint64_t value) {
+    localStats().counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+void Stats::peak(Counter counter, uint64_t value) {
+    auto &slot = localStats().counters[static_cast<size_t>(counter)];
+    // Only the owning thread writes its block, so this is not a read-modify-write race.
+    if (value > slot.load(std::memory_order_relaxed))
+        slot.store(value, std::memory_order_relaxed);
+}
+
+Stats::HistogramId Stats::histogram(std::string_view name, std::string_view unit) {
+    std::lock_guard lock(registry_mutex);
+    for (size_t i = 0; i < histogram_infos.size(); ++i) {
+        if (histogram_infos[i].name == name && histogram_infos[i].unit == unit)
+            return static_cast<HistogramId>(i);
+    }
+    histogram_infos.push_back({.name = std::string(name), .unit = unit});
+    return static_cast<HistogramId>(histogram_infos.size() - 1);
+}
+
+void Stats::record(HistogramId histogram, uint64_t value) {
+    ThreadStats &stats = localStats();
+    if (histogram >= stats.histograms.size())
+        stats.histograms.resize(histogram + 1);
+    if (!stats.histograms[histogram])
+        stats.histograms[histogram] = std::make_unique<Histogram>();
+    Histogram &target = *stats.histograms[histogram];
+    target.buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    target.sum.fetch_add(value, std::memory_order_relaxed);
+    if (value > target.max.load(std::memory_order_relaxed))
+        target.max.store(value, std::memory_order_relaxed);
+}
+
+void Stats::print(std::FILE *out, bool steps_ran) {
+    std::lock_guard lock(registry_mutex);
+
+    if (steps_ran) {
+        std::println(out, "Counters:");
+    } else {
+        std::println(out, "Counters (no step ran, so spawns and step durations are left out):");
+    }
+    for (size_t c = 0; c < COUNTER_COUNT; ++c) {
+        if (!steps_ran && isStepRun(static_cast<Counter>(c)))
+            continue;
+        uint64_t total = 0;
+        for (const auto &block : blocks) {
+            const uint64_t value = block->counters[c].load(std::memory_order_relaxed);
+            total = isPeak(static_cast<Counter>(c)) ? std::max(total, value) : total + value;
+        }
+        std::println(out, "  {:<28}{:>16}", COUNTER_NAMES[c], total);
+    }
+    std::println(out, "  {:<28}{:>16}", "peak RSS (KiB)", peakRssKib());
+
+    for (size_t h = 0; h < histogram_infos.size(); ++h) {
+        std::array<uint64_t, HISTOGRAM_BUCKETS> buckets{};
+        uint64_t sum = 0;
+        uint64_t max = 0;
+        for (const auto &block : blocks) {
+            if (h >= block->histograms.size() || !block->histograms[h])
+                continue;
+            const Histogram &histogram = *block->histograms[h];
+            for (size_t b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+                buckets[b] += histogram.buckets[b].load(std::memory_order_relaxed);
+            }
+            sum += histogram.sum.load(std::memory_order_relaxed);
+            max = std::max(max, histogram.max.load(std::memory_order_relaxed));
+        }
+        uint64_t count = 0;
+        for (uint64_t n : buckets) {
+            count += n;
+        }
+        if (count == 0)
+            continue;
+
+        const HistogramInfo &info = histogram_infos[h];
+        std::println(out, "\n{} ({}): count {}, mean {}, p50 <={}, p90 <={}, p99 <={}, max {}", info.name, info.unit,
+                     count, sum / count, quantile(buckets, count, 0.5), quantile(buckets, count, 0.9),
+                     quantile(buckets, count, 0.99), max);
+        constexpr size_t TUNABLE_BAR_WIDTH = 40;
+        const uint64_t fullest = std::ranges::max(buckets);
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; ++b) {
+            if (buckets[b] == 0)
+                continue;
+            const uint64_t low = b == 0 ? 0 : uint64_t{1} << (b - 1);
+            const uint64_t high = b == 0 ? 0 : (uint64_t{1} << b) - 1;
+            const auto bar = static_cast<size_t>((buckets[b] * TUNABLE_BAR_WIDTH + fullest - 1) / fullest);
+            std::println(out, "  {:>12} - {:<12}{:>10} {}", low, high, buckets[b], std::string(bar, '#'));
+        }
+    }
+}
+
+} // namespace catalyst
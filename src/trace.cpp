@@ -0,0 +1,128 @@
+#include "cbe/trace.hpp"
+
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <utility>
+#include <vector>
+
+namespace {
+using catalyst::Trace;
+
+struct Event {
+    std::string name;
+    std::string_view category;
+    uint64_t id = 0;
+    bool async = false;
+    Trace::Clock::time_point begin;
+    Trace::Clock::time_point end;
+};
+
+struct ThreadBuffer {
+    uint32_t lane = 0;
+    std::string name;
+    std::vector<Event> events;
+};
+
+// Buffers are owned here rather than by their threads, so the events of workers that already exited are written.
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+Trace::Clock::time_point epoch;
+
+ThreadBuffer &localBuffer() {
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer == nullptr) {
+        constexpr size_t TUNABLE_TRACE_RESERVE = 1024;
+        auto owned = std::make_unique<ThreadBuffer>();
+        owned->events.reserve(TUNABLE_TRACE_RESERVE);
+        std::lock_guard lock(registry_mutex);
+        owned->lane = static_cast<uint32_t>(buffers.size() + 1);
+        buffer = buffers.emplace_back(std::move(owned)).get();
+    }
+    return *buffer;
+}
+
+double micros(Trace::Clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(time - epoch).count();
+}
+} // namespace
+
+namespace catalyst {
+
+void Trace::enable() {
+    epoch = Clock::now();
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Trace::name_thread(std::string name) {
+    if (enabled())
+        localBuffer().name = std::move(name);
+}
+
+void Trace::complete(std::string name, std::string_view category, Clock::time_point begin, Clock::time_point end) {
+    if (enabled())
+        localBuffer().events.push_back({.name = std::move(name), .category = category, .begin = begin, .end = end});
+}
+
+void Trace::async(std::string name, std::string_view category, uint64_t id, Clock::time_point begin,
+                  Clock::time_point end) {
+    if (enabled()) {
+        localBuffer().events.push_back(
+            {.name = std::move(name), .category = category, .id = id, .async = true, .begin = begin, .end = end});
+    }
+}
+
+Result<void> Trace::write(const std::string &path) {
+    using JSON = nlohmann::json;
+    JSON events = JSON::array();
+    events.push_back({{"name", "process_name"}, {"ph", "M"}, {"pid", 1}, {"args", {{"name", "cbe"}}}});
+
+    std::lock_guard lock(registry_mutex);
+    for (const auto &buffer : buffers) {
+        const std::string lane_name = buffer->name.empty() ? std::format("thread {}", buffer->lane) : buffer->name;
+        events.push_back({{"name", "thread_name"},
+                          {"ph", "M"},
+                          {"pid", 1},
+                          {"tid", buffer->lane},
+                          {"args", {{"name", lane_name}}}});
+        events.push_back({{"name", "thread_sort_index"},
+                          {"ph", "M"},
+                          {"pid", 1},
+                          {"tid", buffer->lane},
+                          {"args", {{"sort_index", buffer->lane}}}});
+        for (const Event &event : buffer->events) {
+            if (event.async) {
+                // Nestable async events: a begin and an end sharing an id, drawn on a track of their own.
+                for (const bool begin : {true, false}) {
+                    events.push_back({{"name", event.name},
+                                      {"cat", event.category},
+                                      {"ph", begin ? "b" : "e"},
+                                      {"id", event.id},
+                                      {"ts", micros(begin ? event.begin : event.end)},
+                                      {"pid", 1},
+                                      {"tid", buffer->lane}});
+                }
+            } else {
+                events.push_back({{"name", event.name},
+                                  {"cat", event.category},
+                                  {"ph", "X"},
+                                  {"ts", micros(event.begin)},
+                                  {"dur", std::chrono::duration<double, std::micro>(event.end - event.begin).count()},
+                                  {"pid", 1},
+                                  {"tid", buffer->lane}});
+            }
+        }
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file)
+        return std::unexpected(std::format("Failed to open trace file: {}", path));
+    file << JSON{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}}.dump();
+    if (!file)
+        return std::unexpected(std::format("Failed to write trace file: {}", path));
+    return {};
+}
+
+} // namespace catalyst
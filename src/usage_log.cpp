@@ -0,0 +1,111 @@
+#include "cbe/usage_log.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr std::string_view HEADER = "# output\ttool\twall_us\tuser_us\tsys_us\tmax_rss_kib\tread_blocks\twrite_blocks";
+constexpr size_t FIELD_COUNT = 8;
+
+/** @brief Splits a line on tabs; fails unless it has exactly `FIELD_COUNT` fields. */
+bool splitFields(std::string_view line, std::array<std::string_view, FIELD_COUNT> &fields) {
+    size_t count = 0;
+    while (count < FIELD_COUNT) {
+        const size_t tab = line.find('\t');
+        fields[count++] = line.substr(0, tab);
+        if (tab == std::string_view::npos)
+            return count == FIELD_COUNT;
+        line.remove_prefix(tab + 1);
+    }
+    return false;
+}
+
+bool parseNumber(std::string_view text, uint64_t &value) {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc{} && end == text.data() + text.size();
+}
+} // namespace
+
+namespace catalyst {
+
+Result<UsageLog> UsageLog::load(const std::string &path) {
+    UsageLog log;
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec))
+        return log;
+    std::ifstream file(path);
+    if (!file)
+        return std::unexpected(std::format("Failed to open usage log: {}", path));
+
+    std::string line;
+    std::array<std::string_view, FIELD_COUNT> fields;
+    while (std::getline(file, line)) {
+        if (line.starts_with('#') || !splitFields(line, fields))
+            continue;
+        Record record{.tool = std::string(fields[1]), .usage = {}};
+        StepUsage &usage = record.usage;
+        if (!parseNumber(fields[2], usage.wall_us) || !parseNumber(fields[3], usage.process.user_us) ||
+            !parseNumber(fields[4], usage.process.sys_us) || !parseNumber(fields[5], usage.process.max_rss_kib) ||
+            !parseNumber(fields[6], usage.process.read_blocks) || !parseNumber(fields[7], usage.process.write_blocks))
+            continue;
+        log.records_.insert_or_assign(std::string(fields[0]), std::move(record));
+    }
+    return log;
+}
+
+Result<void> UsageLog::save(const std::string &path) const {
+    std::vector<const std::pair<const std::string, Record> *> sorted;
+    sorted.reserve(records_.size());
+    for (const auto &entry : records_) {
+        sorted.push_back(&entry);
+    }
+    std::ranges::sort(sorted, {}, [](const auto *entry) -> const std::string & { return entry->first; });
+
+    std::string out;
+    out.reserve((sorted.size() + 1) * 96);
+    out += HEADER;
+    out += '\n';
+    for (const auto *entry : sorted) {
+        const StepUsage &usage = entry->second.usage;
+        std::format_to(std::back_inserter(out), "{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\n", entry->first, entry->second.tool,
+                       usage.wall_us, usage.process.user_us, usage.process.sys_us, usage.process.max_rss_kib,
+                       usage.process.read_blocks, usage.process.write_blocks);
+    }
+
+    // Written next to the log and renamed over it, so a build that dies while writing keeps the previous history.
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return std::unexpected(std::format("Failed to open usage log: {}", temp_path));
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+        file.close();
+        if (!file) {
+            std::error_code remove_ec;
+            std::filesystem::remove(temp_path, remove_ec);
+            return std::unexpected(std::format("Failed to write usage log: {}", temp_path));
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec) {
+        std::error_code remove_ec;
+        std::filesystem::remove(temp_path, remove_ec);
+        return std::unexpected(std::format("Failed to replace usage log {}: {}", path, ec.message()));
+    }
+    return {};
+}
+
+void UsageLog::set(std::string_view output, std::string_view tool, const StepUsage &usage) {
+    records_.insert_or_assign(std::string(output), Record{.tool = std::string(tool), .usage = usage});
+}
+
+} // namespace catalyst
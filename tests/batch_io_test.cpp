@@ -0,0 +1,108 @@
+#include "tests/test_suite.hpp"
+
+#include "cbe/batch_io.hpp"
+#include "cbe/usage_log.hpp"
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <print>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+using namespace catalyst;
+
+namespace {
+bool check(bool condition, std::string_view what) {
+    if (!condition)
+        std::println(std::cerr, "batch_io_test: {}", what);
+    return condition;
+}
+} // namespace
+
+bool batch_io_test() {
+    std::println("Starting Batch IO Test...");
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "cbe_batch_io_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    // More files than the ring holds at once, so requests have to be recycled.
+    constexpr size_t FILE_COUNT = 600;
+    std::vector<std::string> names;
+    std::vector<std::string> contents;
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        names.push_back((dir / std::format("f{}.txt", i)).string());
+        contents.push_back(std::string(i * 7, static_cast<char>('a' + i % 26)));
+    }
+    std::vector<std::string_view> paths(names.begin(), names.end());
+    std::vector<std::string_view> data(contents.begin(), contents.end());
+
+    BatchIO io(2);
+    std::println("Using {}", io.uses_io_uring() ? "io_uring" : "thread pool");
+
+    bool ok = true;
+    std::vector<std::error_code> errors(FILE_COUNT);
+    io.write(paths, data, errors);
+    for (size_t i = 0; i < FILE_COUNT; ++i)
+        ok &= check(!errors[i], std::format("write {} failed: {}", names[i], errors[i].message()));
+
+    std::vector<std::string> buffers(FILE_COUNT);
+    io.read(paths, buffers, errors);
+    for (size_t i = 0; i < FILE_COUNT; ++i) {
+        ok &= check(!errors[i], std::format("read {} failed", names[i]));
+        ok &= check(buffers[i] == contents[i], std::format("read {} returned the wrong contents", names[i]));
+    }
+
+    // Modification times must agree with std::filesystem, since the executor compares the two.
+    const std::string missing = (dir / "missing.txt").string();
+    std::vector<std::string_view> stat_paths = {paths[0], paths[FILE_COUNT - 1], missing};
+    std::vector<FileStat> stats(stat_paths.size());
+    io.stat(stat_paths, stats);
+    ok &= check(!stats[0].ec && stats[0].mtime == std::filesystem::last_write_time(names[0]), "mtime mismatch");
+    ok &= check(!stats[1].ec && stats[1].mtime == std::filesystem::last_write_time(names[FILE_COUNT - 1]),
+                "mtime mismatch");
+    ok &= check(static_cast<bool>(stats[2].ec), "stat of a missing file succeeded");
+
+    std::vector<std::string_view> read_missing = {missing};
+    std::vector<std::string> missing_buffer(1);
+    std::vector<std::error_code> missing_error(1);
+    io.read(read_missing, missing_buffer, missing_error);
+    ok &= check(static_cast<bool>(missing_error[0]), "read of a missing file succeeded");
+
+    // The usage log survives a round trip; malformed lines are skipped, not fatal.
+    {
+        const std::string usage_path = (dir / ".catalyst.usage").string();
+        std::ofstream(usage_path) << "# output\ttool\twall_us\n"
+                                  << "a.o\tcxx\t10\t8\t1\t2048\t0\t4\n"
+                                  << "b.o\tcxx\t10\tnan\t1\t2048\t0\t4\n"
+                                  << "c.o\tcxx\t10\n";
+        auto loaded = UsageLog::load(usage_path);
+        ok &= check(loaded && loaded->records().size() == 1 && loaded->records().contains("a.o"),
+                    "expected only the well-formed usage line");
+        if (loaded) {
+            loaded->set("app", "ld", {.wall_us = 300, .process = {.user_us = 250, .max_rss_kib = 4096}});
+            ok &= check(loaded->save(usage_path).has_value(), "saving the usage log failed");
+            ok &= check(!std::filesystem::exists(usage_path + ".tmp"), "temporary usage log left behind");
+            auto reloaded = UsageLog::load(usage_path);
+            ok &= check(reloaded && reloaded->records().size() == 2, "usage log lost records");
+            if (reloaded && reloaded->records().size() == 2) {
+                const StepUsage &app = reloaded->records().at("app").usage;
+                const StepUsage &object = reloaded->records().at("a.o").usage;
+                ok &= check(reloaded->records().at("app").tool == "ld" && app.wall_us == 300 &&
+                                app.process.user_us == 250 && app.process.max_rss_kib == 4096,
+                            "usage of app changed in the round trip");
+                ok &= check(object.wall_us == 10 && object.process.sys_us == 1 && object.process.write_blocks == 4,
+                            "usage of a.o changed in the round trip");
+            }
+        }
+    }
+
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::println("Batch IO Test passed!");
+    return ok;
+}
@@ -0,0 +1,136 @@
+#include "tests/test_suite.hpp"
+
+#include "cbe/builder.hpp"
+#include "cbe/command.hpp"
+#include "cbe/graph.hpp"
+
+#include <cstddef>
+#include <format>
+#include <iostream>
+#include <print>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace catalyst;
+
+namespace {
+bool check(bool condition, std::string_view what) {
+    if (!condition)
+        std::println(std::cerr, "command_test: {}", what);
+    return condition;
+}
+
+std::string join(std::span<const char *const> argv) {
+    std::string line;
+    for (const char *arg : argv) {
+        if (!line.empty())
+            line += ' ';
+        line += arg;
+    }
+    return line;
+}
+
+bool expectCommand(const BuildGraph &graph, const CommandTemplates &templates, CommandArena &arena,
+                   std::string_view output, std::string_view expected, std::string_view rsp_path = {}) {
+    const auto step_id = graph.node_step(graph.find_node(output));
+    if (!check(step_id.has_value(), std::format("no step produces {}", output)))
+        return false;
+    const auto argv = templates.emit(graph, graph.step(*step_id), arena, rsp_path);
+    const std::string line = join(argv);
+    return check(argv.data()[argv.size()] == nullptr, std::format("argv of {} is not null-terminated", output)) &&
+           check(line == expected, std::format("{}: expected '{}', got '{}'", output, expected, line));
+}
+} // namespace
+
+bool command_test() {
+    std::println("Starting Command Test...");
+
+    CBEBuilder builder;
+    builder.add_definition("cc", "gcc");
+    builder.add_definition("cflags", "-O2  -Wall");
+    builder.add_definition("cxx", "g++");
+    builder.add_definition("cxxflags", "-std=c++23");
+    builder.add_definition("ldflags", "-fuse-ld=mold");
+    builder.add_definition("ldlibs", "-lm -lpthread");
+    builder.add_definition("protoc", "tools/protoc");
+    builder.add_definition("proto_path", "proto");
+    if (!builder.add_pool("codegen", 2) ||
+        !builder.add_rule({.name = "proto",
+                           .command = "$protoc --proto_path=$proto_path --cpp_out=${out}_dir -I$in $$HOME",
+                           .depfile = "$out.d",
+                           .pool = "codegen"}) ||
+        !builder.add_rule({.name = "bundle", .command = "tar cf $out $in", .rsp = "$out.rsp"})) {
+        std::println(std::cerr, "command_test: failed to add rules");
+        return false;
+    }
+    if (!check(!builder.add_rule({.name = "cc", .command = "true"}), "rule shadowing a tool accepted") ||
+        !check(!builder.add_rule({.name = "x", .command = "true", .pool = "missing"}), "unknown pool accepted") ||
+        !check(!builder.add_rule({.name = "y", .command = "true", .depfile = "$in.d"}), "$in in depfile accepted") ||
+        !check(!builder.add_pool("none", 0), "pool of depth 0 accepted"))
+        return false;
+    if (!builder.add_step({.tool = "cc", .inputs = "a.c", .output = "a.o"}) ||
+        !builder.add_step({.tool = "cxx", .inputs = "b.cpp", .output = "b.o"}) ||
+        !builder.add_step({.tool = "ar", .inputs = "b.o", .output = "libb.a"}) ||
+        !builder.add_step({.tool = "sld", .inputs = "b.o", .output = "libb.so"}) ||
+        !builder.add_step({.tool = "ld", .inputs = "a.o,libb.a", .output = "app"}) ||
+        !builder.add_step({.tool = "proto", .inputs = "a.proto,b.proto", .output = "gen/a.pb"}) ||
+        !builder.add_step({.tool = "bundle", .inputs = "a.o,b.o", .output = "dist.tar"})) {
+        std::println(std::cerr, "command_test: failed to add steps");
+        return false;
+    }
+
+    if (auto res = builder.compile_templates(); !res) {
+        std::println(std::cerr, "command_test: {}", res.error());
+        return false;
+    }
+    const CommandTemplates &templates = builder.templates();
+    BuildGraph graph = builder.emit_graph();
+    CommandArena arena;
+
+    // Repeated spaces in a definition do not produce empty arguments.
+    bool ok = true;
+    ok &= expectCommand(graph, templates, arena, "a.o", "gcc -O2 -Wall -MMD -MF a.o.d -c a.c -o a.o");
+    ok &= expectCommand(graph, templates, arena, "b.o", "g++ -std=c++23 -MMD -MF b.o.d -c b.cpp -o b.o");
+    ok &= expectCommand(graph, templates, arena, "libb.a", "ar rcs libb.a b.o");
+    ok &= expectCommand(graph, templates, arena, "libb.so", "g++ -shared b.o -o libb.so");
+    ok &= expectCommand(graph, templates, arena, "app", "g++ a.o libb.a -o app -fuse-ld=mold -lm -lpthread");
+    ok &= expectCommand(graph, templates, arena, "app", "g++ @app.rsp -o app -fuse-ld=mold -lm -lpthread", "app.rsp");
+
+    // Definitions inside an argument are pasted as is, `$in` repeats its affixes for every input.
+    ok &= expectCommand(graph, templates, arena, "gen/a.pb",
+                        "tools/protoc --proto_path=proto --cpp_out=gen/a.pb_dir -Ia.proto -Ib.proto $HOME");
+    ok &= expectCommand(graph, templates, arena, "dist.tar", "tar cf dist.tar @dist.tar.rsp", "dist.tar.rsp");
+
+    // Counted like the kernel does: "ar" "rcs" "libb.a" "b.o" with terminators, and five pointers.
+    const StepView archive = graph.step(*graph.node_step(graph.find_node("libb.a")));
+    ok &= check(templates.argv_size(graph, archive) == 18 + 5 * sizeof(char *), "wrong argv size");
+    ok &= check(templates.takes_inputs(archive), "archive command has no inputs");
+
+    const StepView proto = graph.step(*graph.node_step(graph.find_node("gen/a.pb")));
+    std::string depfile;
+    ok &= check(graph.tool_name(proto) == "proto", "rule step not named after its rule");
+    ok &= check(graph.step_pool(proto) == 0, "rule step not in its pool");
+    ok &= check(graph.depfile_path(proto, depfile) && depfile == "gen/a.pb.d", "rule depfile not expanded");
+
+    // A definition added after the templates were compiled, like a command line `ldlibs=-lfoo`, still applies.
+    CBEBuilder overridden;
+    overridden.add_definition("cxx", "g++");
+    if (!overridden.add_step({.tool = "ld", .inputs = "a.o", .output = "app"}) || !overridden.compile_templates()) {
+        std::println(std::cerr, "command_test: failed to build the override graph");
+        return false;
+    }
+    overridden.add_definition("ldlibs", "-lfoo");
+    overridden.add_definition("cxx", "clang++");
+    if (auto res = overridden.compile_templates(); !res) {
+        std::println(std::cerr, "command_test: {}", res.error());
+        return false;
+    }
+    BuildGraph overridden_graph = overridden.emit_graph();
+    ok &= expectCommand(overridden_graph, overridden.templates(), arena, "app", "g++ a.o -o app -lfoo");
+
+    if (ok)
+        std::println("Command Test passed!");
+    return ok;
+}
@@ -0,0 +1,318 @@
+#include "tests/test_suite.hpp"
+
+#include "cbe/batch_io.hpp"
+#include "cbe/builder.hpp"
+#include "cbe/executor.hpp"
+#include "cbe/graph.hpp"
+#include "cbe/path_table.hpp"
+#include "cbe/simulator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <print>
+#include <span>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace catalyst;
+
+namespace {
+bool check(bool condition, std::string_view what) {
+    if (!condition)
+        std::println(std::cerr, "graph_test: {}", what);
+    return condition;
+}
+} // namespace
+
+bool graph_test() {
+    std::println("Starting Graph Test...");
+
+    CBEBuilder builder;
+    // Every spelling of the same header must end up as one node, and one edge.
+    if (!builder.add_step({.tool = "cxx", .inputs = "./src/a.cpp,!include/a.h,!src/../include/a.h", .output = "a.o"}) ||
+        !builder.add_step({.tool = "cxx", .inputs = "src/b.cpp,!include//a.h", .output = "./b.o"}) ||
+        !builder.add_step({.tool = "ld", .inputs = "a.o,b.o", .output = "app"})) {
+        std::println(std::cerr, "graph_test: failed to add steps");
+        return false;
+    }
+    if (!check(!builder.add_step({.tool = "cc", .inputs = "x.c", .output = "b.o"}), "duplicate producer accepted") ||
+        !check(!builder.add_step({.tool = "nope", .inputs = "x.c", .output = "x.o"}), "unknown tool accepted"))
+        return false;
+    if (!check(builder.add_alias({.name = "objs", .targets = "a.o,b.o"}).has_value(), "alias rejected") ||
+        !check(builder.add_alias({.name = "all", .targets = "objs,app,all"}).has_value(), "alias rejected") ||
+        !check(!builder.add_alias({.name = "objs", .targets = "app"}), "duplicate alias accepted"))
+        return false;
+
+    BuildGraph graph = builder.emit_graph();
+    bool ok = true;
+    ok &= check(graph.node_count() == 6, "expected 6 nodes (a.cpp, b.cpp, a.h, a.o, b.o, app)");
+    ok &= check(graph.edge_count() == 6, "expected 6 deduplicated edges");
+    ok &= check(graph.find_node("include/a.h") == graph.find_node("./include/../include/a.h"), "paths not canonical");
+    ok &= check(graph.find_node("missing.h") == INVALID_ID, "unknown path resolved");
+
+    // Nodes are renumbered in topological order: every edge points forward.
+    for (NodeId i = 0; i < graph.node_count(); ++i) {
+        for (NodeId to : graph.out_edges(i)) {
+            ok &= check(to > i, "edge does not point forward after finalize");
+        }
+    }
+
+    const NodeId app = graph.find_node("app");
+    ok &= check(app != INVALID_ID && graph.node_step(app).has_value(), "app has no producing step");
+    if (app != INVALID_ID && graph.node_step(app)) {
+        const StepView link = graph.step(*graph.node_step(app));
+        ok &= check(link.tool == Tool::LD && link.inputs.size() == 2, "link step not preserved");
+    }
+
+    auto levels = graph.topo_sort(1);
+    ok &= check(levels.has_value() && levels->level_count() == 3, "expected 3 levels (sources, objects, app)");
+
+    // Aliases expand to their targets, nested ones included and each once; a target's closure is what it is built
+    // from, in topological order.
+    auto objs = graph.resolve_targets(std::vector<std::string>{"objs"});
+    auto all = graph.resolve_targets(std::vector<std::string>{"all"});
+    ok &= check(objs && objs->size() == 2, "alias not expanded");
+    ok &= check(all && all->size() == 3, "nested alias not expanded exactly once");
+    ok &= check(!graph.resolve_targets(std::vector<std::string>{"nope"}), "unknown target resolved");
+    if (objs && objs->size() == 2) {
+        const std::vector<NodeId> closure = graph.closure(std::span(*objs).first(1));
+        ok &= check(closure.size() == 3 && std::ranges::is_sorted(closure), "expected source, header and object");
+        ok &= check(graph.closure(std::vector<NodeId>{app}).size() == 6, "closure of app is the whole graph");
+        ok &= check(graph.is_acyclic(graph.closure(std::vector<NodeId>{app})), "acyclic closure has a cycle");
+    }
+
+    // Every cycle is reported, not only the first one found.
+    CBEBuilder cyclic;
+    for (auto [inputs, output] : {std::pair{"y", "x"}, {"x", "y"}, {"s", "s"}, {"x,q", "p"}, {"p", "q"}}) {
+        ok &= check(cyclic.add_step({.tool = "ar", .inputs = inputs, .output = output}).has_value(), "add cyclic step");
+    }
+    BuildGraph cyclic_graph = cyclic.emit_graph();
+    auto cycles = cyclic_graph.topo_sort(1);
+    ok &= check(!cycles && cycles.error().starts_with("3 cycle(s)"), "expected 3 cycles to be reported");
+    for (std::string_view target : {"s", "p"}) {
+        ok &= check(!cyclic_graph.is_acyclic(cyclic_graph.closure(std::vector{cyclic_graph.find_node(target)})),
+                    "cycle in a closure not found");
+    }
+
+    // A string too long to share a chunk gets its own, even as the first copy, and short ones still fit after it.
+    StringArena arena;
+    const std::string long_string(64 * 1024, 'l');
+    ok &= check(arena.copy(long_string) == long_string, "long string not copied");
+    ok &= check(arena.copy("short") == "short", "short string after a long one not copied");
+
+    // The parallel frontier expansion must produce the same levels as the serial one.
+    CBEBuilder wide;
+    std::vector<std::string> names;
+    constexpr size_t LAYERS = 8;
+    constexpr size_t WIDTH = 4096;
+    names.reserve(LAYERS * WIDTH * 2);
+    for (size_t layer = 1; layer < LAYERS; ++layer) {
+        for (size_t i = 0; i < WIDTH; ++i) {
+            std::string &inputs = names.emplace_back();
+            for (size_t k = 0; k < 4; ++k) {
+                inputs += std::format("{}n{}_{}", inputs.empty() ? "" : ",", layer - 1, (i * 7 + k * 131) % WIDTH);
+            }
+            std::string &output = names.emplace_back(std::format("n{}_{}", layer, i));
+            ok &= check(wide.add_step({.tool = "ar", .inputs = inputs, .output = output}).has_value(), "add wide step");
+        }
+    }
+    BuildGraph wide_graph = wide.emit_graph();
+    auto serial = wide_graph.topo_sort(1);
+    auto parallel = wide_graph.topo_sort(4);
+    ok &= check(serial && parallel && serial->level_offsets == parallel->level_offsets, "parallel levels differ");
+    ok &= check(serial && serial->level_count() == LAYERS, "wide graph level count");
+
+    // A simulated build of a known graph: two objects of 3s and 1s, then a 2s link.
+    {
+        CBEBuilder timed;
+        ok &= check(timed.add_step({.tool = "cxx", .inputs = "a.cpp", .output = "a.o"}).has_value() &&
+                        timed.add_step({.tool = "cxx", .inputs = "b.cpp", .output = "b.o"}).has_value() &&
+                        timed.add_step({.tool = "ld", .inputs = "a.o,b.o", .output = "app"}).has_value(),
+                    "add timed steps");
+        BuildGraph timed_graph = timed.emit_graph();
+        auto timed_levels = timed_graph.topo_sort(1);
+        std::vector<uint64_t> durations(timed_graph.step_count(), 0);
+        for (auto [output, us] : {std::pair{"a.o", 3'000'000}, {"b.o", 1'000'000}, {"app", 2'000'000}}) {
+            durations[*timed_graph.node_step(timed_graph.find_node(output))] = us;
+        }
+        if (check(timed_levels.has_value(), "timed graph has a cycle")) {
+            const BuildSimulator simulator(timed_graph, timed_levels->order, durations);
+            ok &= check(simulator.total_work_us() == 6'000'000, "total work");
+            ok &= check(simulator.critical_path_us() == 5'000'000, "critical path length");
+            ok &= check(std::ranges::equal(simulator.critical_path(), std::vector{timed_graph.find_node("a.o"),
+                                                                                   timed_graph.find_node("app")}),
+                        "critical path steps");
+            ok &= check(simulator.run(1, SchedulingPolicy::FIFO).wall_us == 6'000'000, "makespan on one job");
+            const SimulationResult two_jobs = simulator.run(2, SchedulingPolicy::CRITICAL_PATH);
+            ok &= check(two_jobs.wall_us == 5'000'000 && two_jobs.utilization == 0.6, "makespan on two jobs");
+        }
+    }
+
+    // Hotspots of a diamond: the shared header rebuilds both objects and the link, which counts once.
+    {
+        CBEBuilder diamond;
+        ok &= check(diamond.add_step({.tool = "cxx", .inputs = "x.cpp,!a.h", .output = "x.o"}).has_value() &&
+                        diamond.add_step({.tool = "cxx", .inputs = "y.cpp,!a.h", .output = "y.o"}).has_value() &&
+                        diamond.add_step({.tool = "ld", .inputs = "x.o,y.o", .output = "app"}).has_value(),
+                    "add diamond steps");
+        BuildGraph diamond_graph = diamond.emit_graph();
+        std::vector<uint64_t> weights(diamond_graph.step_count(), 0);
+        for (auto [output, weight] : {std::pair{"x.o", 1}, {"y.o", 2}, {"app", 4}}) {
+            weights[*diamond_graph.node_step(diamond_graph.find_node(output))] = weight;
+        }
+        auto ranked = [&](std::span<const uint64_t> touches) {
+            std::vector<std::tuple<std::string_view, uint32_t, uint64_t>> result;
+            for (const Hotspot &hotspot : Executor::rank_hotspots(diamond_graph, weights, touches)) {
+                result.emplace_back(diamond_graph.node_path(hotspot.input), hotspot.rebuilds, hotspot.cost);
+            }
+            return result;
+        };
+        using Ranked = std::vector<std::tuple<std::string_view, uint32_t, uint64_t>>;
+        ok &= check(ranked({}) == Ranked{{"a.h", 3, 7}, {"y.cpp", 2, 6}, {"x.cpp", 2, 5}}, "diamond hotspots");
+        std::vector<uint64_t> touches(diamond_graph.node_count(), 1);
+        touches[diamond_graph.find_node("x.cpp")] = 3;
+        ok &= check(ranked(touches) == Ranked{{"x.cpp", 2, 5}, {"a.h", 3, 7}, {"y.cpp", 2, 6}},
+                    "diamond hotspots weighted by touches");
+    }
+
+    // Why steps rebuild: a missing output, a header newer than its object, a missing source, and a link of a step
+    // that rebuilds.
+    {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "cbe_dirty_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        const std::string base = dir.string();
+        auto path = [&](std::string_view name) { return std::format("{}/{}", base, name); };
+        const auto start = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+        for (auto [name, age] : {std::pair{"catalyst.build", 0}, {"a.cpp", 1}, {"b.cpp", 1}, {"c.cpp", 1},
+                                 {"a.o", 2}, {"c.o", 2}, {"d.o", 2}, {"a.h", 3}, {"app", 4}, {"lib", 4}}) {
+            std::ofstream(path(name)) << name;
+            std::filesystem::last_write_time(path(name), start + std::chrono::seconds(age));
+        }
+        // The builder keeps views of the step strings.
+        const std::vector<std::pair<std::string, std::string>> stale_steps = {
+            {path("a.cpp") + ",!" + path("a.h"), path("a.o")},
+            {path("b.cpp"), path("b.o")},
+            {path("c.cpp"), path("c.o")},
+            {path("d.cpp"), path("d.o")},
+            {path("a.o") + "," + path("b.o"), path("app")},
+            {path("c.o"), path("lib")}};
+        CBEBuilder stale;
+        for (const auto &[inputs, output] : stale_steps) {
+            ok &= check(stale.add_step({.tool = "ar", .inputs = inputs, .output = output}).has_value(),
+                        "add stale step");
+        }
+        BuildGraph stale_graph = stale.emit_graph();
+        auto stale_levels = stale_graph.topo_sort(1);
+        if (check(stale_levels.has_value(), "stale graph has a cycle")) {
+            BatchIO io(1);
+            StatCache stat_cache;
+            stat_cache.prefetch(stale_graph, path("catalyst.build"), io);
+            const std::vector<uint8_t> causes = Executor::find_dirty(stale_graph, stale_levels->order, stat_cache);
+            auto cause = [&](std::string_view name) {
+                return static_cast<RebuildCause>(causes[stale_graph.find_node(path(name))]);
+            };
+            ok &= check(cause("a.o") == RebuildCause::INPUT_NEWER, "newer header not found");
+            ok &= check(cause("b.o") == RebuildCause::OUTPUT_MISSING, "missing output not found");
+            ok &= check(cause("c.o") == RebuildCause::CLEAN && cause("lib") == RebuildCause::CLEAN, "clean step");
+            ok &= check(cause("d.o") == RebuildCause::INPUT_MISSING, "missing input not found");
+            ok &= check(cause("app") == RebuildCause::INPUT_DIRTY, "upstream rebuild not propagated");
+        }
+        std::filesystem::remove_all(dir);
+    }
+
+    // Identical depfile header lists are stored once, and only generated headers become edges.
+    {
+        const std::filesystem::path dir = std::filesystem::temp_directory_path() / "cbe_graph_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        const std::string base = dir.string();
+        std::string headers;
+        for (size_t i = 0; i < 200; ++i) {
+            headers += std::format(" {}/inc/h{}.h", base, i);
+        }
+        auto write = [](const std::string &path, const std::string &content) { std::ofstream(path) << content; };
+        for (std::string_view tu : {"a", "b", "c"}) {
+            write(std::format("{}/{}.o", base, tu), "");
+            std::string extra = tu == "c" ? std::format(" {}/inc/c_only.h", base) : "";
+            write(std::format("{}/{}.o.d", base, tu),
+                  std::format("{0}/{1}.o: {0}/{1}.cpp{2} {0}/gen.h{3}\n", base, tu, headers, extra));
+        }
+
+        std::vector<std::string> step_names;
+        for (std::string_view tu : {"a", "b", "c"}) {
+            step_names.push_back(std::format("{}/{}.cpp", base, tu));
+            step_names.push_back(std::format("{}/{}.o", base, tu));
+        }
+        step_names.push_back(base + "/gen.in");
+        step_names.push_back(base + "/gen.h");
+        auto add_steps = [&](CBEBuilder &target) {
+            for (size_t i = 0; i + 1 < step_names.size(); i += 2) {
+                ok &= check(target
+                                .add_step({.tool = i + 2 == step_names.size() ? "ar" : "cxx",
+                                           .inputs = step_names[i],
+                                           .output = step_names[i + 1]})
+                                .has_value(),
+                            "add depfile step");
+            }
+        };
+        CBEBuilder deps;
+        add_steps(deps);
+        BuildGraph dep_graph = deps.emit_graph(2);
+        auto step_of = [&](std::string_view output) {
+            return dep_graph.step(*dep_graph.node_step(dep_graph.find_node(output)));
+        };
+        const StepView a = step_of(step_names[1]);
+        const StepView b = step_of(step_names[3]);
+        const StepView c = step_of(step_names[5]);
+        ok &= check(a.depfile_set != INVALID_ID && a.depfile_set == b.depfile_set, "identical depfiles not shared");
+        ok &= check(c.depfile_set != a.depfile_set, "different depfiles shared");
+        ok &= check(dep_graph.depset_count() == 2, "expected 2 dependency sets");
+
+        size_t a_inputs = 0;
+        bool has_source = false;
+        dep_graph.for_each_depfile_input(a, [&](NodeId id) {
+            ++a_inputs;
+            has_source |= id == a.inputs[0];
+        });
+        ok &= check(a_inputs == 201 && !has_source, "expected 200 headers plus gen.h, without the source");
+
+        // One header more only changes the chunk it lands in.
+        auto chunks_a = dep_graph.depset_chunks(a.depfile_set);
+        auto chunks_c = dep_graph.depset_chunks(c.depfile_set);
+        size_t shared = 0;
+        for (uint32_t chunk : chunks_c) {
+            shared += std::ranges::find(chunks_a, chunk) != chunks_a.end();
+        }
+        ok &= check(shared + 1 >= chunks_a.size(), "a one-header difference changed more than one chunk");
+
+        // 3 source edges, gen.in -> gen.h and 3 generated-header edges; plain headers get none.
+        ok &= check(dep_graph.edge_count() == 7, "expected only generated depfile inputs to become edges");
+
+        // Selecting a.o reads its depfile only, which leads to the producer of gen.h.
+        CBEBuilder selected;
+        add_steps(selected);
+        const NodeId a_target = selected.graph().find_node(step_names[1]);
+        BuildGraph selected_graph = selected.emit_graph(2, std::span(&a_target, 1));
+        auto selected_step = [&](std::string_view output) {
+            return selected_graph.step(*selected_graph.node_step(selected_graph.find_node(output)));
+        };
+        ok &= check(selected_step(step_names[1]).depfile_set != INVALID_ID, "depfile of the target not read");
+        ok &= check(selected_step(step_names[3]).depfile_set == INVALID_ID, "depfile outside the target read");
+        const std::vector<NodeId> a_closure =
+            selected_graph.closure(std::vector<NodeId>{selected_graph.find_node(step_names[1])});
+        ok &= check(std::ranges::find(a_closure, selected_graph.find_node(base + "/gen.in")) != a_closure.end(),
+                    "producer of a generated header not selected");
+        std::filesystem::remove_all(dir);
+    }
+
+    if (ok)
+        std::println("Graph Test passed!");
+    return ok;
+}
@@ -3,5 +3,5 @@
 #include <cassert>
 
 int main(int argc, char **argv) {
-    return !(integration_test() && opaque_deps_test());
+    return !(graph_test() && batch_io_test() && command_test() && integration_test() && opaque_deps_test());
 }